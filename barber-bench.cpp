@@ -4,20 +4,31 @@
 #include "utils.h"
 #include "box.h"
 #include "logger.h"
+#include "compositor.h"
+#include "sim-clock.h"
 #include "barber-bench.h"
 
 static const int skel_length = (MAX_BARBERS*4*3+3)*4;
 
 static char* to_string_barber_bench(BarberBench* bench);
 
-void init_barber_bench(BarberBench* bench, int num_seats, int vertical_orientation, int line, int column)
+size_t sizeof_barber_bench_arrays(int num_seats)
+{
+   require (num_seats > 0, concat_3str("invalid number of seats (", int2str(num_seats), ")"));
+
+   return storage_size(num_seats*sizeof(int));
+}
+
+void init_barber_bench(BarberBench* bench, int num_seats, int vertical_orientation, int line, int column, Storage* storage)
 {
    require (bench != NULL, "bench argument required");
-   require (num_seats > 0 && num_seats <= MAX_BARBERS, concat_5str("invalid number of seats (", int2str(num_seats), " not in [1,", int2str(MAX_BARBERS), "])"));
+   require (num_seats > 0 && (global->HEADLESS || num_seats <= MAX_BARBERS), concat_5str("invalid number of seats (", int2str(num_seats), " not in [1,", int2str(MAX_BARBERS), "])"));
    require (line >= 0, concat_3str("Invalid line (", int2str(line), ")"));
    require (column >= 0, concat_3str("Invalid column (", int2str(column), ")"));
+   require (storage != NULL, "storage argument required");
 
    bench->numSeats = num_seats;
+   bench->id = (int*)storage_alloc(storage, num_seats*sizeof(int));
    for(int i = 0; i < num_seats; i++)
       bench->id[i] = 0; // empty
    bench->verticalOrientation = vertical_orientation;
@@ -39,8 +50,8 @@ void log_barber_bench(BarberBench* bench)
 {
    require (bench != NULL, "bench argument required");
 
-   spend(random_int(global->MIN_VITALITY_TIME_UNITS, global->MAX_VITALITY_TIME_UNITS));
-   send_log(bench->logId, to_string_barber_bench(bench));
+   if (!global->HEADLESS)
+      compose_log(bench->logId, to_string_barber_bench(bench));
 }
 
 static char* to_string_barber_bench(BarberBench* bench)
@@ -144,6 +155,7 @@ int random_sit_in_barber_bench(BarberBench* bench, int id)
    check (bench->id[res] == 0, "");
 
    bench->id[res] = id;
+   pace_sim_clock();
    log_barber_bench(bench);
 
    ensure (res >= 0 && res < bench->numSeats, "");
@@ -158,6 +170,7 @@ void rise_barber_bench(BarberBench* bench, int pos)
    require (bench_seat_occupied(bench, pos), concat_3str("barber bench sit ",int2str(pos)," is empty"));
 
    bench->id[pos] = 0;
+   pace_sim_clock();
    log_barber_bench(bench);
 }
 
@@ -12,13 +12,14 @@
 typedef struct _BarberBench_
 {
    int numSeats;
-   int id[MAX_BARBERS];
+   int* id;         // [numSeats]
    int verticalOrientation;
    int logId;
    char* internal;
 } BarberBench;
 
-void init_barber_bench(BarberBench* bench, int num_seats, int vertical_orientation, int line, int column);
+size_t sizeof_barber_bench_arrays(int num_seats);
+void init_barber_bench(BarberBench* bench, int num_seats, int vertical_orientation, int line, int column, Storage* storage);
 void term_barber_bench(BarberBench* bench);
 void log_barber_bench(BarberBench* bench);
 
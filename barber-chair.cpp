@@ -3,7 +3,10 @@
 #include "global.h"
 #include "utils.h"
 #include "box.h"
+#include "box-template.h"
 #include "logger.h"
+#include "compositor.h"
+#include "sim-clock.h"
 #include "barber-chair.h"
 
 static const char* skel = 
@@ -15,18 +18,21 @@ static const char* skel =
    "  |B##|\n"
    "  @---@";
 
+static int numLines = string_num_lines((char*)skel);       // (skeleton scanned once)
+static int numColumns = string_num_columns((char*)skel);
+static BoxTemplate skel_boxes;      // (compiled by the first init of a rendered shop)
 static int skel_length = num_lines_barber_chair()*(num_columns_barber_chair()+1)*4; // extra space for (pessimistic) utf8 encoding!
 
 static char* to_string_barber_chair(BarberChair* chair);
 
 int num_lines_barber_chair()
 {
-   return string_num_lines((char*)skel);
+   return numLines;
 }
 
 int num_columns_barber_chair()
 {
-   return string_num_columns((char*)skel);
+   return numColumns;
 }
 
 void init_barber_chair(BarberChair* chair, int id, int line, int column)
@@ -41,16 +47,22 @@ void init_barber_chair(BarberChair* chair, int id, int line, int column)
    chair->barberID = 0;
    chair->toolsHolded = 0;
    chair->completionPercentage = -1;
-   chair->internal = NULL;
-   char buf[31];
-   gen_boxes(buf, 30, "Chair #.##: progress:", "#", int2nstr(chair->id, 2));
+   chair->internal = (char*)mem_alloc(skel_length + 1);
    static char* translations[] = {
       SCISSOR, (char*)"Scissor",
       COMB, (char*)"Comb",
       RAZOR, (char*)"Razor",
       NULL
    };
-   chair->logId = register_logger(buf, line ,column , num_lines_barber_chair(), num_columns_barber_chair(), translations);
+   chair->logId = -1;
+   if (!global->HEADLESS) // the logger only registers the areas of a rendered shop
+   {
+      if (!compiled_box_template(&skel_boxes))
+         init_box_template(&skel_boxes, skel);
+      char buf[31];
+      gen_boxes(buf, 30, "Chair #.##: progress:", "#", int2nstr(chair->id, 2));
+      chair->logId = register_logger(buf, line ,column , num_lines_barber_chair(), num_columns_barber_chair(), translations);
+   }
 }
 
 void term_barber_chair(BarberChair* chair)
@@ -68,8 +80,8 @@ void log_barber_chair(BarberChair* chair)
 {
    require (chair != NULL, "chair argument required");
 
-   spend(random_int(global->MIN_VITALITY_TIME_UNITS, global->MAX_VITALITY_TIME_UNITS));
-   send_log(chair->logId, to_string_barber_chair(chair));
+   if (!global->HEADLESS)
+      compose_log(chair->logId, to_string_barber_chair(chair));
 }
 
 static char* to_string_barber_chair(BarberChair* chair)
@@ -98,10 +110,10 @@ static char* to_string_barber_chair(BarberChair* chair)
    }
    else if (chair->toolsHolded & RAZOR_TOOL)
       strcpy(t1, RAZOR);
-   return gen_boxes(chair->internal, skel_length, skel,
-                    chair->completionPercentage < 0 ? " ---" : perc2str(chair->completionPercentage),
-                    t1, barber_chair_with_a_client(chair) ? int2nstr(chair->clientID, 2) : "--", t2,
-                    barber_chair_with_a_barber(chair) ? int2nstr(chair->barberID, 2) : "--");
+   return gen_box_template(&skel_boxes, chair->internal, skel_length,
+                           chair->completionPercentage < 0 ? " ---" : perc2str(chair->completionPercentage),
+                           t1, barber_chair_with_a_client(chair) ? int2nstr(chair->clientID, 2) : "--", t2,
+                           barber_chair_with_a_barber(chair) ? int2nstr(chair->barberID, 2) : "--");
 }
 
 int empty_barber_chair(BarberChair* chair)
@@ -162,6 +174,7 @@ void reserve_barber_chair(BarberChair* chair, int barberID)
 
    chair->barberID = barberID;
    chair->completionPercentage = 0;
+   pace_sim_clock();
    log_barber_chair(chair);
 }
 
@@ -175,6 +188,7 @@ void release_barber_chair(BarberChair* chair, int barberID)
    chair->barberID = 0;
    chair->toolsHolded = 0;
    chair->completionPercentage = -1;
+   pace_sim_clock();
    log_barber_chair(chair);
 }
 
@@ -185,6 +199,7 @@ void sit_in_barber_chair(BarberChair* chair, int clientID)
    require (!barber_chair_with_a_client(chair), "chair occupied with a client");
 
    chair->clientID = clientID;
+   pace_sim_clock();
    log_barber_chair(chair);
 }
 
@@ -196,6 +211,7 @@ void rise_from_barber_chair(BarberChair* chair, int clientID)
    require (barber_chair_service_finished(chair), "barber chair service not complete");
 
    chair->clientID = 0;
+   pace_sim_clock();
    log_barber_chair(chair);
 }
 
@@ -206,6 +222,7 @@ void set_tools_barber_chair(BarberChair* chair, int tools)
    require (complete_barber_chair(chair), "barber chair is not complete");
 
    chair->toolsHolded = tools;
+   pace_sim_clock();
    log_barber_chair(chair);
 }
 
@@ -226,6 +243,7 @@ void set_completion_barber_chair(BarberChair* chair, int completionPercentage)
    require (complete_barber_chair(chair), "barber chair is not complete");
 
    chair->completionPercentage = completionPercentage;
+   pace_sim_clock();
    log_barber_chair(chair);
 }
 
@@ -7,6 +7,8 @@
 #ifndef BARBER_CHAIR_H
 #define BARBER_CHAIR_H
 
+#include "global.h"
+
 typedef struct _BarberChair_
 {
    int id; // 1, 2, ... (position in barber shop)
@@ -16,7 +18,7 @@ typedef struct _BarberChair_
    int completionPercentage; // [0;100]
    int logId;
    char* internal;
-} BarberChair;
+} CACHE_ALIGNED BarberChair;
 
 // tools mask:
 #define SCISSOR_TOOL 1
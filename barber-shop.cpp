@@ -6,6 +6,7 @@
 #include "utils.h"
 #include "box.h"
 #include "logger.h"
+#include "compositor.h"
 #include "global.h"
 #include "barber-shop.h"
 
@@ -27,32 +28,66 @@ int num_lines_barber_shop(BarberShop* shop)
 {
    require (shop != NULL, "shop argument required");
 
-   return 1+3+num_lines_barber_chair()+num_lines_tools_pot()+3*shop->numClientBenches+1;
+   return layout_lines_barber_shop(shop->numClientBenches);
 }
 
 int num_columns_barber_shop(BarberShop* shop)
 {
    require (shop != NULL, "shop argument required");
 
+   return layout_columns_barber_shop();
+}
+
+int layout_lines_barber_shop(int num_client_benches)
+{
+   require (num_client_benches > 0, concat_3str("invalid number of client benches (", int2str(num_client_benches), ")"));
+
+   return 1+3+num_lines_barber_chair()+num_lines_tools_pot()+3*num_client_benches+1;
+}
+
+int layout_columns_barber_shop()
+{
    struct winsize w;
-   ioctl(STDOUT_FILENO, TIOCGWINSZ, &w);
+   if (ioctl(STDOUT_FILENO, TIOCGWINSZ, &w) == -1) // not a terminal
+      w.ws_col = 0;
 
    return w.ws_col == 0 ? 80 : w.ws_col;
 }
 
+size_t sizeof_barber_shop_arrays(int num_barbers, int num_chairs, int num_basins,
+                                 int num_client_benches_seats, int num_clients)
+{
+   require (num_barbers > 0, concat_3str("invalid number of barbers (", int2str(num_barbers), ")"));
+   require (num_chairs > 0, concat_3str("invalid number of chairs (", int2str(num_chairs), ")"));
+   require (num_basins > 0, concat_3str("invalid number of washbasins (", int2str(num_basins), ")"));
+   require (num_client_benches_seats > 0, concat_3str("invalid number of client benches seats (", int2str(num_client_benches_seats), ")"));
+   require (num_clients > 0, concat_3str("invalid number of clients (", int2str(num_clients), ")"));
+
+   return storage_size(num_chairs*sizeof(BarberChair)) + storage_size(num_basins*sizeof(Washbasin)) +
+          sizeof_resource_pool_arrays(num_chairs) + sizeof_resource_pool_arrays(num_basins) +
+          sizeof_tools_pot_arrays(num_barbers) +
+          storage_size(num_clients*sizeof(int)) +
+          storage_size(num_client_benches_seats*sizeof(SeatMailbox)) + storage_size((num_clients+1)*sizeof(int)) +
+          storage_size((num_barbers+1)*sizeof(ServiceChannel)) +
+          sizeof_barber_bench_arrays(num_barbers) + sizeof_client_benches_arrays(num_client_benches_seats);
+}
+
 void init_barber_shop(BarberShop* shop, int num_barbers, int num_chairs,
                       int num_scissors, int num_combs, int num_razors, int num_basins, 
-                      int num_client_benches_seats, int num_client_benches)
+                      int num_client_benches_seats, int num_client_benches,
+                      int num_clients, Storage* storage)
 {
    require (shop != NULL, "shop argument required");
-   require (num_barbers > 0 && num_barbers <= MAX_BARBERS, concat_5str("invalid number of barbers (", int2str(num_barbers), " not in [1,", int2str(MAX_BARBERS), "])"));
-   require (num_chairs > 0 && num_chairs <= MAX_BARBER_CHAIRS, concat_5str("invalid number of chairs (", int2str(num_chairs), " not in [1,", int2str(MAX_BARBER_CHAIRS), "])"));
-   require (num_scissors > 0 && num_scissors <= MAX_NUM_TOOLS, concat_5str("invalid number of scissors (", int2str(num_scissors), " not in [1,", int2str(MAX_NUM_TOOLS), "])"));
-   require (num_combs > 0 && num_combs <= MAX_NUM_TOOLS, concat_5str("invalid number of combs (", int2str(num_combs), " not in [1,", int2str(MAX_NUM_TOOLS), "])"));
-   require (num_razors > 0 && num_razors <= MAX_NUM_TOOLS, concat_5str("invalid number of razors (", int2str(num_razors), " not in [1,", int2str(MAX_NUM_TOOLS), "])"));
-   require (num_basins > 0 && num_basins <= MAX_WASHBASINS, concat_5str("invalid number of washbasins (", int2str(num_basins), " not in [1,", int2str(MAX_WASHBASINS), "])"));
-   require (num_client_benches_seats > 0 && num_client_benches_seats <= MAX_CLIENT_BENCHES_SEATS, concat_5str("invalid number of client benches seats (", int2str(num_client_benches_seats), " not in [1,", int2str(MAX_CLIENT_BENCHES_SEATS), "])"));
+   require (num_barbers > 0 && (global->HEADLESS || num_barbers <= MAX_BARBERS), concat_5str("invalid number of barbers (", int2str(num_barbers), " not in [1,", int2str(MAX_BARBERS), "])"));
+   require (num_chairs > 0 && (global->HEADLESS || num_chairs <= MAX_BARBER_CHAIRS), concat_5str("invalid number of chairs (", int2str(num_chairs), " not in [1,", int2str(MAX_BARBER_CHAIRS), "])"));
+   require (num_scissors > 0 && (global->HEADLESS || num_scissors <= MAX_NUM_TOOLS), concat_5str("invalid number of scissors (", int2str(num_scissors), " not in [1,", int2str(MAX_NUM_TOOLS), "])"));
+   require (num_combs > 0 && (global->HEADLESS || num_combs <= MAX_NUM_TOOLS), concat_5str("invalid number of combs (", int2str(num_combs), " not in [1,", int2str(MAX_NUM_TOOLS), "])"));
+   require (num_razors > 0 && (global->HEADLESS || num_razors <= MAX_NUM_TOOLS), concat_5str("invalid number of razors (", int2str(num_razors), " not in [1,", int2str(MAX_NUM_TOOLS), "])"));
+   require (num_basins > 0 && (global->HEADLESS || num_basins <= MAX_WASHBASINS), concat_5str("invalid number of washbasins (", int2str(num_basins), " not in [1,", int2str(MAX_WASHBASINS), "])"));
+   require (num_client_benches_seats > 0 && (global->HEADLESS || num_client_benches_seats <= MAX_CLIENT_BENCHES_SEATS), concat_5str("invalid number of client benches seats (", int2str(num_client_benches_seats), " not in [1,", int2str(MAX_CLIENT_BENCHES_SEATS), "])"));
    require (num_client_benches > 0 && num_client_benches <= num_client_benches_seats, concat_5str("invalid number of client benches (", int2str(num_client_benches), " not in [1,", int2str(num_client_benches_seats), "])"));
+   require (num_clients > 0 && (global->HEADLESS || num_clients <= MAX_CLIENTS), concat_5str("invalid number of clients (", int2str(num_clients), " not in [1,", int2str(MAX_CLIENTS), "])"));
+   require (storage != NULL, "storage argument required");
 
    shop->numBarbers = num_barbers;
    shop->numChairs = num_chairs;
@@ -62,36 +97,55 @@ void init_barber_shop(BarberShop* shop, int num_barbers, int num_chairs,
    shop->numWashbasins = num_basins;
    shop->numClientBenchesSeats = num_client_benches_seats;
    shop->numClientBenches = num_client_benches;
+   shop->numClients = num_clients;
    shop->numClientsInside = 0;
-   for(int i = 0; i < MAX_CLIENTS; i++)
-      shop->clientsInside[i] = 0;
    shop->opened = 1;
 
-   for(int i = 0; i <= MAX_CLIENTS; i++){
-      shop->barbers_assigned[i] = -1;
-   }
+   shop->barberChair = (BarberChair*)storage_alloc(storage, num_chairs*sizeof(BarberChair));
+   shop->washbasin = (Washbasin*)storage_alloc(storage, num_basins*sizeof(Washbasin));
+   shop->clientsInside = (int*)storage_alloc(storage, num_clients*sizeof(int));
+   shop->seatMailbox = (SeatMailbox*)storage_alloc(storage, num_client_benches_seats*sizeof(SeatMailbox));
+   shop->insidePos = (int*)storage_alloc(storage, (num_clients+1)*sizeof(int));
+   shop->service_channel = (ServiceChannel*)storage_alloc(storage, (num_barbers+1)*sizeof(ServiceChannel));
+   for(int i = 0; i <= num_barbers; i++)
+      init_service_channel(shop->service_channel+i);
+
+   init_resource_pool(&shop->barberChairsPool, num_chairs, storage);
+   init_resource_pool(&shop->washbasinsPool, num_basins, storage);
 
-   gen_rect(skel, skel_length, num_lines_barber_shop(shop), num_columns_barber_shop(shop), 0xF, 1);
-   gen_overlap_boxes(skel, 0, skel,
-                     (char*)" BARBER SHOP ", 0, 2,
-                     (char*)" Idle Barbers:", 2, 1,
-                     (char*)"Barber Chairs:", 2+3, 1,
-                     (char*)"Washbasins:", 3+3+num_lines_barber_chair(), num_columns_tools_pot()+3,
-                     (char*)" Waiting Room:", 2+3+num_lines_barber_chair()+num_lines_tools_pot(), 1,
-                     (char*)"+          +", num_lines_barber_shop(shop)-1, num_columns_barber_shop(shop)-15, NULL);
+   for(int i = 0; i < num_clients; i++)
+      shop->clientsInside[i] = 0;
+   for(int i = 0; i < num_client_benches_seats; i++)
+      shop->seatMailbox[i].barberID = -1;
+   for(int i = 0; i <= num_clients; i++)
+      shop->insidePos[i] = -1;
+   shop->numBenchesWaiters = 0;
+   shop->numHandedSeats = 0;
+
+   if (!global->HEADLESS) // frame sized to the rendering limits
+   {
+      gen_rect(skel, skel_length, num_lines_barber_shop(shop), num_columns_barber_shop(shop), 0xF, 1);
+      gen_overlap_boxes(skel, 0, skel,
+                        (char*)" BARBER SHOP ", 0, 2,
+                        (char*)" Idle Barbers:", 2, 1,
+                        (char*)"Barber Chairs:", 2+3, 1,
+                        (char*)"Washbasins:", 3+3+num_lines_barber_chair(), num_columns_tools_pot()+3,
+                        (char*)" Waiting Room:", 2+3+num_lines_barber_chair()+num_lines_tools_pot(), 1,
+                        (char*)"+          +", num_lines_barber_shop(shop)-1, num_columns_barber_shop(shop)-15, NULL);
+   }
 
    shop->internal = (char*)mem_alloc(skel_length + 1);
 
    shop->logId = register_logger((char*)"Barber Shop:", 0, 0, num_lines_barber_shop(shop), num_columns_barber_shop(shop), NULL);
 
    // init components:
-   init_barber_bench(&shop->barberBench, num_barbers, 0, 1, 16);
+   init_barber_bench(&shop->barberBench, num_barbers, 0, 1, 16, storage);
    for (int i = 0; i < num_chairs; i++)
       init_barber_chair(shop->barberChair+i, i+1, 1+3, 16+i*(num_columns_barber_chair()+2));
-   init_tools_pot(&shop->toolsPot, num_scissors, num_combs, num_razors, 1+3+num_lines_barber_chair(), 1);
+   init_tools_pot(&shop->toolsPot, num_scissors, num_combs, num_razors, num_barbers, 1+3+num_lines_barber_chair(), 1, storage);
    for (int i = 0; i < num_basins; i++)
       init_washbasin(shop->washbasin+i, i+1, 1+3+num_lines_barber_chair(), num_columns_tools_pot()+3+11+1+i*(num_columns_washbasin()+2));
-   init_client_benches(&shop->clientBenches, num_client_benches_seats, num_client_benches, 1+3+num_lines_barber_chair()+num_lines_tools_pot(), 16);
+   init_client_benches(&shop->clientBenches, num_client_benches_seats, num_client_benches, 1+3+num_lines_barber_chair()+num_lines_tools_pot(), 16, storage);
 
 }
 
@@ -107,6 +161,8 @@ void term_barber_shop(BarberShop* shop)
    for (int i = 0; i < shop->numChairs; i++)
       term_barber_chair(shop->barberChair+i);
    term_barber_bench(&shop->barberBench);
+   term_resource_pool(&shop->washbasinsPool);
+   term_resource_pool(&shop->barberChairsPool);
 
    mem_free(shop->internal);
 }
@@ -131,8 +187,8 @@ void show_barber_shop(BarberShop* shop)
 void log_barber_shop(BarberShop* shop)
 {
    require (shop != NULL, "shop argument required");
-   spend(random_int(global->MIN_VITALITY_TIME_UNITS, global->MAX_VITALITY_TIME_UNITS));
-   send_log(shop->logId, to_string_barber_shop(shop));
+   if (!global->HEADLESS)
+      compose_log(shop->logId, to_string_barber_shop(shop));
 }
 
 int valid_barber_chair_pos(BarberShop* shop, int pos)
@@ -190,12 +246,7 @@ int num_available_barber_chairs(BarberShop* shop)
 {
    require (shop != NULL, "shop argument required");
 
-   int res = 0;
-   for(int pos = 0; pos < shop->numChairs ; pos++)
-      if (empty_barber_chair(shop->barberChair+pos))
-         res++;
-
-   return res;
+   return num_free_resource_pool(&shop->barberChairsPool);
 }
 
 int reserve_random_empty_barber_chair(BarberShop* shop, int barberID)
@@ -206,14 +257,8 @@ int reserve_random_empty_barber_chair(BarberShop* shop, int barberID)
 
    require (shop != NULL, "shop argument required");
    require (barberID > 0, concat_3str("invalid barber id (", int2str(barberID), ")"));
-   require (num_available_barber_chairs(shop) > 0, "barber chair not available");
-
-   int r = random_int(1, num_available_barber_chairs(shop));
-   int res;
-   for(res = 0; r > 0 && res < shop->numChairs ; res++)
-      if (empty_barber_chair(shop->barberChair+res))
-         r--;
-   res--;
+
+   int res = acquire_resource_pool(&shop->barberChairsPool);
    reserve_barber_chair(shop->barberChair+res, barberID);
 
    ensure (res >= 0 && res < shop->numChairs, "");
@@ -221,16 +266,21 @@ int reserve_random_empty_barber_chair(BarberShop* shop, int barberID)
    return res;
 }
 
-int num_available_washbasin(BarberShop* shop)
+void release_reserved_barber_chair(BarberShop* shop, int pos, int barberID)
 {
    require (shop != NULL, "shop argument required");
+   require (valid_barber_chair_pos(shop, pos), concat_3str("invalid chair position (", int2str(pos), ")"));
+   require (barberID > 0, concat_3str("invalid barber id (", int2str(barberID), ")"));
+
+   release_barber_chair(shop->barberChair+pos, barberID);
+   release_resource_pool(&shop->barberChairsPool, pos);
+}
 
-   int res = 0;
-   for(int pos = 0; pos < shop->numWashbasins ; pos++)
-      if (empty_washbasin(shop->washbasin+pos))
-         res++;
+int num_available_washbasin(BarberShop* shop)
+{
+   require (shop != NULL, "shop argument required");
 
-   return res;
+   return num_free_resource_pool(&shop->washbasinsPool);
 }
 
 int reserve_random_empty_washbasin(BarberShop* shop, int barberID)
@@ -241,14 +291,8 @@ int reserve_random_empty_washbasin(BarberShop* shop, int barberID)
 
    require (shop != NULL, "shop argument required");
    require (barberID > 0, concat_3str("invalid barber id (", int2str(barberID), ")"));
-   require (num_available_washbasin(shop) > 0, "washbasin not available");
-
-   int r = random_int(1, num_available_washbasin(shop));
-   int res;
-   for(res = 0; r > 0 && res < shop->numWashbasins ; res++)
-      if (empty_washbasin(shop->washbasin+res))
-         r--;
-   res--;
+
+   int res = acquire_resource_pool(&shop->washbasinsPool);
    reserve_washbasin(shop->washbasin+res, barberID);
 
    ensure (res >= 0 && res < shop->numWashbasins, "");
@@ -256,17 +300,29 @@ int reserve_random_empty_washbasin(BarberShop* shop, int barberID)
    return res;
 }
 
+void release_reserved_washbasin(BarberShop* shop, int pos, int barberID)
+{
+   require (shop != NULL, "shop argument required");
+   require (pos >= 0 && pos < shop->numWashbasins, concat_3str("invalid washbasin position (", int2str(pos), ")"));
+   require (barberID > 0, concat_3str("invalid barber id (", int2str(barberID), ")"));
+
+   release_washbasin(shop->washbasin+pos, barberID);
+   release_resource_pool(&shop->washbasinsPool, pos);
+}
+
 int is_client_inside(BarberShop* shop, int clientID)
 {
    require (shop != NULL, "shop argument required");
-   require (clientID > 0, concat_3str("invalid client id (", int2str(clientID), ")"));
+   require (clientID > 0 && clientID <= shop->numClients, concat_3str("invalid client id (", int2str(clientID), ")"));
 
-   int res = 0;
+   return shop->insidePos[clientID] != -1;
+}
 
-   for(int i = 0; !res && i < shop->numClientsInside; i++)
-      res = (clientID == shop->clientsInside[i]);
+int num_vacant_benches_seats(BarberShop* shop)
+{
+   require (shop != NULL, "shop argument required");
 
-   return res;
+   return num_available_benches_seats(client_benches(shop)) - shop->numHandedSeats;
 }
 
 Service wait_service_from_barber(BarberShop* shop, int barberID)
@@ -277,10 +333,11 @@ Service wait_service_from_barber(BarberShop* shop, int barberID)
 
    require (shop != NULL, "shop argument required");
    require (barberID > 0, concat_3str("invalid barber id (", int2str(barberID), ")"));
+   require (barberID <= shop->numBarbers, concat_3str("invalid barber id (", int2str(barberID), ")"));
    //debug_log(shop,"wait_service_from_barber\tThe client is waitting for service from the barber %d", barberID);
-   psem_wait(&shop->sem_services[barberID]);   
+   wait_service_step(shop->service_channel+barberID, SERVICE_ASSIGNED);
    
-   Service res = shop->services_assigned[barberID];
+   Service res = shop->service_channel[barberID].service;
    
    //debug_log(shop,"wait_service_from_barber\tIt has been assigned the service %d to client %d from barber %d", res.request, res.clientID, res.barberID);
    return res;
@@ -293,10 +350,59 @@ void inform_client_on_service(BarberShop* shop, Service service)
     **/
 
    require (shop != NULL, "shop argument required");
+   require (service.barberID > 0 && service.barberID <= shop->numBarbers, concat_3str("invalid barber id (", int2str(service.barberID), ")"));
    //debug_log(shop,"inform_client_on_service\tBarber %d / Client %d / Informing Client", service.barberID, service.clientID);
-   shop->services_assigned[service.barberID] = service;
-   psem_post(&shop->sem_services[service.barberID]);
+   shop->service_channel[service.barberID].service = service;
+   post_service_step(shop->service_channel+service.barberID, SERVICE_ASSIGNED);
+}
+
+void client_ready_for_service(BarberShop* shop, int barberID)
+{
+   require (shop != NULL, "shop argument required");
+   require (barberID > 0 && barberID <= shop->numBarbers, concat_3str("invalid barber id (", int2str(barberID), ")"));
 
+   post_service_step(shop->service_channel+barberID, SERVICE_STARTED);
+}
+
+void wait_client_ready_for_service(BarberShop* shop, int barberID)
+{
+   require (shop != NULL, "shop argument required");
+   require (barberID > 0 && barberID <= shop->numBarbers, concat_3str("invalid barber id (", int2str(barberID), ")"));
+
+   wait_service_step(shop->service_channel+barberID, SERVICE_STARTED);
+}
+
+void service_done(BarberShop* shop, int barberID)
+{
+   require (shop != NULL, "shop argument required");
+   require (barberID > 0 && barberID <= shop->numBarbers, concat_3str("invalid barber id (", int2str(barberID), ")"));
+
+   post_service_step(shop->service_channel+barberID, SERVICE_DONE);
+}
+
+void wait_service_done(BarberShop* shop, int barberID)
+{
+   require (shop != NULL, "shop argument required");
+   require (barberID > 0 && barberID <= shop->numBarbers, concat_3str("invalid barber id (", int2str(barberID), ")"));
+
+   // (the barber may already have assigned the next service)
+   wait_service_step_past(shop->service_channel+barberID, SERVICE_STARTED);
+}
+
+void release_barber(BarberShop* shop, int barberID)
+{
+   require (shop != NULL, "shop argument required");
+   require (barberID > 0 && barberID <= shop->numBarbers, concat_3str("invalid barber id (", int2str(barberID), ")"));
+
+   post_service_step(shop->service_channel+barberID, SERVICE_RELEASED);
+}
+
+void wait_barber_released(BarberShop* shop, int barberID)
+{
+   require (shop != NULL, "shop argument required");
+   require (barberID > 0 && barberID <= shop->numBarbers, concat_3str("invalid barber id (", int2str(barberID), ")"));
+
+   wait_service_step(shop->service_channel+barberID, SERVICE_RELEASED);
 }
 
 void client_done(BarberShop* shop, int clientID)
@@ -323,14 +429,86 @@ int enter_barber_shop(BarberShop* shop, int clientID, int request)
    require (!is_client_inside(shop, clientID), concat_3str("client ", int2str(clientID), " inside barber shop"));
 
    int res = random_sit_in_client_benches(&shop->clientBenches, clientID, request);
+   shop->insidePos[clientID] = shop->numClientsInside;
    shop->clientsInside[shop->numClientsInside++] = clientID;
+   clock_sem_post(&shop->sem_clients_available);
+   return res;
+}
+
+void queue_for_benches_seat(BarberShop* shop, int clientID)
+{
+   /**
+    * Function called from a client, with mutex_client_bench locked, when no seat is
+    * vacant: the client waits (wait_benches_seat) for a seat to be handed over
+    **/
+
+   require (shop != NULL, "shop argument required");
+   require (clientID > 0 && clientID <= shop->numClients, concat_3str("invalid client id (", int2str(clientID), ")"));
+   require (num_vacant_benches_seats(shop) == 0, "vacant seat in client benches");
+
+   shop->numBenchesWaiters++;
+}
+
+int wait_benches_seat(BarberShop* shop, int clientID, int request, int time_units)
+{
+   /**
+    * Function called from a queued client (mutex_client_bench unlocked).
+    * With time_units >= 0 the client gives up (returns -1) if no seat is handed over in time.
+    * The waiting clients share a single semaphore: a seat is handed to whichever of
+    * them it wakes (the first one, in virtual time), which then sits itself.
+    **/
+
+   require (shop != NULL, "shop argument required");
+   require (clientID > 0 && clientID <= shop->numClients, concat_3str("invalid client id (", int2str(clientID), ")"));
+   require (request > 0 && request < 8, concat_3str("invalid request (", int2str(request), ")"));
+
+   if (time_units < 0)
+      clock_sem_wait(&shop->sem_benches_seat_handed);
+   else if (!clock_sem_timedwait(&shop->sem_benches_seat_handed, time_units))
+   {
+      // gives up, unless every waiter left has a seat handed over (its post is then
+      // pending, and this client takes it)
+      clock_sem_wait(&shop->mutex_client_bench);
+      int granted = shop->numBenchesWaiters == 0;
+      if (!granted)
+         shop->numBenchesWaiters--;
+      clock_sem_post(&shop->mutex_client_bench);
+      if (!granted)
+         return -1;
+      clock_sem_wait(&shop->sem_benches_seat_handed); // seat handed over meanwhile
+   }
+
+   clock_sem_wait(&shop->mutex_client_bench);
+   shop->numHandedSeats--;
+   int res = enter_barber_shop(shop, clientID, request);
+   clock_sem_post(&shop->mutex_client_bench);
+
+   ensure (res >= 0, "");
+
    return res;
 }
 
+void hand_over_benches_seat(BarberShop* shop)
+{
+   /**
+    * Function called from a client, with mutex_client_bench locked, after rising from the benches:
+    * the freed seat goes to a waiting client (if any), so that no newcomer can take it
+    **/
+
+   require (shop != NULL, "shop argument required");
+
+   if (shop->numBenchesWaiters > 0)
+   {
+      shop->numBenchesWaiters--;
+      shop->numHandedSeats++;
+      clock_sem_post(&shop->sem_benches_seat_handed);
+   }
+}
+
 void leave_barber_shop(BarberShop* shop, int clientID)
 {
    /** TODO:
-    * Function called from a client when leaving the barbershop
+    * Function called from a client, with mutex_client_bench locked, when leaving the barbershop
     **/
 
    require (shop != NULL, "shop argument required");
@@ -338,51 +516,60 @@ void leave_barber_shop(BarberShop* shop, int clientID)
    require (is_client_inside(shop, clientID), concat_3str("client ", int2str(clientID), " already inside barber shop"));
 
    
-   shop->barbers_assigned[clientID] = -1;
-   int i;
-   for(i = 0; shop->clientsInside[i] != clientID; i++)
-      ;
-   shop->numClientsInside--;
-   check (shop->clientsInside[i] == clientID, "");
-   for(; i < shop->numClientsInside; i++)
-      shop->clientsInside[i] = shop->clientsInside[i+1];
+   // the last client inside takes its position
+   int pos = shop->insidePos[clientID];
+   int last = shop->clientsInside[--shop->numClientsInside];
+   check (shop->clientsInside[pos] == clientID, "");
+   shop->clientsInside[pos] = last;
+   shop->insidePos[last] = pos;
+   shop->insidePos[clientID] = -1;
 }
 
-void receive_and_greet_client(BarberShop* shop, int barberID, int clientID)
+void receive_and_greet_client(BarberShop* shop, int barberID, int clientID, int benchPos)
 {
    /** TODO:
     * function called from a barber, when receiving a new client
     * it must send the barber ID to the client
     **/
-   int i;
-   for (i = 1 ; i <= MAX_CLIENTS; i ++) {
-      //debug_log(shop,"receive_and_greet_client\tBA%d-B%d-C%d", shop->barbers_assigned[i],barberID,i);
-      if (shop->barbers_assigned[i] == barberID) break;
-   }
-   //debug_log(shop,"receive_and_greet_client\tThe barber %d is picking client %d-%d", barberID,clientID,i);
-   psem_post(&shop->sem_clients[i]);
-
- 
-   //debug_log(shop,"receive_and_greet_client\tThe barber %d rised the sem", barberID);
-
    require (shop != NULL, "shop argument required");
    require (barberID > 0, concat_3str("invalid barber id (", int2str(barberID), ")"));
    require (clientID > 0, concat_3str("invalid client id (", int2str(clientID), ")"));
+   require (benchPos >= 0 && benchPos < shop->numClientBenchesSeats, concat_3str("invalid bench position (", int2str(benchPos), ")"));
 
+   // the greeting goes to the seat of the client (it rises only after reading it)
+   shop->seatMailbox[benchPos].barberID = barberID;
+   clock_sem_post(&shop->seatMailbox[benchPos].greeting);
+   //debug_log(shop,"receive_and_greet_client\tThe barber %d is picking client %d seated in %d", barberID,clientID,benchPos);
 }
 
-int greet_barber(BarberShop* shop, int clientID)
+int greet_barber(BarberShop* shop, int clientID, int benchPos)
 {
    /** TODO:
     * function called from a client, expecting to receive its barber's ID
     **/   
+   require (shop != NULL, "shop argument required");
+   require (clientID > 0, concat_3str("invalid client id (", int2str(clientID), ")"));
+   require (benchPos >= 0 && benchPos < shop->numClientBenchesSeats, concat_3str("invalid bench position (", int2str(benchPos), ")"));
+
    //debug_log(shop,"greet_barber\tThe client %d is waitting for the barber", clientID);
-   psem_wait(&shop->sem_clients[clientID]);
+   clock_sem_wait(&shop->seatMailbox[benchPos].greeting);
+   int res = shop->seatMailbox[benchPos].barberID;
+   shop->seatMailbox[benchPos].barberID = -1;
    //debug_log(shop,"greet_barber\tClient %d Finished the handshake with the barber", clientID);
+
+   return res;
+}
+
+void wait_client_available(BarberShop* shop)
+{
+   /**
+    * function called from an idle barber: each seated client is announced once,
+    * so a barber only returns when a client can be picked from the benches
+    * (or when the shop has closed)
+    **/
    require (shop != NULL, "shop argument required");
-   require (clientID > 0, concat_3str("invalid client id (", int2str(clientID), ")"));
 
-   return shop->barbers_assigned[clientID];
+   clock_sem_wait(&shop->sem_clients_available);
 }
 
 int shop_opened(BarberShop* shop)
@@ -398,6 +585,8 @@ void close_shop(BarberShop* shop)
    require (shop_opened(shop), "barber shop already closed");
  
    shop->opened = 0;
+   for(int i = 0; i < shop->numBarbers; i++) // wake every idle barber
+      clock_sem_post(&shop->sem_clients_available);
 }
 
 static char* to_string_barber_shop(BarberShop* shop)
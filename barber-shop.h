@@ -14,66 +14,80 @@
 #include "barber-bench.h"
 #include "service.h"
 #include "client-benches.h"
+#include "sim-clock.h"
+#include "resource-pool.h"
 
+/* greeting mailbox of a client benches seat, in a cache line of its own */
+typedef struct _SeatMailbox_
+{
+   ClockSem greeting;                     // barber greeting the client seated there
+   int barberID;                          // id of that barber (-1 if none)
+} CACHE_ALIGNED SeatMailbox;
+
+/*
+ * Shared by every barber and client: the read-mostly configuration comes
+ * first, and each group of write-hot state starts a cache line of its own
+ * (as does every element of the per barber and seat arrays), so
+ * that processes updating unrelated state do not invalidate each other's
+ * cache lines.
+ */
 typedef struct _BarberShop_
 {
+   // read-mostly (set on init):
    int numBarbers;
-
    int numChairs;                         // num barber chairs
-   BarberChair barberChair[MAX_BARBERS]; // index related with position
-
    int numScissors;
    int numCombs;
    int numRazors;
-   ToolsPot toolsPot;
-
    int numWashbasins;
-   Washbasin washbasin[MAX_WASHBASINS];  // index related with position
-
-   BarberBench barberBench;
-
    int numClientBenchesSeats;
    int numClientBenches;
-   ClientBenches clientBenches;
+   int numClients;
 
-   int numClientsInside;
-   int clientsInside[MAX_CLIENTS];
+   int opened;                            // (written once, at closing)
 
-   int opened;
+   BarberChair* barberChair;              // [numChairs] index related with position
+   Washbasin* washbasin;                  // [numWashbasins] index related with position
+   int* clientsInside;                    // [numClients] ids of the clients inside (unordered, dense)
+   SeatMailbox* seatMailbox;              // [numClientBenchesSeats] indexed by client benches position
+   int* insidePos;                        // [numClients+1] position in clientsInside, indexed by client id (-1 if outside)
+   ServiceChannel* service_channel;       // [numBarbers+1] indexed by barber id: services handshake with the client being attended
 
    int logId;
    char* internal;
+   FILE *log_file;
 
-   sem_t mutex_barber_bench;
-   sem_t mutex_client_bench;
-   sem_t mutex_barber_chairs;
-   sem_t mutex_washbasins;
-
-   sem_t sem_barber_chairs;
-   sem_t sem_scissors;
-   sem_t sem_combs;
-   sem_t sem_razors;
-   sem_t sem_washbasins;
+   // write-hot:
+   ResourcePool barberChairsPool CACHE_ALIGNED; // free barber chairs (a reserved chair belongs to its barber)
+   ResourcePool washbasinsPool CACHE_ALIGNED;   // free washbasins (a reserved washbasin belongs to its barber)
+   ToolsPot toolsPot CACHE_ALIGNED;
 
-   sem_t sem_clients[MAX_CLIENTS+1];
-   int barbers_assigned[MAX_CLIENTS+1];
+   ClockSem mutex_barber_bench CACHE_ALIGNED;
+   BarberBench barberBench;
 
-   sem_t sem_services[MAX_BARBERS+1];
-   sem_t sem_services_client[MAX_BARBERS+1];
-   sem_t sem_services_barber[MAX_BARBERS+1];
-   sem_t sem_services_finish[MAX_BARBERS+1];
+   ClockSem mutex_client_bench CACHE_ALIGNED;
+   // protected by mutex_client_bench:
+   int numClientsInside;
+   int numBenchesWaiters;                 // clients waiting for a client benches seat, not yet handed one
+   int numHandedSeats;                    // free seats handed over to waiting clients, not yet taken
+   ClientBenches clientBenches;           // (its queue is lock-free, in cache lines of its own)
 
-   Service services_assigned[MAX_BARBERS+1];
+   ClockSem sem_benches_seat_handed CACHE_ALIGNED; // one post per seat handed over (the waiting clients block on it, FIFO in virtual time)
 
-   FILE *log_file;
+   ClockSem sem_clients_available CACHE_ALIGNED; // one post per client seated in the benches (and per barber at closing)
 
 } BarberShop;
 
 int num_lines_barber_shop(BarberShop* shop);
 int num_columns_barber_shop(BarberShop* shop);
+int layout_lines_barber_shop(int num_client_benches); // (before the shop is initialized)
+int layout_columns_barber_shop();
+size_t sizeof_barber_shop_arrays(int num_barbers, int num_chairs, int num_basins,
+                                 int num_client_benches_seats, int num_clients);
 void init_barber_shop(BarberShop* shop, int num_barbers, int num_chairs,
                       int num_scissors, int num_combs, int num_razors, int num_basins, 
-                      int num_client_benches_seats, int num_client_benches);
+                      int num_client_benches_seats, int num_client_benches,
+                      int num_clients, Storage* storage);
 void term_barber_shop(BarberShop* shop);
 void show_barber_shop(BarberShop* shop);
 void log_barber_shop(BarberShop* shop);
@@ -90,21 +104,34 @@ BarberBench* barber_bench(BarberShop* shop);
 ClientBenches* client_benches(BarberShop* shop);
 
 int num_available_barber_chairs(BarberShop* shop);
-int reserve_random_empty_barber_chair(BarberShop* shop, int barberID);
+int reserve_random_empty_barber_chair(BarberShop* shop, int barberID); // blocks until one is free
+void release_reserved_barber_chair(BarberShop* shop, int pos, int barberID);
 int num_available_washbasin(BarberShop* shop);
-int reserve_random_empty_washbasin(BarberShop* shop, int barberID);
+int reserve_random_empty_washbasin(BarberShop* shop, int barberID);    // blocks until one is free
+void release_reserved_washbasin(BarberShop* shop, int pos, int barberID);
 
 int is_client_inside(BarberShop* shop, int clientID);
+int num_vacant_benches_seats(BarberShop* shop); // (mutex_client_bench locked) free seats not handed over
 
 Service wait_service_from_barber(BarberShop* shop, int barberID);
 void inform_client_on_service(BarberShop* shop, Service service);
+void client_ready_for_service(BarberShop* shop, int barberID);      // (client) seated
+void wait_client_ready_for_service(BarberShop* shop, int barberID);
+void service_done(BarberShop* shop, int barberID);                  // (barber) service performed
+void wait_service_done(BarberShop* shop, int barberID);
+void release_barber(BarberShop* shop, int barberID);                // (client) all its services done
+void wait_barber_released(BarberShop* shop, int barberID);
 
 void client_done(BarberShop* shop, int clientID);
 
 int enter_barber_shop(BarberShop* shop, int clientID, int request);
+void queue_for_benches_seat(BarberShop* shop, int clientID);
+int wait_benches_seat(BarberShop* shop, int clientID, int request, int time_units); // returns bench position (-1 if given up)
+void hand_over_benches_seat(BarberShop* shop);
 void leave_barber_shop(BarberShop* shop, int clientID);
-void receive_and_greet_client(BarberShop* shop, int barberID, int clientID);
-int greet_barber(BarberShop* shop, int clientID); // returns barberID
+void receive_and_greet_client(BarberShop* shop, int barberID, int clientID, int benchPos);
+int greet_barber(BarberShop* shop, int clientID, int benchPos); // returns barberID
+void wait_client_available(BarberShop* shop); // blocks an idle barber until a client is seated or the shop closes
 
 int shop_opened(BarberShop* shop);
 void close_shop(BarberShop* shop); // no more outside clients accepted
@@ -3,10 +3,14 @@
 #include "global.h"
 #include "utils.h"
 #include "box.h"
+#include "box-template.h"
 #include "timer.h"
 #include "logger.h"
+#include "compositor.h"
+#include "trace.h"
 #include "barber-shop.h"
 #include "barber.h"
+#include "sim-stats.h"
 
 enum State
 {
@@ -46,6 +50,9 @@ static const char* skel =
    "+---+---+-+-+\n"
    "|#########|#|\n"
    "@---------+-@";
+static int numLines = string_num_lines((char*)skel);       // (skeleton scanned once)
+static int numColumns = string_num_columns((char*)skel);
+static BoxTemplate skel_boxes;      // (compiled by the first init of a rendered shop)
 static int skel_length = num_lines_barber()*(num_columns_barber()+1)*4; // extra space for (pessimistic) utf8 encoding!
 
 static void life(Barber* barber);
@@ -60,7 +67,9 @@ static void done(Barber* barber);
 static void process_haircut_request(Barber* barber);
 static void process_shave_request(Barber* barber);
 static void process_washhair_request(Barber* barber);
+static void serve_in_barber_chair(Barber* barber, int req);
 
+static void trace_barber(Barber* barber);
 static char* to_string_barber(Barber* barber);
 
 size_t sizeof_barber()
@@ -70,12 +79,24 @@ size_t sizeof_barber()
 
 int num_lines_barber()
 {
-   return string_num_lines((char*)skel);
+   return numLines;
 }
 
 int num_columns_barber()
 {
-   return string_num_columns((char*)skel);
+   return numColumns;
+}
+
+int num_states_barber()
+{
+   return State_SIZE;
+}
+
+const char* state_text_barber(int state)
+{
+   require (state >= 0 && state < State_SIZE, concat_3str("invalid state (", int2str(state), ")"));
+
+   return stateText[state];
 }
 
 void init_barber(Barber* barber, int id, BarberShop* shop, int line, int column)
@@ -88,6 +109,7 @@ void init_barber(Barber* barber, int id, BarberShop* shop, int line, int column)
 
    barber->id = id;
    barber->state = NONE;
+   barber->tracedState = NONE;
    barber->shop = shop;
    barber->clientID = 0;
    barber->reqToDo = 0;
@@ -95,9 +117,15 @@ void init_barber(Barber* barber, int id, BarberShop* shop, int line, int column)
    barber->chairPosition = -1;
    barber->basinPosition = -1;
    barber->tools = 0;
-   barber->internal = NULL;
-   barber->logId = register_logger((char*)("Barber:"), line ,column,
-                                   num_lines_barber(), num_columns_barber(), NULL);
+   barber->internal = (char*)mem_alloc(skel_length + 1);
+   barber->logId = -1;
+   if (!global->HEADLESS) // the logger only registers the areas of a rendered shop
+   {
+      if (!compiled_box_template(&skel_boxes))
+         init_box_template(&skel_boxes, skel);
+      barber->logId = register_logger((char*)("Barber:"), line ,column,
+                                      num_lines_barber(), num_columns_barber(), NULL);
+   }
 }
 
 void term_barber(Barber* barber)
@@ -115,8 +143,9 @@ void log_barber(Barber* barber)
 {
    require (barber != NULL, "barber argument required");
 
-   spend(random_int(global->MIN_VITALITY_TIME_UNITS, global->MAX_VITALITY_TIME_UNITS));
-   send_log(barber->logId, to_string_barber(barber));
+   trace_barber(barber);
+   if (!global->HEADLESS)
+      compose_log(barber->logId, to_string_barber(barber));
 }
 
 void* main_barber(void* args)
@@ -126,7 +155,9 @@ void* main_barber(void* args)
    require (barber != NULL, "barber argument required");
    //debug_log(barber->shop,"main_barber\tStarted the BARBER life %d", barber->id);
 
+   enter_sim_clock(barber->id-1);
    life(barber);
+   leave_sim_clock();
    return NULL;
 }
 
@@ -138,9 +169,11 @@ static void life(Barber* barber)
    wait_for_client(barber);
    while(work_available(barber)) // no more possible clients and closes barbershop
    {
+      long busy = now_sim_clock();
       rise_from_barber_bench(barber);
       process_resquests_from_client(barber);
       release_client(barber);
+      busy_time_sim_stats(barber->id, now_sim_clock()-busy);
       sit_in_barber_bench(barber);
       wait_for_client(barber);
    }
@@ -158,7 +191,7 @@ static void sit_in_barber_bench(Barber* barber)
     * zone and realese it when the barber is seated.
     * 
     **/
-   psem_wait(&barber->shop->mutex_barber_bench);
+   clock_sem_wait(&barber->shop->mutex_barber_bench);
 
    require (barber != NULL, "barber argument required");
    require (num_seats_available_barber_bench(barber_bench(barber->shop)) > 0, "seat not available in barber shop");
@@ -169,8 +202,9 @@ static void sit_in_barber_bench(Barber* barber)
    barber->benchPosition = num;
    barber->clientID = 0;
    
-   psem_post(&barber->shop->mutex_barber_bench);
+   clock_sem_post(&barber->shop->mutex_barber_bench);
 
+   pace_sim_clock();
    log_barber(barber);
 }
 
@@ -186,18 +220,12 @@ static void wait_for_client(Barber* barber)
     **/
    require (barber != NULL, "barber argument required");
 
-   //cleanup old barber positions
-   for (int i=1; i <=MAX_CLIENTS; i ++) {
-      if (barber->shop->barbers_assigned[i] == barber->id)  
-         barber->shop->barbers_assigned[i]=-1;
-   }
    barber->state = WAITING_CLIENTS; 
    RQItem res = empty_item();
    do {
       //debug_log(barber->shop,"wait_for_client\tThe barber %d is waitting for clients", barber->id);
-      psem_wait(&barber->shop->mutex_client_bench);
-      res = next_client_in_benches(client_benches(barber->shop));
-      psem_post(&barber->shop->mutex_client_bench);
+      wait_client_available(barber->shop);
+      res = next_client_in_benches(client_benches(barber->shop), barber->id); // lock-free (no mutex_client_bench)
 
       if (res.benchPos != -1) {
             barber->clientID = res.clientID; 
@@ -205,16 +233,13 @@ static void wait_for_client(Barber* barber)
           
 
 
-            barber->shop->barbers_assigned[res.clientID] = barber->id;
-            //debug_log(barber->shop,"wait_for_client\tThe barber %d is picking up client %d seated in %d (AB %d)", barber->id, res.clientID,res.benchPos,barber->shop->barbers_assigned[res.clientID] );
-            receive_and_greet_client(barber->shop, barber->id, res.clientID);                      
+            //debug_log(barber->shop,"wait_for_client\tThe barber %d is picking up client %d seated in %d", barber->id, res.clientID,res.benchPos);
+            receive_and_greet_client(barber->shop, barber->id, res.clientID, res.benchPos);
       } else {
             //debug_log(barber->shop,"wait_for_client\tThe barber %d has no clients to attend", barber->id); 
       }
+      pace_sim_clock();
       log_barber(barber);
-
-      //Sleep for a little while 
-      sleep(random_int(1,3));      
    } while(res.benchPos == -1 && barber->shop->opened ==1);
 }
 
@@ -251,12 +276,13 @@ static void rise_from_barber_bench(Barber* barber)
    require (barber != NULL, "barber argument required");
    require (seated_in_barber_bench(barber_bench(barber->shop), barber->id), "barber not seated in barber shop");
 
-   psem_wait(&barber->shop->mutex_barber_bench);
+   clock_sem_wait(&barber->shop->mutex_barber_bench);
    rise_barber_bench (barber_bench(barber->shop), barber->benchPosition);
-   psem_post(&barber->shop->mutex_barber_bench);
+   clock_sem_post(&barber->shop->mutex_barber_bench);
 
    barber->benchPosition = -1; //clean up
 
+   pace_sim_clock();
    log_barber(barber);
 }
 
@@ -284,14 +310,18 @@ static void process_resquests_from_client(Barber* barber)
 
    while (barber->reqToDo != 0) {
 
+      long start = now_sim_clock();
       barber->basinPosition = -1;
       barber->chairPosition = -1;
       barber->benchPosition = -1;
 
 
       //Select one of the services that the client wants
+      //(batching: shave and haircut together, in the same chair)
       int req;
-      if (barber->reqToDo & SHAVE_REQ ) {
+      if (global->BATCH_CHAIR_SERVICES && (barber->reqToDo & (SHAVE_REQ|HAIRCUT_REQ)) == (SHAVE_REQ|HAIRCUT_REQ)) {
+         req = SHAVE_REQ|HAIRCUT_REQ;
+      } else if (barber->reqToDo & SHAVE_REQ ) {
          req = SHAVE_REQ;
       }else if (barber->reqToDo & WASH_HAIR_REQ ) {
          req = WASH_HAIR_REQ;
@@ -299,15 +329,14 @@ static void process_resquests_from_client(Barber* barber)
          req = HAIRCUT_REQ;
       }
 
+      int chair = (req & (SHAVE_REQ|HAIRCUT_REQ)) != 0;
+
       //debug_log(barber->shop,"process_resquests_from_client\tBarber %d / Client %d / Service %d", barber->id, barber->clientID, req);
-      if (req == SHAVE_REQ || req == HAIRCUT_REQ) { //needs a baerber chair
+      if (chair) { //needs a baerber chair
          
-         psem_wait(&barber->shop->sem_barber_chairs);  
-
-         //protect the memory zone of the barber chairs
-         psem_wait(&barber->shop->mutex_barber_chairs); 
+         //waits for a free chair, which then belongs to this barber until released
+         barber->state = WAITING_BARBER_SEAT;
          int idx = reserve_random_empty_barber_chair(barber->shop, barber->id);       
-         psem_post(&barber->shop->mutex_barber_chairs);    
                   
          //debug_log(barber->shop,"process_resquests_from_client\tBarber %d / Client %d / Reserved Chair %d", barber->id, barber->clientID, idx);
 
@@ -316,12 +345,9 @@ static void process_resquests_from_client(Barber* barber)
          barber->chairPosition = idx;
 
       }  else { // needs a wasbasin
-         psem_wait(&barber->shop->sem_washbasins); 
-
-         //protect the memory zone of the washbasins
-         psem_wait(&barber->shop->mutex_washbasins);                    
+         //waits for a free washbasin, which then belongs to this barber until released
+         barber->state = WAITING_WASHBASIN;
          int idx = reserve_random_empty_washbasin(barber->shop, barber->id);       
-         psem_post(&barber->shop->mutex_washbasins); 
 
          set_washbasin_service(&s,barber->id,barber->clientID,idx);
 
@@ -332,98 +358,52 @@ static void process_resquests_from_client(Barber* barber)
       inform_client_on_service(barber->shop,s);
 
       //Wait for the client to tell that we can continue
-      psem_wait(&barber->shop->sem_services_client[s.barberID]); 
-
-      if (req == HAIRCUT_REQ) {
-         //Pick up scissor
-         psem_wait(&barber->shop->sem_scissors);     
-         barber->tools = barber->tools + SCISSOR_TOOL;
-         pick_scissor(tools_pot(barber->shop));
-         //debug_log(barber->shop,"process_resquests_from_client\tBarber %d / Client %d / Got Scissor", barber->id, barber->clientID);
-
-         //Pick up Comb
-         psem_wait(&barber->shop->sem_combs);      
-         barber->tools = barber->tools + COMB_TOOL;
-         pick_comb(tools_pot(barber->shop));
-         //debug_log(barber->shop,"process_resquests_from_client\tBarber %d / Client %d / Got Comb", barber->id, barber->clientID);
-      }
-
-      if (req == SHAVE_REQ) {
-         //Pick up Razor
-         psem_wait(&barber->shop->sem_razors);      
-         barber->tools = barber->tools + RAZOR_TOOL;
-         pick_razor(tools_pot(barber->shop));
-         //debug_log(barber->shop,"process_resquests_from_client\tBarber %d / Client %d / Got Razor", barber->id, barber->clientID);
-      }      
+      wait_client_ready_for_service(barber->shop, s.barberID);
 
       //debug_log(barber->shop,"process_resquests_from_client\tService CL %d / BAR %d / CHAI %d / WB %d / POS %d / REQ %d",s.clientID, s.barberID, s.barberChair, s.washbasin, s.pos, s.request);
-      if (req== SHAVE_REQ || req == HAIRCUT_REQ) {
-         set_tools_barber_chair(barber_chair(barber->shop,s.pos), barber->tools);
-      }
-      
-      
       //debug_log(barber->shop,"process_resquests_from_client\tBarber %d / Client %d / Starting Proccess", barber->id, barber->clientID);
-      switch (req) {
-         case HAIRCUT_REQ:  process_haircut_request(barber); break;
-         case WASH_HAIR_REQ: process_washhair_request(barber); break;
-         case SHAVE_REQ: process_shave_request(barber); break;
+      int last = req; // (of a batch, the services before it are timed as they end)
+      if (chair) {
+         //the client stays seated along a batch, only the tools are swapped
+         if (req == (SHAVE_REQ|HAIRCUT_REQ)) {
+            serve_in_barber_chair(barber, SHAVE_REQ);
+            service_time_sim_stats(SHAVE_REQ, now_sim_clock()-start);
+            start = now_sim_clock();
+            last = HAIRCUT_REQ;
+         }
+         serve_in_barber_chair(barber, last);
+      } else {
+         barber->state = WASHING;
+         process_washhair_request(barber);
       }
       //debug_log(barber->shop,"process_resquests_from_client\tBarber %d / Client %d / Finished Proccess", barber->id, barber->clientID);
 
-      if (req == SHAVE_REQ || req == HAIRCUT_REQ) { // Release barber chair
+      if (chair) { // Release barber chair
          //debug_log(barber->shop,"process_resquests_from_client\tBarber %d / Client %d / Try to release chair %d", barber->id, barber->clientID, s.pos);
-         psem_wait(&barber->shop->mutex_barber_chairs); //protect the memory zone         
          rise_from_barber_chair(barber_chair(barber->shop,s.pos), s.clientID);
-         release_barber_chair(barber_chair(barber->shop,s.pos), s.barberID);         
-         psem_post(&barber->shop->mutex_barber_chairs); 
-         psem_post(&barber->shop->sem_barber_chairs); 
+         release_reserved_barber_chair(barber->shop, s.pos, s.barberID);
          //debug_log(barber->shop,"process_resquests_from_client\tBarber %d / Client %d / RELASED chair %d", barber->id, barber->clientID, s.pos);
       } else {
          //debug_log(barber->shop,"process_resquests_from_client\tBarber %d / Client %d / Try to washbasin %d", barber->id, barber->clientID, s.pos);
-         psem_wait(&barber->shop->mutex_washbasins); //protect the memory zone
          rise_from_washbasin(washbasin(barber->shop,s.pos), s.clientID);
-         release_washbasin(washbasin(barber->shop,s.pos), s.barberID);         
-         psem_post(&barber->shop->mutex_washbasins); 
-         psem_post(&barber->shop->sem_washbasins); 
+         release_reserved_washbasin(barber->shop, s.pos, s.barberID);
          //debug_log(barber->shop,"process_resquests_from_client\tBarber %d / Client %d / RELASED washbasin %d", barber->id, barber->clientID, s.pos);
       }
 
-
-      if (req == HAIRCUT_REQ) {
-         //Return scissor
-         //debug_log(barber->shop,"process_resquests_from_client\tBarber %d / Client %d / Try to return Scissor", barber->id, barber->clientID);         
-         barber->tools = barber->tools - SCISSOR_TOOL;
-         return_scissor(tools_pot(barber->shop));
-         psem_post(&barber->shop->sem_scissors);     
-         //debug_log(barber->shop,"process_resquests_from_client\tBarber %d / Client %d / Return Scissor", barber->id, barber->clientID);
-
-         //Return Comb
-         //debug_log(barber->shop,"process_resquests_from_client\tBarber %d / Client %d / Try to return comb", barber->id, barber->clientID);
-         return_comb(tools_pot(barber->shop));
-         psem_post(&barber->shop->sem_combs);      
-         barber->tools = barber->tools - COMB_TOOL;         
-         //debug_log(barber->shop,"process_resquests_from_client\tBarber %d / Client %d / Return Comb", barber->id, barber->clientID);
-      }
-
-      if (req == SHAVE_REQ) {
-         //Return Razor
-         //debug_log(barber->shop,"process_resquests_from_client\tBarber %d / Client %d / Try to return Razor", barber->id, barber->clientID);
-         return_razor(tools_pot(barber->shop));
-         psem_post(&barber->shop->sem_razors);      
-         barber->tools = barber->tools - RAZOR_TOOL;         
-         //debug_log(barber->shop,"process_resquests_from_client\tBarber %d / Client %d /Return Razor", barber->id, barber->clientID);
-      }
    
       //debug_log(barber->shop,"process_resquests_from_client\tBarber %d / Client %d / Inform Client Finish", barber->id, barber->clientID);
-      psem_post(&barber->shop->sem_services_barber[s.barberID]); 
+      service_done(barber->shop, s.barberID);
+      service_time_sim_stats(last, now_sim_clock()-start);
 
       barber->reqToDo = barber->reqToDo - req;
+      pace_sim_clock();
       log_barber(barber);
    }   
    
-   psem_wait(&barber->shop->sem_services_finish[barber->id]);
+   wait_barber_released(barber->shop, barber->id);
    
    
+   pace_sim_clock();
    log_barber(barber); 
 }
 
@@ -438,6 +418,7 @@ static void release_client(Barber* barber)
 
    client_done(barber->shop,barber->clientID);
 
+   pace_sim_clock();
    log_barber(barber);
 }
 
@@ -448,9 +429,37 @@ static void done(Barber* barber)
     **/
    require (barber != NULL, "barber argument required");
 
+   barber->state = DONE;
+   pace_sim_clock();
    log_barber(barber);
 }
 
+/* one chair service: with its whole tool set (scissor and comb, or razor),
+ * picked up at once (holding none while waiting) and returned at the end */
+static void serve_in_barber_chair(Barber* barber, int req)
+{
+   require (barber != NULL, "barber argument required");
+   require (req == HAIRCUT_REQ || req == SHAVE_REQ, concat_3str("invalid request (", int2str(req), ")"));
+   require (barber->tools == 0, "barber already holding tools");
+
+   int tools = req == HAIRCUT_REQ ? SCISSOR_TOOL + COMB_TOOL : RAZOR_TOOL;
+   barber->state = req == HAIRCUT_REQ ? REQ_SCISSOR : REQ_RAZOR; // (with the comb)
+   pick_tools(tools_pot(barber->shop), barber->id, tools);
+   barber->tools = tools;
+   barber->state = req == HAIRCUT_REQ ? CUTTING : SHAVING;
+   //debug_log(barber->shop,"process_resquests_from_client\tBarber %d / Client %d / Got Tools %d", barber->id, barber->clientID, tools);
+   set_tools_barber_chair(barber_chair(barber->shop, barber->chairPosition), barber->tools);
+
+   if (req == HAIRCUT_REQ)
+      process_haircut_request(barber);
+   else
+      process_shave_request(barber);
+
+   return_tools(tools_pot(barber->shop), barber->tools);
+   barber->tools = 0;
+   //debug_log(barber->shop,"process_resquests_from_client\tBarber %d / Client %d / Returned Tools", barber->id, barber->clientID);
+}
+
 static void process_haircut_request(Barber* barber)
 {
    /** TODO:
@@ -465,11 +474,12 @@ static void process_haircut_request(Barber* barber)
    int complete = 0;
    while(complete < 100)
    {
-      sleep(slice);
+      sleep_sim_clock(slice);
       complete += 100/steps;
       if (complete > 100)
          complete = 100;
       set_completion_barber_chair(barber_chair(barber->shop, barber->chairPosition), complete);
+      pace_sim_clock();
       log_barber(barber); 
 
    }
@@ -488,11 +498,12 @@ static void process_shave_request(Barber* barber)
    int complete = 0;
    while(complete < 100)
    {
-      sleep(slice);
+      sleep_sim_clock(slice);
       complete += 100/steps;
       if (complete > 100)
          complete = 100;
       set_completion_barber_chair(barber_chair(barber->shop, barber->chairPosition), complete);
+      pace_sim_clock();
       log_barber(barber); 
 
    }
@@ -510,7 +521,7 @@ static void process_washhair_request(Barber* barber)
    int complete = 0;
    while(complete < 100)
    {
-      sleep(slice);
+      sleep_sim_clock(slice);
       complete += 100/steps;
       if (complete > 100)
          complete = 100;
@@ -518,6 +529,7 @@ static void process_washhair_request(Barber* barber)
       Washbasin* basin = washbasin(barber->shop, barber->basinPosition);
       //debug_log(barber->shop,"process_washhair_request\tBarber %d / B %d / C %d / CP %d / ID %d", barber->id, basin->barberID, basin->clientID, basin->completionPercentage, basin->id);
       set_completion_washbasin(washbasin(barber->shop, barber->basinPosition), complete);
+      pace_sim_clock();
       log_barber(barber); 
 
    }
@@ -525,6 +537,29 @@ static void process_washhair_request(Barber* barber)
 
 
 
+static void trace_barber(Barber* barber)
+{
+   int kind = TRACE_NO_RESOURCE;
+   int pos = -1;
+   if (barber->chairPosition >= 0)
+   {
+      kind = TRACE_BARBER_CHAIR;
+      pos = barber->chairPosition;
+   }
+   else if (barber->basinPosition >= 0)
+   {
+      kind = TRACE_WASHBASIN;
+      pos = barber->basinPosition;
+   }
+   else if (barber->benchPosition >= 0)
+   {
+      kind = TRACE_BARBER_BENCH;
+      pos = barber->benchPosition;
+   }
+   trace_event(TRACE_BARBER, barber->id, barber->tracedState, barber->state, kind, pos, barber->reqToDo);
+   barber->tracedState = barber->state;
+}
+
 static char* to_string_barber(Barber* barber)
 {
    require (barber != NULL, "barber argument required");
@@ -544,7 +579,7 @@ static char* to_string_barber(Barber* barber)
    else if (barber->basinPosition >= 0)
       pos = int2nstr(barber->basinPosition+1, 1);
 
-   return gen_boxes(barber->internal, skel_length, skel,
+   return gen_box_template(&skel_boxes, barber->internal, skel_length,
          int2nstr(barber->id, 2),
          barber->clientID > 0 ? int2nstr(barber->clientID, 2) : "--",
          tools, stateText[barber->state], pos);
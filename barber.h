@@ -14,6 +14,7 @@ typedef struct _Barber_
 {
    int id; // 1, 2, ...
    int state;
+   int tracedState;   // state of the last log
 
    BarberShop* shop;
    int clientID;
@@ -28,12 +29,14 @@ typedef struct _Barber_
 
    int logId;
    char* internal;
-} Barber;
+} CACHE_ALIGNED Barber;
 
 // export to simulation:
 size_t sizeof_barber();
 int num_lines_barber();
 int num_columns_barber();
+int num_states_barber();
+const char* state_text_barber(int state);
 void init_barber(Barber* barber, int id, BarberShop* shop, int line, int column);
 void term_barber(Barber* barber);
 void log_barber(Barber* barber);
@@ -0,0 +1,308 @@
+/**
+ *  \brief Rendering benchmark of the box templates
+ *
+ * Times the boxes of the barber, client, barber chair and client benches
+ * logs (to_string_barber, to_string_client, to_string_barber_chair and
+ * to_string_client_benches), generated as before the box templates (by
+ * gen_boxes, the benches matrix regenerated on every render) and by their
+ * compiled box template, with the same arguments.  Both results are checked
+ * to be equal.  The skeletons are copies of those of the modules.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <getopt.h>
+#include <string.h>
+#include <time.h>
+#include "dbc.h"
+#include "global.h"
+#include "utils.h"
+#include "box.h"
+#include "box-template.h"
+
+#define MAX_LENGTH 10000
+#define BENCHES_SKEL_LENGTH ((MAX_CLIENT_BENCHES_SEATS*12*3+6)*4)
+
+static const char* barberSkel =
+   "@---+---+---@\n"
+   "|B##|C##|###|\n"
+   "+---+---+-+-+\n"
+   "|#########|#|\n"
+   "@---------+-@";
+
+static const char* clientSkel =
+   "@---+---+---@\n"
+   "|C##|B##|###|\n"
+   "+---+---+-+-+\n"
+   "|#########|#|\n"
+   "@---------+-@";
+
+static const char* chairSkel =
+   "@-------@\n"
+   "| ####  |\n"
+   "@-+---+-@\n"
+   "##|C##|##\n"
+   "  +---+\n"
+   "  |B##|\n"
+   "  @---@";
+
+static int iterations = 20000;
+static int numSeats = 10;
+static int numBenches = 2;
+
+static char before[MAX_LENGTH+1];
+static char after[MAX_LENGTH+1];
+
+static void help(char* prog);
+static void processArgs(int argc, char* argv[]);
+static double elapsed_ns(struct timespec* t0);
+static void report(const char* name, double before_ns, double after_ns);
+static char* benches_skel(char* s, int slots);
+static char* gen_boxes_benches(char* res, const char* seat);
+
+int main(int argc, char* argv[])
+{
+   processArgs(argc, argv);
+
+   BoxTemplate barberBoxes, clientBoxes, chairBoxes, benchesBoxes;
+   init_box_template(&barberBoxes, barberSkel);
+   init_box_template(&clientBoxes, clientSkel);
+   init_box_template(&chairBoxes, chairSkel);
+   char s[BENCHES_SKEL_LENGTH+1];
+   init_box_template(&benchesBoxes, benches_skel(s, 1));
+   const char* seat[numSeats];
+   for(int i = 0; i < numSeats; i++)
+      seat[i] = i % 3 == 1 ? "C07/012/H:S" : ""; // (a third of the seats taken)
+
+   printf("render,iterations,gen_boxes_ns,template_ns,speedup\n");
+   struct timespec t0;
+   double b, a;
+   char id[4];      // (as int2nstr(id, 2) and perc2str formatted them, without a stack allocation per render)
+   char perc[8];
+
+   clock_gettime(CLOCK_MONOTONIC, &t0);
+   for(int i = 0; i < iterations; i++)
+   {
+      snprintf(id, sizeof(id), "%02d", i % 20 + 1);
+      gen_boxes(before, MAX_LENGTH, barberSkel, id, "--", "SC-", "CUTTING  ", "2");
+   }
+   b = elapsed_ns(&t0);
+   for(int i = 0; i < iterations; i++)
+   {
+      snprintf(id, sizeof(id), "%02d", i % 20 + 1);
+      gen_box_template(&barberBoxes, after, MAX_LENGTH, id, "--", "SC-", "CUTTING  ", "2");
+   }
+   a = elapsed_ns(&t0);
+   check (strcmp(before, after) == 0, "barber boxes differ");
+   report("to_string_barber", b, a);
+
+   clock_gettime(CLOCK_MONOTONIC, &t0);
+   for(int i = 0; i < iterations; i++)
+   {
+      snprintf(id, sizeof(id), "%02d", i % 99 + 1);
+      gen_boxes(before, MAX_LENGTH, clientSkel, id, "03", "H:S", "WAITING  ", "-");
+   }
+   b = elapsed_ns(&t0);
+   for(int i = 0; i < iterations; i++)
+   {
+      snprintf(id, sizeof(id), "%02d", i % 99 + 1);
+      gen_box_template(&clientBoxes, after, MAX_LENGTH, id, "03", "H:S", "WAITING  ", "-");
+   }
+   a = elapsed_ns(&t0);
+   check (strcmp(before, after) == 0, "client boxes differ");
+   report("to_string_client", b, a);
+
+   clock_gettime(CLOCK_MONOTONIC, &t0);
+   for(int i = 0; i < iterations; i++)
+   {
+      snprintf(perc, sizeof(perc), "%3d%%", i % 101);
+      gen_boxes(before, MAX_LENGTH, chairSkel, perc, SCISSOR, "07", COMB, "03");
+   }
+   b = elapsed_ns(&t0);
+   for(int i = 0; i < iterations; i++)
+   {
+      snprintf(perc, sizeof(perc), "%3d%%", i % 101);
+      gen_box_template(&chairBoxes, after, MAX_LENGTH, perc, SCISSOR, "07", COMB, "03");
+   }
+   a = elapsed_ns(&t0);
+   check (strcmp(before, after) == 0, "barber chair boxes differ");
+   report("to_string_barber_chair", b, a);
+
+   clock_gettime(CLOCK_MONOTONIC, &t0);
+   for(int i = 0; i < iterations; i++)
+      gen_boxes_benches(before, "C07/012/H:S");
+   b = elapsed_ns(&t0);
+   for(int i = 0; i < iterations; i++)
+      gen_box_template_array(&benchesBoxes, after, MAX_LENGTH, seat);
+   a = elapsed_ns(&t0);
+   check (strcmp(before, after) == 0, "client benches boxes differ");
+   report("to_string_client_benches", b, a);
+
+   term_box_template(&barberBoxes);
+   term_box_template(&clientBoxes);
+   term_box_template(&chairBoxes);
+   term_box_template(&benchesBoxes);
+   return 0;
+}
+
+/* ns since t0 (t0 restarted) */
+static double elapsed_ns(struct timespec* t0)
+{
+   struct timespec t1;
+   clock_gettime(CLOCK_MONOTONIC, &t1);
+   double res = (t1.tv_sec-t0->tv_sec)*1e9 + (t1.tv_nsec-t0->tv_nsec);
+   *t0 = t1;
+   return res;
+}
+
+static void report(const char* name, double before_ns, double after_ns)
+{
+   printf("%s,%d,%.0f,%.0f,%.1f\n", name, iterations, before_ns/iterations, after_ns/iterations, before_ns/after_ns);
+}
+
+/* the benches matrix, as init_boxes_client_benches builds it (each seat a slot, if slots) */
+static char* benches_skel(char* s, int slots)
+{
+   gen_matrix(s, BENCHES_SKEL_LENGTH, numBenches, (numSeats+numBenches-1)/numBenches, 3, 13, 1);
+   int i;
+   for(i = 0; s[i] != '|'; i++)
+      ;
+   i++;
+   for(int pos = 0; pos < numSeats ; pos++)
+   {
+      if (slots)
+         memset(s+i, '#', 11);
+      i += 12;
+      if (s[i] == '\n')
+      {
+         for(; s[i] && s[i] != '|'; i++)
+            ;
+         if (s[i])
+            i++;
+      }
+   }
+   return s;
+}
+
+/* the benches boxes, as to_string_client_benches generated them before the box templates */
+static char* gen_boxes_benches(char* res, const char* seat)
+{
+   char s[BENCHES_SKEL_LENGTH+1];
+   gen_matrix(s, BENCHES_SKEL_LENGTH, numBenches, (numSeats+numBenches-1)/numBenches, 3, 13, 1);
+   int i;
+   for(i = 0; s[i] != '|'; i++)
+      ;
+   i++;
+   for(int pos = 0; pos < numSeats ; pos++)
+   {
+      if (pos % 3 == 1)
+         memcpy(s+i, seat, 11);
+      i += 12;
+      if (s[i] == '\n')
+      {
+         for(; s[i] && s[i] != '|'; i++)
+            ;
+         if (s[i])
+            i++;
+      }
+   }
+   return gen_boxes(res, MAX_LENGTH, s);
+}
+
+/*********************************************************************/
+
+static void help(char* prog)
+{
+   require (prog != NULL, "program name argument required");
+
+   printf("\n");
+   printf("Usage: %s [OPTION] ...\n", prog);
+   printf("\n");
+   printf("Box rendering benchmark: mean time per render of the barber, client, barber\n");
+   printf("chair and client benches boxes, by gen_boxes and by a box template;\n");
+   printf("writes one CSV line per render.\n");
+   printf("\n");
+   printf("Options:\n");
+   printf("\n");
+   printf("  -h,--help                                   show this help\n");
+   printf("  -i,--iterations <N>\n");
+   printf("     renders timed of each kind (default is %d)\n", iterations);
+   printf("  -s,--num-seats <N>\n");
+   printf("     client benches seats (default is %d)\n", numSeats);
+   printf("  -k,--num-benches <N>\n");
+   printf("     client benches (default is %d)\n", numBenches);
+   printf("\n");
+}
+
+static void processArgs(int argc, char* argv[])
+{
+   require (argc >= 0 && argv != NULL && argv[0] != NULL, "invalid main arguments");
+
+   static struct option long_options[] =
+   {
+      {"help",                         no_argument,       NULL, 'h'},
+      {"iterations",                   required_argument, NULL, 'i'},
+      {"num-seats",                    required_argument, NULL, 's'},
+      {"num-benches",                  required_argument, NULL, 'k'},
+      {0, 0, NULL, 0}
+   };
+   int op=0;
+
+   while (op != -1)
+   {
+      int option_index = 0;
+
+      op = getopt_long(argc, argv, "hi:s:k:", long_options, &option_index);
+      int st,n;
+      switch (op)
+      {
+         case -1:
+            break;
+
+         case 'h':
+            help(argv[0]);
+            exit(EXIT_SUCCESS);
+
+         case 'i':
+            st = sscanf(optarg, "%d", &n);
+            if (st != 1 || n < 1)
+            {
+               fprintf(stderr, "ERROR: invalid number of iterations \"%s\"\n", optarg);
+               exit(EXIT_FAILURE);
+            }
+            iterations = n;
+            break;
+
+         case 's':
+            st = sscanf(optarg, "%d", &n);
+            if (st != 1 || n < 2 || n > MAX_CLIENT_BENCHES_SEATS)
+            {
+               fprintf(stderr, "ERROR: invalid number of seats \"%s\" (not in [2,%d])\n", optarg, MAX_CLIENT_BENCHES_SEATS);
+               exit(EXIT_FAILURE);
+            }
+            numSeats = n;
+            break;
+
+         case 'k':
+            st = sscanf(optarg, "%d", &n);
+            if (st != 1 || n < 1)
+            {
+               fprintf(stderr, "ERROR: invalid number of benches \"%s\"\n", optarg);
+               exit(EXIT_FAILURE);
+            }
+            numBenches = n;
+            break;
+
+         default:
+            help(argv[0]);
+            exit(EXIT_FAILURE);
+            break;
+      }
+   }
+
+   if (numBenches > numSeats || (numSeats+numBenches-1)/numBenches < 2)
+   {
+      fprintf(stderr, "ERROR: %d benches of %d seats do not make a matrix\n", numBenches, numSeats);
+      exit(EXIT_FAILURE);
+   }
+}
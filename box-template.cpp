@@ -0,0 +1,144 @@
+#include <stdlib.h>
+#include <string.h>
+#include <stdarg.h>
+#include "dbc.h"
+#include "utils.h"
+#include "utf8.h"
+#include "box.h"
+#include "box-template.h"
+
+// slots are compiled by generating the boxes with their '#' runs marked
+// (alternately, for runs made adjacent by '.') by characters no skeleton uses
+#define SLOT_MARK_A '\001'
+#define SLOT_MARK_B '\002'
+
+static int is_slot_mark(char c);
+static char* put_slot(char* out, const char* arg, int width);
+
+void init_box_template(BoxTemplate* templ, const char* box)
+{
+   require (templ != NULL, "template argument required");
+   require (box != NULL, "box argument required");
+
+   int n = strlen(box);
+   char* marked = (char*)mem_alloc(n+1);
+   char mark = SLOT_MARK_B;
+   for(int i = 0; i <= n; i++)
+   {
+      if (box[i] == '#' && (i == 0 || box[i-1] != '#'))
+         mark = mark == SLOT_MARK_A ? SLOT_MARK_B : SLOT_MARK_A;
+      marked[i] = box[i] == '#' ? mark : box[i];
+   }
+   int max_length = n*MAX_UTF8_STRING;
+   templ->text = (char*)mem_alloc(max_length+1);
+   gen_boxes(templ->text, max_length, marked);
+   mem_free(marked);
+   templ->length = strlen(templ->text);
+
+   templ->numSlots = 0;
+   for(int i = 0; i < templ->length; i++)
+      if (is_slot_mark(templ->text[i]) && (i == 0 || templ->text[i-1] != templ->text[i]))
+         templ->numSlots++;
+   templ->slotOffset = (int*)mem_alloc((templ->numSlots+1)*sizeof(int));
+   templ->slotWidth = (int*)mem_alloc((templ->numSlots+1)*sizeof(int));
+   int s = -1;
+   for(int i = 0; i < templ->length; i++)
+      if (is_slot_mark(templ->text[i]))
+      {
+         if (i == 0 || templ->text[i-1] != templ->text[i])
+         {
+            s++;
+            templ->slotOffset[s] = i;
+            templ->slotWidth[s] = 0;
+         }
+         templ->slotWidth[s]++;
+      }
+   for(int i = 0; i < templ->length; i++)
+      if (is_slot_mark(templ->text[i]))
+         templ->text[i] = ' ';
+}
+
+void term_box_template(BoxTemplate* templ)
+{
+   require (templ != NULL, "template argument required");
+
+   if (templ->text != NULL)
+   {
+      mem_free(templ->text);
+      mem_free(templ->slotOffset);
+      mem_free(templ->slotWidth);
+      templ->text = NULL;
+   }
+}
+
+int compiled_box_template(BoxTemplate* templ)
+{
+   require (templ != NULL, "template argument required");
+
+   return templ->text != NULL;
+}
+
+char* gen_box_template(BoxTemplate* templ, char* res, int max_length, ...)
+{
+   require (templ != NULL && compiled_box_template(templ), "compiled template argument required");
+   require (res != NULL, "res argument required");
+
+   va_list ap;
+   va_start(ap, max_length);
+   char* out = res;
+   int pos = 0;
+   for(int s = 0; s < templ->numSlots; s++)
+   {
+      memcpy(out, templ->text+pos, templ->slotOffset[s]-pos);
+      out = put_slot(out+templ->slotOffset[s]-pos, va_arg(ap, const char*), templ->slotWidth[s]);
+      pos = templ->slotOffset[s]+templ->slotWidth[s];
+   }
+   va_end(ap);
+   memcpy(out, templ->text+pos, templ->length-pos);
+   out += templ->length-pos;
+   *out = '\0';
+   check (out-res <= max_length, "result longer than max_length");
+   return res;
+}
+
+char* gen_box_template_array(BoxTemplate* templ, char* res, int max_length, const char* args[])
+{
+   require (templ != NULL && compiled_box_template(templ), "compiled template argument required");
+   require (res != NULL, "res argument required");
+   require (args != NULL, "args argument required");
+
+   char* out = res;
+   int pos = 0;
+   for(int s = 0; s < templ->numSlots; s++)
+   {
+      memcpy(out, templ->text+pos, templ->slotOffset[s]-pos);
+      out = put_slot(out+templ->slotOffset[s]-pos, args[s], templ->slotWidth[s]);
+      pos = templ->slotOffset[s]+templ->slotWidth[s];
+   }
+   memcpy(out, templ->text+pos, templ->length-pos);
+   out += templ->length-pos;
+   *out = '\0';
+   check (out-res <= max_length, "result longer than max_length");
+   return res;
+}
+
+static int is_slot_mark(char c)
+{
+   return c == SLOT_MARK_A || c == SLOT_MARK_B;
+}
+
+/* the argument, padded with spaces to the slot width (columns are UTF8 characters, as in gen_boxes) */
+static char* put_slot(char* out, const char* arg, int width)
+{
+   int columns = 0;
+   for(; *arg != '\0'; arg++)
+   {
+      if ((*arg & 0xC0) != 0x80) // (not a continuation byte)
+         columns++;
+      *out++ = *arg;
+   }
+   check (columns <= width, "argument wider than its slot");
+   for(; columns < width; columns++)
+      *out++ = ' ';
+   return out;
+}
@@ -0,0 +1,31 @@
+/**
+ *  \brief Precompiled box skeletons
+ *
+ * gen_boxes parses its skeleton (and translates its line drawing
+ * characters) on every call.  A box template does it once: it holds the
+ * generated boxes with every argument slot blank, and the byte position and
+ * width (columns) of each slot.  Generating the boxes is then a copy of the
+ * constant bytes between slots and of the arguments, padded with spaces to
+ * their slot widths, the same result as gen_boxes.
+ */
+
+#ifndef BOX_TEMPLATE_H
+#define BOX_TEMPLATE_H
+
+typedef struct _BoxTemplate_
+{
+   char* text;          // boxes with blank slots
+   int length;          // of text
+   int numSlots;
+   int* slotOffset;     // [numSlots] byte position in text
+   int* slotWidth;      // [numSlots] columns (and bytes in text)
+} BoxTemplate;
+
+void init_box_template(BoxTemplate* templ, const char* box); // (box as in gen_boxes)
+void term_box_template(BoxTemplate* templ);
+int compiled_box_template(BoxTemplate* templ);
+
+char* gen_box_template(BoxTemplate* templ, char* res, int max_length, ...); // one argument per slot, as gen_boxes
+char* gen_box_template_array(BoxTemplate* templ, char* res, int max_length, const char* args[]); // args[numSlots]
+
+#endif
@@ -0,0 +1,261 @@
+/**
+ *  \brief Cache behaviour benchmark of the barber shop simulation
+ *
+ * Runs simulation binaries (e.g. builds before and after a change to the
+ * shared memory layout) with the same options, and reads the performance
+ * counters of each run, including every process or thread it creates.
+ * Counters not supported by the machine (or not allowed by
+ * /proc/sys/kernel/perf_event_paranoid) are reported as NA.  The cache-line
+ * contention counter (HITM: loads hitting a line modified in another core's
+ * cache) has no generic event, so its raw event code for the running CPU
+ * must be given.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <getopt.h>
+#include <string.h>
+#include <time.h>
+#include <fcntl.h>
+#include <sys/wait.h>
+#include <sys/syscall.h>
+#include <linux/perf_event.h>
+#include "dbc.h"
+#include "utils.h"
+#include "process.h"
+
+#define MAX_EXECUTABLES 16
+#define MAX_ARGS 128
+
+/* counters read for each run (the raw HITM event only if given) */
+static struct
+{
+   const char* column;
+   unsigned int type;
+   unsigned long long config;
+} counters[] =
+{
+   {"cache_references",  PERF_TYPE_HARDWARE, PERF_COUNT_HW_CACHE_REFERENCES},
+   {"cache_misses",      PERF_TYPE_HARDWARE, PERF_COUNT_HW_CACHE_MISSES},
+   {"l1d_read_misses",   PERF_TYPE_HW_CACHE, PERF_COUNT_HW_CACHE_L1D | (PERF_COUNT_HW_CACHE_OP_READ << 8) | (PERF_COUNT_HW_CACHE_RESULT_MISS << 16)},
+   {"hitm",              PERF_TYPE_RAW,      0},
+   {"task_clock_ms",     PERF_TYPE_SOFTWARE, PERF_COUNT_SW_TASK_CLOCK},
+   {"context_switches",  PERF_TYPE_SOFTWARE, PERF_COUNT_SW_CONTEXT_SWITCHES},
+   {"cpu_migrations",    PERF_TYPE_SOFTWARE, PERF_COUNT_SW_CPU_MIGRATIONS},
+};
+#define NUM_COUNTERS ((int)(sizeof(counters)/sizeof(counters[0])))
+#define HITM_COUNTER 3
+#define TASK_CLOCK_COUNTER 4
+
+static int numExecutables = 0;
+static char* executables[MAX_EXECUTABLES];
+static int numRuns = 3;
+static int hitmEvent = 0;          // raw HITM event code given
+static int numSimArgs = 0;
+static char* simArgs[MAX_ARGS];
+
+static void help(char* prog);
+static void processArgs(int argc, char* argv[]);
+static void run(char* executable, int num);
+static int open_counter(int c, pid_t pid);
+
+int main(int argc, char* argv[])
+{
+   processArgs(argc, argv);
+
+   printf("executable,run,seconds");
+   for(int c = 0; c < NUM_COUNTERS; c++)
+      printf(",%s", counters[c].column);
+   printf("\n");
+   for(int r = 1; r <= numRuns; r++)    // (interleaved, so that drifts affect every executable alike)
+      for(int e = 0; e < numExecutables; e++)
+         run(executables[e], r);
+   return 0;
+}
+
+/* one simulation run, its counters enabled on exec and inherited by its children */
+static void run(char* executable, int num)
+{
+   int go[2];
+   check (pipe(go) == 0, "pipe failed");
+   fflush(stdout); // (otherwise also flushed by the child)
+   pid_t pid = pfork();
+   if (pid == 0)
+   {
+      close(go[1]);
+      char c;
+      if (read(go[0], &c, 1) != 1) // counters open
+         exit(EXIT_FAILURE);
+      close(go[0]);
+      int devnull = open("/dev/null", O_WRONLY);
+      if (devnull >= 0)
+         dup2(devnull, STDOUT_FILENO); // (summary not needed)
+      char* args[MAX_ARGS+2];
+      args[0] = executable;
+      for(int i = 0; i < numSimArgs; i++)
+         args[i+1] = simArgs[i];
+      args[numSimArgs+1] = NULL;
+      execv(executable, args);
+      perror(executable);
+      exit(EXIT_FAILURE);
+   }
+   close(go[0]);
+
+   int fd[NUM_COUNTERS];
+   for(int c = 0; c < NUM_COUNTERS; c++)
+      fd[c] = open_counter(c, pid);
+
+   struct timespec t0, t1;
+   clock_gettime(CLOCK_MONOTONIC, &t0);
+   check (write(go[1], "g", 1) == 1, "write failed");
+   close(go[1]);
+   int status;
+   pwaitpid(pid, &status, 0);
+   clock_gettime(CLOCK_MONOTONIC, &t1);
+   if (!WIFEXITED(status) || WEXITSTATUS(status) != EXIT_SUCCESS)
+      fprintf(stderr, "WARNING: %s (run %d) failed\n", executable, num);
+
+   printf("%s,%d,%.3f", executable, num, (t1.tv_sec-t0.tv_sec) + (t1.tv_nsec-t0.tv_nsec)/1000000000.0);
+   for(int c = 0; c < NUM_COUNTERS; c++)
+   {
+      unsigned long long value;
+      if (fd[c] >= 0 && read(fd[c], &value, sizeof(value)) == (ssize_t)sizeof(value))
+      {
+         if (c == TASK_CLOCK_COUNTER)
+            printf(",%.1f", value/1000000.0); // (ns)
+         else
+            printf(",%llu", value);
+      }
+      else
+         printf(",NA");
+      if (fd[c] >= 0)
+         close(fd[c]);
+   }
+   printf("\n");
+}
+
+/* counter c of process pid (-1 if unavailable) */
+static int open_counter(int c, pid_t pid)
+{
+   if (c == HITM_COUNTER && !hitmEvent)
+      return -1;
+
+   struct perf_event_attr attr;
+   memset(&attr, 0, sizeof(attr));
+   attr.size = sizeof(attr);
+   attr.type = counters[c].type;
+   attr.config = counters[c].config;
+   attr.disabled = 1;
+   attr.enable_on_exec = 1;
+   attr.inherit = 1;        // every process and thread of the simulation
+   if (attr.type != PERF_TYPE_SOFTWARE) // (user space only, as allowed to unprivileged users)
+   {
+      attr.exclude_kernel = 1;
+      attr.exclude_hv = 1;
+   }
+   return (int)syscall(SYS_perf_event_open, &attr, pid, -1, -1, 0);
+}
+
+/*********************************************************************/
+
+static void help(char* prog)
+{
+   require (prog != NULL, "program name argument required");
+
+   printf("\n");
+   printf("Usage: %s [OPTION] ... [-- SIMULATION-OPTION ...]\n", prog);
+   printf("\n");
+   printf("Cache behaviour benchmark: runs each simulation executable with the given\n");
+   printf("options and writes one CSV line of performance counters per run.\n");
+   printf("\n");
+   printf("Options:\n");
+   printf("\n");
+   printf("  -h,--help                                   show this help\n");
+   printf("  -x,--executable <PATH>\n");
+   printf("     simulation executable (repeat it to compare builds; default is ./simulation)\n");
+   printf("  -r,--runs <N>\n");
+   printf("     runs of each executable (default is %d)\n", numRuns);
+   printf("  -m,--hitm-event <HEX>\n");
+   printf("     raw event code of HITM loads on this CPU, as for perf stat -e rHEX\n");
+   printf("     (e.g. 4d2 on Intel Skylake: MEM_LOAD_L3_HIT_RETIRED.XSNP_HITM)\n");
+   printf("\n");
+   printf("Example:\n");
+   printf("  %s -x ./simulation.before -x ./simulation -- -H -e process -b 20 -n 100\n", prog);
+   printf("\n");
+}
+
+static void processArgs(int argc, char* argv[])
+{
+   require (argc >= 0 && argv != NULL && argv[0] != NULL, "invalid main arguments");
+
+   static struct option long_options[] =
+   {
+      {"help",                         no_argument,       NULL, 'h'},
+      {"executable",                   required_argument, NULL, 'x'},
+      {"runs",                         required_argument, NULL, 'r'},
+      {"hitm-event",                   required_argument, NULL, 'm'},
+      {0, 0, NULL, 0}
+   };
+   int op=0;
+
+   while (op != -1)
+   {
+      int option_index = 0;
+
+      op = getopt_long(argc, argv, "hx:r:m:", long_options, &option_index);
+      int st,n;
+      switch (op)
+      {
+         case -1:
+            break;
+
+         case 'h':
+            help(argv[0]);
+            exit(EXIT_SUCCESS);
+
+         case 'x':
+            if (numExecutables == MAX_EXECUTABLES)
+            {
+               fprintf(stderr, "ERROR: too many executables (max. %d)\n", MAX_EXECUTABLES);
+               exit(EXIT_FAILURE);
+            }
+            executables[numExecutables++] = optarg;
+            break;
+
+         case 'r':
+            st = sscanf(optarg, "%d", &n);
+            if (st != 1 || n < 1)
+            {
+               fprintf(stderr, "ERROR: invalid value \"%s\" for -%c\n", optarg, (char)op);
+               exit(EXIT_FAILURE);
+            }
+            numRuns = n;
+            break;
+
+         case 'm':
+            if (sscanf(optarg, "%llx", &counters[HITM_COUNTER].config) != 1)
+            {
+               fprintf(stderr, "ERROR: invalid raw event \"%s\"\n", optarg);
+               exit(EXIT_FAILURE);
+            }
+            hitmEvent = 1;
+            break;
+
+         default:
+            help(argv[0]);
+            exit(EXIT_FAILURE);
+            break;
+      }
+   }
+
+   if (numExecutables == 0)
+      executables[numExecutables++] = (char*)"./simulation";
+   if (argc-optind > MAX_ARGS)
+   {
+      fprintf(stderr, "ERROR: too many simulation options (max. %d)\n", MAX_ARGS);
+      exit(EXIT_FAILURE);
+   }
+   for(int i = optind; i < argc; i++)
+      simArgs[numSimArgs++] = argv[i];
+}
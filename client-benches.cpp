@@ -3,33 +3,60 @@
 #include "global.h"
 #include "utils.h"
 #include "box.h"
+#include "box-template.h"
 #include "logger.h"
+#include "compositor.h"
+#include "sim-clock.h"
 #include "client-benches.h"
 
 static const int skel_length = (MAX_CLIENT_BENCHES_SEATS*12*3+6)*4;
 
 static int random_empty_seat_position_client_benches(ClientBenches* benches);
+static void init_boxes_client_benches(ClientBenches* benches);
 static char* to_string_client_benches(ClientBenches* benches);
-static int _num_available_benches_seats_(ClientBenches* benches);
+static RQItem take_best_client(ClientBenches* benches, int barberID);
 
-void init_client_benches(ClientBenches* benches, int num_seats, int num_benches, int line, int column)
+size_t sizeof_client_benches_arrays(int num_seats)
+{
+   require (num_seats > 0, concat_3str("invalid number of seats (", int2str(num_seats), ")"));
+
+   return 5*storage_size(num_seats*sizeof(int)) + storage_size(num_seats*sizeof(long)) + sizeof_client_queue_arrays(num_seats);
+}
+
+void init_client_benches(ClientBenches* benches, int num_seats, int num_benches, int line, int column, Storage* storage)
 {
    require (benches != NULL, "benches argument required");
-   require (num_seats > 0 && num_seats <= MAX_CLIENT_BENCHES_SEATS, concat_5str("invalid number of seats (", int2str(num_seats), " not in [1,", int2str(MAX_CLIENT_BENCHES_SEATS), "])"));
+   require (num_seats > 0 && (global->HEADLESS || num_seats <= MAX_CLIENT_BENCHES_SEATS), concat_5str("invalid number of seats (", int2str(num_seats), " not in [1,", int2str(MAX_CLIENT_BENCHES_SEATS), "])"));
    require (num_benches > 0 && num_benches <= num_seats, concat_5str("invalid number of benches (", int2str(num_benches), " not in [1,", int2str(num_seats), "])"));
    require (line >= 0, concat_3str("Invalid line (", int2str(line), ")"));
    require (column >= 0, concat_3str("Invalid column (", int2str(column), ")"));
+   require (storage != NULL, "storage argument required");
 
    benches->numSeats = num_seats;
    benches->numBenches = num_benches;
+   benches->id = (int*)storage_alloc(storage, num_seats*sizeof(int));
+   benches->order = (int*)storage_alloc(storage, num_seats*sizeof(int));
+   benches->request = (int*)storage_alloc(storage, num_seats*sizeof(int));
+   benches->ticket = (int*)storage_alloc(storage, num_seats*sizeof(int));
+   benches->seatedAt = (long*)storage_alloc(storage, num_seats*sizeof(long));
+   benches->vacant = (int*)storage_alloc(storage, num_seats*sizeof(int));
+   benches->numVacant = num_seats;
    for(int i = 0; i < num_seats; i++)
    {  // empty
+      benches->vacant[i] = i;
       benches->id[i] = 0;
       benches->order[i] = 0;
       benches->request[i] = 0;
+      benches->ticket[i] = 0;
+      benches->seatedAt[i] = 0;
    }
-   init_client_queue(&benches->queue);
+   benches->policy = global->DISPATCH_POLICY;
+   benches->lastOrder = 0;
+   init_client_queue(&benches->queue, num_seats, storage);
    benches->internal = (char*)mem_alloc(skel_length + 1);
+   benches->boxes.text = NULL;
+   if (!global->HEADLESS)
+      init_boxes_client_benches(benches);
    benches->logId = register_logger((char*)"Client benches:", line, column, 7 ,num_seats*4+1 ,NULL);
 }
 
@@ -39,34 +66,22 @@ void term_client_benches(ClientBenches* benches)
 
    term_client_queue(&benches->queue);
    mem_free(benches->internal);
+   term_box_template(&benches->boxes);
 }
 
 void log_client_benches(ClientBenches* benches)
 {
    require (benches != NULL, "benches argument required");
 
-   spend(random_int(global->MIN_VITALITY_TIME_UNITS, global->MAX_VITALITY_TIME_UNITS));
-   send_log(benches->logId, to_string_client_benches(benches));
+   if (!global->HEADLESS)
+      compose_log(benches->logId, to_string_client_benches(benches));
 }
 
 int num_available_benches_seats(ClientBenches* benches)
 {
    require (benches != NULL, "benches argument required");
 
-   int res;
-   res = _num_available_benches_seats_(benches);
-
-   return res;
-}
-
-static int _num_available_benches_seats_(ClientBenches* benches)
-{
-   int res = 0;
-   for(int pos = 0; pos < benches->numSeats ; pos++)
-      if (benches->id[pos] == 0)
-         res++;
-
-   return res;
+   return benches->numVacant;
 }
 
 int occupied_by_id_client_benches(ClientBenches* benches, int pos, int id)
@@ -90,7 +105,15 @@ int random_sit_in_client_benches(ClientBenches* benches, int id, int request)
    RQItem item = {id, res, request, 0};
    benches->id[res] = id;
    benches->request[res] = request;
-   benches->order[res] = in_client_queue(&benches->queue, item);
+   if (dispatch_queued(benches->policy))
+      benches->order[res] = in_client_queue(&benches->queue, item);
+   else
+   {  // (clients sit with the benches locked, so only barbers race for the ticket)
+      benches->order[res] = ++benches->lastOrder;
+      benches->seatedAt[res] = dispatch_timed(benches->policy) ? now_sim_clock() : 0;
+      __atomic_store_n(&benches->ticket[res], benches->order[res], __ATOMIC_RELEASE);
+   }
+   pace_sim_clock();
    log_client_benches(benches);
    return res;
 }
@@ -103,20 +126,15 @@ int no_more_clients(ClientBenches* benches)
    return res;
 }
 
-RQItem next_client_in_benches(ClientBenches* benches)
+/* (lock-free: no need to lock the benches) */
+RQItem next_client_in_benches(ClientBenches* benches, int barberID)
 {
    require (benches != NULL, "benches argument required");
+   require (barberID > 0, concat_3str("invalid barber id (", int2str(barberID), ")"));
 
-   RQItem res;
-
-   if (!empty_client_queue(&benches->queue))
-   {
-      res = out_client_queue(&benches->queue);
-   }
-   else
-      res = empty_item();
-
-   return res;
+   if (dispatch_queued(benches->policy))
+      return out_client_queue(&benches->queue);
+   return take_best_client(benches, barberID);
 }
 
 void rise_client_benches(ClientBenches* benches, int pos, int id)
@@ -129,6 +147,8 @@ void rise_client_benches(ClientBenches* benches, int pos, int id)
    benches->id[pos] = 0;
    benches->order[pos] = 0;
    benches->request[pos] = 0;
+   benches->vacant[benches->numVacant++] = pos;
+   pace_sim_clock();
    log_client_benches(benches);
 }
 
@@ -144,45 +164,68 @@ int seated_in_client_benches(ClientBenches* benches, int id)
    return res;
 }
 
+/* taken out of the vacant seats (the last one moved to its place) */
 static int random_empty_seat_position_client_benches(ClientBenches* benches)
 {
-   int r = random_int(1, _num_available_benches_seats_(benches));
-   int res;
-   for(res = 0; r > 0 && res < benches->numSeats ; res++)
-      if (benches->id[res] == 0)
-         r--;
-   res--;
+   int r = random_int(1, benches->numVacant) - 1;
+   int res = benches->vacant[r];
+   benches->vacant[r] = benches->vacant[--benches->numVacant];
 
-   ensure (res >= 0 && res < benches->numSeats, "");
+   ensure (res >= 0 && res < benches->numSeats && benches->id[res] == 0, "");
 
    return res;
 }
 
-static char* to_string_client_benches(ClientBenches* benches)
+/* the waiting client with the lowest score, taken by clearing its ticket (a
+ * seat is only reused after its client is taken, and orders are never
+ * repeated, so a successful exchange also validates what was read of it) */
+static RQItem take_best_client(ClientBenches* benches, int barberID)
+{
+   long now = dispatch_timed(benches->policy) ? now_sim_clock() : 0;
+   for(;;)
+   {
+      int best = -1;
+      double bestScore = 0;
+      RQItem res = empty_item();
+      for(int pos = 0; pos < benches->numSeats; pos++)
+      {
+         int ticket = __atomic_load_n(&benches->ticket[pos], __ATOMIC_ACQUIRE);
+         if (ticket == 0)
+            continue;
+         WaitingClient client = {benches->id[pos], benches->request[pos], ticket, now-benches->seatedAt[pos]};
+         if (client.request == 0) // (taken and replaced meanwhile)
+            continue;
+         double score = dispatch_score(benches->policy, &client, barberID);
+         if (best == -1 || score < bestScore || (score == bestScore && ticket < res.order))
+         {
+            best = pos;
+            bestScore = score;
+            res.clientID = client.clientID;
+            res.benchPos = pos;
+            res.request = client.request;
+            res.order = ticket;
+         }
+      }
+      if (best == -1)
+         return empty_item();
+      int ticket = res.order;
+      if (__atomic_compare_exchange_n(&benches->ticket[best], &ticket, 0, 0, __ATOMIC_ACQ_REL, __ATOMIC_RELAXED))
+         return res;
+   }
+}
+
+/* the benches matrix, each seat a slot (C<id>/<order>/<requests>) */
+static void init_boxes_client_benches(ClientBenches* benches)
 {
    char s[skel_length+1];
    gen_matrix(s, skel_length, benches->numBenches, (benches->numSeats+benches->numBenches-1)/benches->numBenches, 3, 13, 1);
    int i;
    for(i = 0; s[i] != '|'; i++)
       ;
-   //printf("[to_string_client_benches] i:%d\n", i);
    i++;
    for(int pos = 0; pos < benches->numSeats ; pos++)
    {
-      if (benches->id[pos] > 0)
-      {
-         //assert (s[i] == ' ' && s[i+1] == ' ' && s[i+2] == ' ');
-         char* buf = int2nstr(benches->id[pos], 2);
-         s[i] = 'C';
-         strcpy(s+i+1, buf);
-         s[i+3] = '/';
-         buf = int2nstr(benches->order[pos], 3);
-         strcpy(s+i+4, buf);
-         s[i+7] = '/';
-         s[i+8] =   (benches->request[pos] & HAIRCUT_REQ) ?  'H' : ':';
-         s[i+9] = (benches->request[pos] & WASH_HAIR_REQ) ?  'W' : ':';
-         s[i+10] =    (benches->request[pos] & SHAVE_REQ) ?  'S' : ':';
-      }
+      memset(s+i, '#', 11);
       i += 12;
       if (s[i] == '\n')
       {
@@ -192,8 +235,34 @@ static char* to_string_client_benches(ClientBenches* benches)
             i++;
       }
    }
-   //printf("[to_string_client_benches]\n%s\n", s);
+   init_box_template(&benches->boxes, s);
+   check (benches->boxes.numSlots == benches->numSeats, "a slot per seat expected");
+}
+
+static char* to_string_client_benches(ClientBenches* benches)
+{
+   char seat[benches->numSeats][12];
+   const char* args[benches->numSeats];
+   for(int pos = 0; pos < benches->numSeats ; pos++)
+   {
+      seat[pos][0] = '\0';
+      if (benches->id[pos] > 0)
+      {
+         char* buf = int2nstr(benches->id[pos], 2);
+         seat[pos][0] = 'C';
+         strcpy(seat[pos]+1, buf);
+         seat[pos][3] = '/';
+         buf = int2nstr(benches->order[pos], 3);
+         strcpy(seat[pos]+4, buf);
+         seat[pos][7] = '/';
+         seat[pos][8] =   (benches->request[pos] & HAIRCUT_REQ) ?  'H' : ':';
+         seat[pos][9] = (benches->request[pos] & WASH_HAIR_REQ) ?  'W' : ':';
+         seat[pos][10] =    (benches->request[pos] & SHAVE_REQ) ?  'S' : ':';
+         seat[pos][11] = '\0';
+      }
+      args[pos] = seat[pos];
+   }
 
-   return gen_boxes(benches->internal, skel_length, s);
+   return gen_box_template_array(&benches->boxes, benches->internal, skel_length, args);
 }
 
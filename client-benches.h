@@ -9,20 +9,31 @@
 
 #include "global.h"
 #include "client-queue.h"
+#include "dispatch.h"
+#include "box-template.h"
 
 typedef struct _ClientBenches_
 {
    int numSeats;
    int numBenches;
-   int id[MAX_CLIENT_BENCHES_SEATS];
-   int order[MAX_CLIENT_BENCHES_SEATS];
-   int request[MAX_CLIENT_BENCHES_SEATS];
-   ClientQueue queue;
+   int* id;         // [numSeats]
+   int* order;      // [numSeats]
+   int* request;    // [numSeats]
+   int numVacant;
+   int* vacant;     // [numSeats] positions of the vacant seats (the first numVacant)
+   int policy;      // dispatch policy
+   ClientQueue queue;  // (queued policies)
+   // scored policies:
+   int* ticket;     // [numSeats] order of the client waiting there to be taken (0 if none)
+   long* seatedAt;  // [numSeats] time (ms) it sat down
+   int lastOrder;
    int logId;
+   BoxTemplate boxes;  // (rendered shop) a slot per seat
    char* internal;
 } ClientBenches;
 
-void init_client_benches(ClientBenches* benches, int num_seats, int num_benches, int line, int column);
+size_t sizeof_client_benches_arrays(int num_seats);
+void init_client_benches(ClientBenches* benches, int num_seats, int num_benches, int line, int column, Storage* storage);
 void term_client_benches(ClientBenches* benches);
 void log_client_benches(ClientBenches* benches);
 
@@ -36,7 +47,7 @@ int seated_in_client_benches(ClientBenches* benches, int id);
 
 // to use directly by barbers:
 int no_more_clients(ClientBenches* benches);
-RQItem next_client_in_benches(ClientBenches* benches);
+RQItem next_client_in_benches(ClientBenches* benches, int barberID);
 
 
 #endif
@@ -1,5 +1,6 @@
 #include <stdio.h>
 #include <stdlib.h>
+#include <sched.h>
 #include "dbc.h"
 #include "client-queue.h"
 
@@ -10,16 +11,28 @@ RQItem empty_item()
    return empty;
 }
 
-void init_client_queue(ClientQueue* queue)
+size_t sizeof_client_queue_arrays(int capacity)
 {
-   require (queue != NULL, "queue argument required");
+   require (capacity > 0, concat_3str("invalid capacity (", int2str(capacity), ")"));
+
+   return storage_size(capacity*sizeof(RQCell));
+}
 
-   for(int i = 0; i < MAX_CLIENT_QUEUE_SIZE; i++)
-      queue->array[i] = empty;
+void init_client_queue(ClientQueue* queue, int capacity, Storage* storage)
+{
+   require (queue != NULL, "queue argument required");
+   require (capacity > 0, concat_3str("invalid capacity (", int2str(capacity), ")"));
+   require (storage != NULL, "storage argument required");
+
+   queue->capacity = capacity;
+   queue->array = (RQCell*)storage_alloc(storage, capacity*sizeof(RQCell));
+   for(int i = 0; i < capacity; i++)
+   {
+      queue->array[i].sequence = i;
+      queue->array[i].item = empty;
+   }
    queue->head = 0;
    queue->tail = 0;
-   queue->size = 0;
-   queue->waitingQueueNumber = 0;
 }
 
 void term_client_queue(ClientQueue* queue)
@@ -31,27 +44,62 @@ void term_client_queue(ClientQueue* queue)
 int in_client_queue(ClientQueue* queue, RQItem item)
 {
    require (queue != NULL, "queue argument required");
-   require (!full_client_queue(queue), "client queue is full");
-
-   int res;
-   queue->waitingQueueNumber++;
-   res = item.order = queue->waitingQueueNumber;
-   queue->array[queue->tail] = item;
-   queue->tail = (queue->tail+1) % MAX_CLIENT_QUEUE_SIZE;
-   queue->size++;
-   return res;
+
+   long pos = __atomic_load_n(&queue->tail, __ATOMIC_RELAXED);
+   RQCell* cell;
+   for(;;)
+   {
+      cell = &queue->array[pos % queue->capacity];
+      long dif = __atomic_load_n(&cell->sequence, __ATOMIC_ACQUIRE) - pos;
+      if (dif == 0)
+      {
+         if (__atomic_compare_exchange_n(&queue->tail, &pos, pos+1, 1, __ATOMIC_RELAXED, __ATOMIC_RELAXED))
+            break;
+      }
+      else if (dif < 0)
+      {
+         // full: the callers never hold more items than the capacity,
+         // so a consumer is just finishing reading this cell
+         sched_yield();
+         pos = __atomic_load_n(&queue->tail, __ATOMIC_RELAXED);
+      }
+      else
+         pos = __atomic_load_n(&queue->tail, __ATOMIC_RELAXED);
+   }
+   item.order = (int)(pos+1);
+   cell->item = item;
+   __atomic_store_n(&cell->sequence, pos+1, __ATOMIC_RELEASE);
+   return item.order;
 }
 
 RQItem out_client_queue(ClientQueue* queue)
 {
    require (queue != NULL, "queue argument required");
-   require (!empty_client_queue(queue), "client queue is empty");
-
-   RQItem res = queue->array[queue->head];
-   queue->array[queue->head] = empty;
-   queue->head = (queue->head+1) % MAX_CLIENT_QUEUE_SIZE;
-   queue->size--;
 
+   long pos = __atomic_load_n(&queue->head, __ATOMIC_RELAXED);
+   RQCell* cell;
+   for(;;)
+   {
+      cell = &queue->array[pos % queue->capacity];
+      long dif = __atomic_load_n(&cell->sequence, __ATOMIC_ACQUIRE) - (pos+1);
+      if (dif == 0)
+      {
+         if (__atomic_compare_exchange_n(&queue->head, &pos, pos+1, 1, __ATOMIC_RELAXED, __ATOMIC_RELAXED))
+            break;
+      }
+      else if (dif < 0)
+      {
+         if (__atomic_load_n(&queue->tail, __ATOMIC_RELAXED) == pos) // empty
+            return empty;
+         sched_yield(); // a producer is just finishing writing this cell
+         pos = __atomic_load_n(&queue->head, __ATOMIC_RELAXED);
+      }
+      else
+         pos = __atomic_load_n(&queue->head, __ATOMIC_RELAXED);
+   }
+   RQItem res = cell->item;
+   cell->item = empty;
+   __atomic_store_n(&cell->sequence, pos+queue->capacity, __ATOMIC_RELEASE);
    return res;
 }
 
@@ -59,20 +107,23 @@ int empty_client_queue(ClientQueue* queue)
 {
    require (queue != NULL, "queue argument required");
 
-   return queue-> size == 0;
+   return size_client_queue(queue) == 0;
 }
 
 int full_client_queue(ClientQueue* queue)
 {
    require (queue != NULL, "queue argument required");
 
-   return queue-> size == MAX_CLIENT_QUEUE_SIZE;
+   return size_client_queue(queue) == queue->capacity;
 }
 
+/* (a snapshot: concurrent operations may change it at once) */
 int size_client_queue(ClientQueue* queue)
 {
    require (queue != NULL, "queue argument required");
 
-   return queue-> size;
+   long head = __atomic_load_n(&queue->head, __ATOMIC_ACQUIRE);
+   long tail = __atomic_load_n(&queue->tail, __ATOMIC_ACQUIRE);
+   long res = tail - head;
+   return res < 0 ? 0 : res > queue->capacity ? queue->capacity : (int)res;
 }
-
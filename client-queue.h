@@ -1,5 +1,10 @@
 /**
  *  \brief An array based client queue for barber shop.
+ *
+ * Bounded lock-free multi-producer/multi-consumer FIFO (it may live in a
+ * shared memory segment): producers and consumers claim positions with a
+ * compare-and-swap, and each cell sequence number tells whether it is
+ * ready to be written or read, so no lock serializes clients and barbers.
  *  
  * \author Miguel Oliveira e Silva - 2018
  */
@@ -9,8 +14,6 @@
 
 #include "global.h"
 
-#define MAX_CLIENT_QUEUE_SIZE MAX_CLIENT_BENCHES_SEATS
-
 typedef struct _RQItem_
 {
    int clientID;
@@ -19,21 +22,26 @@ typedef struct _RQItem_
    int order;
 } RQItem;
 
+typedef struct _RQCell_
+{
+   long sequence;    // position it can be written at (== position) or read from (== position+1)
+   RQItem item;
+} RQCell;
+
 typedef struct _ClientQueue_
 {
-   RQItem array[MAX_CLIENT_QUEUE_SIZE];
-   int head; // oldest item position
-   int tail; // first free position
-   int size;
-   int waitingQueueNumber;
+   int capacity;
+   RQCell* array;    // [capacity]
+   long head CACHE_ALIGNED; // next position to read (oldest item), claimed by consumers
+   long tail CACHE_ALIGNED; // next position to write (its order number is tail+1), claimed by producers
 } ClientQueue;
 
 RQItem empty_item();
-void init_client_queue(ClientQueue* queue);
+size_t sizeof_client_queue_arrays(int capacity);
+void init_client_queue(ClientQueue* queue, int capacity, Storage* storage);
 void term_client_queue(ClientQueue* queue);
-int terminated_client_queue(ClientQueue* queue);
-int in_client_queue(ClientQueue* queue, RQItem item);
-RQItem out_client_queue(ClientQueue* queue);
+int in_client_queue(ClientQueue* queue, RQItem item);  // returns its order number
+RQItem out_client_queue(ClientQueue* queue);           // empty_item() if empty
 int empty_client_queue(ClientQueue* queue);
 int full_client_queue(ClientQueue* queue);
 int size_client_queue(ClientQueue* queue);
@@ -3,10 +3,14 @@
 #include "global.h"
 #include "utils.h"
 #include "box.h"
+#include "box-template.h"
 #include "timer.h"
 #include "logger.h"
+#include "compositor.h"
+#include "trace.h"
 #include "service.h"
 #include "client.h"
+#include "sim-stats.h"
 
 enum ClientState
 {
@@ -20,6 +24,7 @@ enum ClientState
    HAVING_A_HAIRCUT,           // haircut in progress
    HAVING_A_SHAVE,             // shave in progress
    HAVING_A_HAIR_WASH,         // hair wash in progress
+   HAVING_A_SHAVE_AND_HAIRCUT, // shave and haircut in progress (batched in the same chair)
    DONE                        // final state
 };
 
@@ -37,6 +42,7 @@ static const char* stateText[State_SIZE] =
    "HAIRCUT  ",
    "SHAVE    ",
    "HAIR WASH",
+   "SHV+HCUT ",
    "DONE     ",
 };
 
@@ -46,6 +52,9 @@ static const char* skel =
    "+---+---+-+-+\n"
    "|#########|#|\n"
    "@---------+-@";
+static int numLines = string_num_lines((char*)skel);       // (skeleton scanned once)
+static int numColumns = string_num_columns((char*)skel);
+static BoxTemplate skel_boxes;      // (compiled by the first init of a rendered shop)
 static int skel_length = num_lines_client()*(num_columns_client()+1)*4; // extra space for (pessimistic) utf8 encoding!
 
 static void life(Client* client);
@@ -55,10 +64,11 @@ static void notify_client_death(Client* client);
 static void wandering_outside(Client* client);
 static int vacancy_in_barber_shop(Client* client);
 static void select_requests(Client* client);
-static void wait_its_turn(Client* client);
+static int wait_its_turn(Client* client);
 static void rise_from_client_benches(Client* client);
 static void wait_all_services_done(Client* client);
 
+static void trace_client(Client* client);
 static char* to_string_client(Client* client);
 
 size_t sizeof_client()
@@ -68,12 +78,24 @@ size_t sizeof_client()
 
 int num_lines_client()
 {
-   return string_num_lines((char*)skel);
+   return numLines;
 }
 
 int num_columns_client()
 {
-   return string_num_columns((char*)skel);
+   return numColumns;
+}
+
+int num_states_client()
+{
+   return State_SIZE;
+}
+
+const char* state_text_client(int state)
+{
+   require (state >= 0 && state < State_SIZE, concat_3str("invalid state (", int2str(state), ")"));
+
+   return stateText[state];
 }
 
 void init_client(Client* client, int id, BarberShop* shop, int num_trips_to_barber, int line, int column)
@@ -87,6 +109,7 @@ void init_client(Client* client, int id, BarberShop* shop, int num_trips_to_barb
 
    client->id = id;
    client->state = NONE;
+   client->tracedState = NONE;
    client->shop = shop;
    client->barberID = 0;
    client->num_trips_to_barber = num_trips_to_barber;
@@ -94,9 +117,16 @@ void init_client(Client* client, int id, BarberShop* shop, int num_trips_to_barb
    client->benchesPosition = -1;
    client->chairPosition = -1;
    client->basinPosition = -1;
-   client->internal = NULL;
-   client->logId = register_logger((char*)("Client:"), line ,column,
-                                   num_lines_client(), num_columns_client(), NULL);
+   client->benchesTime = 0;
+   client->internal = (char*)mem_alloc(skel_length + 1);
+   client->logId = -1;
+   if (!global->HEADLESS) // the logger only registers the areas of a rendered shop
+   {
+      if (!compiled_box_template(&skel_boxes))
+         init_box_template(&skel_boxes, skel);
+      client->logId = register_logger((char*)("Client:"), line ,column,
+                                      num_lines_client(), num_columns_client(), NULL);
+   }
 }
 
 void term_client(Client* client)
@@ -113,8 +143,10 @@ void term_client(Client* client)
 void log_client(Client* client)
 {
    require (client != NULL, "client argument required");
-   spend(random_int(global->MIN_VITALITY_TIME_UNITS, global->MAX_VITALITY_TIME_UNITS));
-   send_log(client->logId, to_string_client(client));
+
+   trace_client(client);
+   if (!global->HEADLESS)
+      compose_log(client->logId, to_string_client(client));
 }
 
 void* main_client(void* args)
@@ -123,7 +155,9 @@ void* main_client(void* args)
    Client* client = (Client*)args;
    require (client != NULL, "client argument required");
    //debug_log(client->shop,"main_client\tStarted the CLIENT %d", client->id );
+   enter_sim_clock(global->NUM_BARBERS+client->id-1);
    life(client);
+   leave_sim_clock();
    return NULL;
 }
 
@@ -139,10 +173,12 @@ static void life(Client* client)
       if (vacancy_in_barber_shop(client))
       {
          select_requests(client);
-         wait_its_turn(client);
-         rise_from_client_benches(client);
-         wait_all_services_done(client);
-         i++;
+         if (wait_its_turn(client)) // otherwise gave up waiting for a seat
+         {
+            rise_from_client_benches(client);
+            wait_all_services_done(client);
+            i++;
+         }
       }
    }
    notify_client_death(client);
@@ -160,6 +196,7 @@ static void notify_client_birth(Client* client)
     * It is not necessary to inform that a new client began it's existence
     **/
 
+   pace_sim_clock();
    log_client(client);
 }
 
@@ -177,6 +214,8 @@ static void notify_client_death(Client* client)
 
    require (client != NULL, "client argument required");
 
+   client->state = DONE;
+   pace_sim_clock();
    log_client(client);
 }
 
@@ -193,9 +232,10 @@ static void wandering_outside(Client* client)
 
    //debug_log(client->shop,"wandering_outside\tCLIENT %d - is wandering outside for %d seconds", client->id , random_time);
    
-   sleep(random_time);
+   sleep_sim_clock(random_time);
    require (client != NULL, "client argument required");
 
+   pace_sim_clock();
    log_client(client);
 }
 
@@ -218,12 +258,13 @@ static int vacancy_in_barber_shop(Client* client)
     client->chairPosition = -1;
     client->requests = 0;
 
-    psem_wait(&client->shop->mutex_client_bench);
-    int res = (num_available_benches_seats(client_benches(client->shop))>0);
-    psem_post(&client->shop->mutex_client_bench);
+    clock_sem_wait(&client->shop->mutex_client_bench);
+    int res = (num_vacant_benches_seats(client->shop)>0);
+    clock_sem_post(&client->shop->mutex_client_bench);
    
     require (client != NULL, "client argument required");
 
+    pace_sim_clock();
     log_client(client);
     return (res);
 }
@@ -263,10 +304,11 @@ static void select_requests(Client* client)
 
    require (client != NULL, "client argument required");
 
+   pace_sim_clock();
    log_client(client);
 }
 
-static void wait_its_turn(Client* client)
+static int wait_its_turn(Client* client)
 {
    /** DONE:
     * 1: set the client state to WAITING_ITS_TURN
@@ -276,41 +318,44 @@ static void wait_its_turn(Client* client)
     * 
     * COMMENT
     * 
-    * We will wait for an empty seat if none is available (random between 1 and 3), if we can get a seat then 
-    * we will wait for a barber to be assigned to the client.
+    * If no seat is available the client joins the (FIFO) benches waiting list and blocks until
+    * a rising client hands its seat over (or, with a benches wait limit, gives up and returns 0).
+    * Once seated we will wait for a barber to be assigned to the client.
     * 
     **/
    client->state = WAITING_ITS_TURN;
    //debug_log(client->shop,"wait_its_turn\tThe client %d is waitting for its turn", client->id);
    int idx = -1;
+   int queued = 0;
 
-   do {
-
-      psem_wait(&client->shop->mutex_client_bench);
-
-      if (num_available_benches_seats(client_benches(client->shop))>0) {
-         idx = enter_barber_shop(client->shop,client->id, client->requests);
-         client->benchesPosition = idx;
-         //debug_log(client->shop,"wait_its_turn\tThe client %d is sitted in %d position", client->id, client->benchesPosition);
-      } else {
-         //debug_log(client->shop,"wait_its_turn\tThe client %d has no seats available", client->id);
-      }
-      
-      psem_post(&client->shop->mutex_client_bench);
+   clock_sem_wait(&client->shop->mutex_client_bench);
+   if (num_vacant_benches_seats(client->shop)>0)
+      idx = enter_barber_shop(client->shop,client->id, client->requests);
+   else if (global->MAX_BENCHES_WAIT_TIME_UNITS != 0)
+   {
+      queue_for_benches_seat(client->shop, client->id);
+      queued = 1;
+   }
+   clock_sem_post(&client->shop->mutex_client_bench);
 
-      if (idx != -1) {         
-         //debug_log(client->shop,"wait_its_turn\tThe client %d is greatting the barber", client->id);         
-         client->barberID = greet_barber(client->shop,client->id);
-         //debug_log(client->shop,"wait_its_turn\tThe client %d has been assigned barber %d", client->id, client->barberID);
-      }
-      
-      log_client(client);
+   if (queued)
+      idx = wait_benches_seat(client->shop, client->id, client->requests, global->MAX_BENCHES_WAIT_TIME_UNITS);
 
-      sleep(random_int(1,3));
+   if (idx != -1) {
+      client->benchesPosition = idx;
+      client->benchesTime = now_sim_clock();
+      //debug_log(client->shop,"wait_its_turn\tThe client %d is sitted in %d position", client->id, client->benchesPosition);
+      client->barberID = greet_barber(client->shop,client->id,idx);
+      //debug_log(client->shop,"wait_its_turn\tThe client %d has been assigned barber %d", client->id, client->barberID);
+   } else
+      client_gave_up_sim_stats();
 
-   } while (idx == -1);
+   pace_sim_clock();
+   log_client(client);
 
    require (client != NULL, "client argument required");
+
+   return idx != -1;
 }
 
 static void rise_from_client_benches(Client* client)
@@ -326,17 +371,19 @@ static void rise_from_client_benches(Client* client)
 
    require (client != NULL, "client argument required");
    require (client != NULL, "client argument required");
-   require (seated_in_client_benches(client_benches(client->shop), client->id), concat_3str("client ",int2str(client->id)," not seated in benches"));
+   require (occupied_by_id_client_benches(client_benches(client->shop), client->benchesPosition, client->id), concat_3str("client ",int2str(client->id)," not seated in benches"));
 
 
-   psem_wait(&client->shop->mutex_client_bench);
+   clock_sem_wait(&client->shop->mutex_client_bench);
    rise_client_benches(client_benches(client->shop),client->benchesPosition, client->id);
-   psem_post(&client->shop->mutex_client_bench);
+   hand_over_benches_seat(client->shop);
+   clock_sem_post(&client->shop->mutex_client_bench);
    //debug_log(client->shop, "rise_from_client_benches\tRemoved the client %d from position %d ", client->id, client->benchesPosition);   
    
    client->benchesPosition = -1;
+   bench_time_sim_stats(now_sim_clock()-client->benchesTime);
 
-
+   pace_sim_clock();
    log_client(client);
 }
 
@@ -358,6 +405,7 @@ static void wait_all_services_done(Client* client)
    require (client != NULL, "client argument required");
 
    client->state = WAITING_SERVICE;
+   pace_sim_clock();
    log_client(client);
 
    int req = client->requests;
@@ -367,19 +415,15 @@ static void wait_all_services_done(Client* client)
       client->chairPosition = -1;
       client->state = WAITING_SERVICE_START;      
 
-      if (s.request == HAIRCUT_REQ || s.request == SHAVE_REQ) {
+      if (is_barber_chair_service(&s)) {
          //debug_log(client->shop, "wait_service_from_barber\tThe client %d is seatting in barber chair position %d", s.clientID, s.pos);   
-         //Sit the client in the barber chair
-         psem_wait(&client->shop->mutex_barber_chairs);
+         //Sit the client in the barber chair (reserved for it by its barber)
          sit_in_barber_chair(barber_chair(client->shop,s.pos), client->id);
-         psem_post(&client->shop->mutex_barber_chairs);
          //debug_log(client->shop, "wait_service_from_barber\tThe client %d is seated", s.clientID);
       }else {
          //debug_log(client->shop, "wait_service_from_barber\tThe client %d is seatting in washbasin position %d", s.clientID, s.pos);   
-         //Sit the client in the washbasin
-         psem_wait(&client->shop->mutex_washbasins);
+         //Sit the client in the washbasin (reserved for it by its barber)
          sit_in_washbasin(washbasin(client->shop,s.pos), client->id);
-         psem_post(&client->shop->mutex_washbasins);
          //debug_log(client->shop, "wait_service_from_barber\tThe client %d is seated", s.clientID);
       }
 
@@ -387,22 +431,26 @@ static void wait_all_services_done(Client* client)
       if (s.request == HAIRCUT_REQ) {
          client->state = HAVING_A_HAIRCUT;
          client->chairPosition = s.pos;
-      } else if (s.request = SHAVE_REQ) {
-         client->state = HAVING_A_HAIR_WASH;
+      } else if (s.request == SHAVE_REQ) {
+         client->state = HAVING_A_SHAVE;
+         client->chairPosition = s.pos;
+      } else if (s.request == (SHAVE_REQ|HAIRCUT_REQ)) {
+         client->state = HAVING_A_SHAVE_AND_HAIRCUT;
          client->chairPosition = s.pos;
       } else {
-         client->state = HAVING_A_SHAVE;
+         client->state = HAVING_A_HAIR_WASH;
          client->basinPosition = s.pos;
       }
                
       //debug_log(client->shop, "wait_service_from_barber\tClient %d inform barber can  start", s.clientID);         
       //Inform the barber that he can continue to perform the service
-      psem_post(&client->shop->sem_services_client[s.barberID]); 
+      client_ready_for_service(client->shop, s.barberID);
 
       //debug_log(client->shop, "wait_service_from_barber\tClient %d waitting for barber %d to finish", s.clientID, s.barberID); 
-      psem_wait(&client->shop->sem_services_barber[s.barberID]); 
+      wait_service_done(client->shop, s.barberID);
       //debug_log(client->shop, "wait_service_from_barber\tClient %d waitting for barber %d SERVICE COMPLETED", s.clientID, s.barberID);
    
+      pace_sim_clock();
       log_client(client);   
 
       req = req - s.request;
@@ -412,15 +460,42 @@ static void wait_all_services_done(Client* client)
       s = wait_service_from_barber(client->shop, client->barberID);   
    } 
 
-   psem_post(&client->shop->sem_services_finish[client->barberID]); 
+   release_barber(client->shop, client->barberID);
 
+   clock_sem_wait(&client->shop->mutex_client_bench); //the clients inside are updated as on entering
    leave_barber_shop(client->shop,client->id);
+   clock_sem_post(&client->shop->mutex_client_bench);
+   client_served_sim_stats();
 
+   pace_sim_clock();
    log_client(client);
 
 }
 
 
+static void trace_client(Client* client)
+{
+   int kind = TRACE_NO_RESOURCE;
+   int pos = -1;
+   if (client->chairPosition >= 0)
+   {
+      kind = TRACE_BARBER_CHAIR;
+      pos = client->chairPosition;
+   }
+   else if (client->basinPosition >= 0)
+   {
+      kind = TRACE_WASHBASIN;
+      pos = client->basinPosition;
+   }
+   else if (client->benchesPosition >= 0)
+   {
+      kind = TRACE_CLIENT_BENCHES;
+      pos = client->benchesPosition;
+   }
+   trace_event(TRACE_CLIENT, client->id, client->tracedState, client->state, kind, pos, client->requests);
+   client->tracedState = client->state;
+}
+
 static char* to_string_client(Client* client)
 {
    require (client != NULL, "client argument required");
@@ -440,10 +515,10 @@ static char* to_string_client(Client* client)
    else if (client->basinPosition >= 0)
       pos = int2nstr(client->basinPosition+1, 1);
 
-   return gen_boxes(client->internal, skel_length, skel,
-                    int2nstr(client->id, 2),
-                    client->barberID > 0 ? int2nstr(client->barberID, 2) : "--",
-                    requests, stateText[client->state], pos);
+   return gen_box_template(&skel_boxes, client->internal, skel_length,
+                           int2nstr(client->id, 2),
+                           client->barberID > 0 ? int2nstr(client->barberID, 2) : "--",
+                           requests, stateText[client->state], pos);
 }
 
 /*
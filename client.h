@@ -14,6 +14,7 @@ typedef struct _Client_
 {
    int id; // 1, 2, ...
    int state;
+   int tracedState;   // state of the last log
 
    BarberShop* shop;
    int barberID;
@@ -25,9 +26,11 @@ typedef struct _Client_
    int chairPosition; // -1 if not in client chair
    int basinPosition; // -1 if not in washbasin
 
+   long benchesTime;  // simulation time (ms) when seated in client benches
+
    int logId;
    char* internal;
-} Client;
+} CACHE_ALIGNED Client;
 
 
 int _generate_random_request(int requests[], int probabilities[], int size);
@@ -39,6 +42,8 @@ int _find_ceil(int arr[], int r, int l, int h);
 size_t sizeof_client();
 int num_lines_client();
 int num_columns_client();
+int num_states_client();
+const char* state_text_client(int state);
 void init_client(Client* client, int id, BarberShop* shop, int num_trips_to_barber, int line, int column);
 void term_client(Client* client);
 void log_client(Client* client);
@@ -0,0 +1,258 @@
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <time.h>
+#include "dbc.h"
+#include "utils.h"
+#include "process.h"
+#include "thread.h"
+#include "logger.h"
+#include "compositor.h"
+
+#define MAX_RUN_GAP 3         // unchanged cells rewritten rather than moving the cursor past them
+#define MAX_CURSOR_MOVE 16    // bytes of "\033[<line>;<column>f"
+
+static Compositor* compositor = NULL; // shared by all processes (inherited through fork)
+static pthread_t renderer;
+static int stopRendering = 0;
+
+static void* main_renderer(void* arg);
+static void render_frame();
+static void write_all(char* buf, size_t size);
+static void compose_cell(int line, int column, char* glyph);
+static char* next_glyph(char* text, char* glyph);
+
+size_t sizeof_compositor_arrays(int num_lines, int num_columns)
+{
+   require (num_lines > 0, concat_3str("invalid number of lines (", int2str(num_lines), ")"));
+   require (num_columns > 0, concat_3str("invalid number of columns (", int2str(num_columns), ")"));
+
+   return 2*storage_size(num_lines*num_columns*sizeof(Cell)) + 2*storage_size(num_lines*sizeof(int)) +
+          storage_size(num_lines*num_columns*(MAX_UTF8_STRING+MAX_CURSOR_MOVE)+2*MAX_CURSOR_MOVE);
+}
+
+void init_compositor(Compositor* comp, int num_lines, int num_columns, int max_fps, int pshared, Storage* storage)
+{
+   require (comp != NULL, "compositor argument required");
+   require (num_lines > 0, concat_3str("invalid number of lines (", int2str(num_lines), ")"));
+   require (num_columns > 0, concat_3str("invalid number of columns (", int2str(num_columns), ")"));
+   require (max_fps > 0, concat_3str("invalid frame rate (", int2str(max_fps), ")"));
+   require (storage != NULL, "storage argument required");
+
+   comp->numLines = num_lines;
+   comp->numColumns = num_columns;
+   comp->maxFps = max_fps;
+   comp->launched = 0;
+   psem_init(&comp->mutex, pshared, 1);
+   comp->screen = (Cell*)storage_alloc(storage, num_lines*num_columns*sizeof(Cell));
+   comp->shown = (Cell*)storage_alloc(storage, num_lines*num_columns*sizeof(Cell));
+   for(int i = 0; i < num_lines*num_columns; i++)
+   {
+      strcpy(comp->screen[i].glyph, " ");
+      strcpy(comp->shown[i].glyph, " "); // (the screen is cleared at launch)
+   }
+   comp->damageFirst = (int*)storage_alloc(storage, num_lines*sizeof(int));
+   comp->damageLast = (int*)storage_alloc(storage, num_lines*sizeof(int));
+   for(int l = 0; l < num_lines; l++)
+   {
+      comp->damageFirst[l] = num_columns;
+      comp->damageLast[l] = -1;
+   }
+   comp->frame = (char*)storage_alloc(storage, num_lines*num_columns*(MAX_UTF8_STRING+MAX_CURSOR_MOVE)+2*MAX_CURSOR_MOVE);
+   comp->logs = 0;
+   comp->logBytes = 0;
+   comp->frames = 0;
+   comp->cellsWritten = 0;
+   comp->bytesWritten = 0;
+
+   compositor = comp;
+}
+
+void launch_compositor()
+{
+   require (compositor != NULL, "compositor not initialized");
+   require (!compositor->launched, "compositor already launched");
+
+   if (line_mode_logger())
+      return;
+   fflush(stdout); // (frames are written past stdio)
+   write_all((char*)"\033[?25l\033[2J", strlen("\033[?25l\033[2J")); // hide the cursor, clear the screen
+   stopRendering = 0;
+   compositor->launched = 1;
+   thread_create(&renderer, NULL, main_renderer, NULL);
+}
+
+void term_compositor()
+{
+   require (compositor != NULL, "compositor not initialized");
+
+   if (compositor->launched)
+   {
+      __atomic_store_n(&stopRendering, 1, __ATOMIC_RELEASE);
+      thread_join(renderer, NULL);
+      char buf[2*MAX_CURSOR_MOVE];
+      sprintf(buf, "\033[%d;1f\033[?25h", compositor->numLines+1); // show the cursor
+      write_all(buf, strlen(buf));
+   }
+   psem_destroy(&compositor->mutex);
+}
+
+void compose_log(int logId, char* text)
+{
+   require (text != NULL, "text argument required");
+
+   if (compositor == NULL || !compositor->launched)
+   {
+      send_log(logId, text);
+      return;
+   }
+
+   int line = get_line_logger(logId);
+   int column = get_column_logger(logId);
+
+   // the text is painted from the window origin, as the logger does (neither clipped to the
+   // window nor clearing the cells it does not cover); only the screen bounds clip it
+   psem_wait(&compositor->mutex);
+   compositor->logs++;
+   compositor->logBytes += strlen(text);
+   for(int l = 0; *text != '\0'; l++)
+   {
+      int c = 0;
+      char glyph[MAX_UTF8_STRING+1];
+      while (*text != '\0' && *text != '\n')
+      {
+         text = next_glyph(text, glyph);
+         if (glyph[0] != '\0')
+            compose_cell(line+l, column+c++, glyph);
+      }
+      if (*text == '\n')
+         text++;
+   }
+   psem_post(&compositor->mutex);
+}
+
+void report_compositor(FILE* out)
+{
+   require (out != NULL, "out argument required");
+   require (compositor != NULL, "compositor not initialized");
+
+   if (compositor->frames == 0)
+      return;
+   fprintf(out, "  rendering: %ld logs (%ld bytes) in %ld frames, %ld cells (%ld bytes) written\n",
+           compositor->logs, compositor->logBytes, compositor->frames, compositor->cellsWritten, compositor->bytesWritten);
+}
+
+/* (compositor thread) a frame per period while the simulation runs, and the last one */
+static void* main_renderer(void* arg)
+{
+   struct timespec period;
+   period.tv_sec = 0;
+   period.tv_nsec = 1000000000L/compositor->maxFps;
+   while (!__atomic_load_n(&stopRendering, __ATOMIC_ACQUIRE))
+   {
+      nanosleep(&period, NULL);
+      render_frame();
+   }
+   render_frame();
+   return NULL;
+}
+
+/* writes the cells changed since the last frame (nothing if none) */
+static void render_frame()
+{
+   char* out = compositor->frame;
+   long cells = 0;
+
+   psem_wait(&compositor->mutex);
+   for(int l = 0; l < compositor->numLines; l++)
+   {
+      Cell* screen = compositor->screen + l*compositor->numColumns;
+      Cell* shown = compositor->shown + l*compositor->numColumns;
+      int c = compositor->damageFirst[l];
+      while (c <= compositor->damageLast[l])
+      {
+         if (strcmp(screen[c].glyph, shown[c].glyph) == 0)
+         {
+            c++;
+            continue;
+         }
+         // a run of changed cells, through short gaps of unchanged ones
+         int first = c;
+         int end = c;
+         for(; c <= compositor->damageLast[l] && c-end <= MAX_RUN_GAP; c++)
+            if (strcmp(screen[c].glyph, shown[c].glyph) != 0)
+               end = c+1;
+         out += sprintf(out, "\033[%d;%df", l+1, first+1);
+         for(int i = first; i < end; i++)
+         {
+            strcpy(shown[i].glyph, screen[i].glyph);
+            out = stpcpy(out, screen[i].glyph);
+         }
+         cells += end-first;
+         c = end;
+      }
+      compositor->damageFirst[l] = compositor->numColumns;
+      compositor->damageLast[l] = -1;
+   }
+   psem_post(&compositor->mutex);
+
+   if (out == compositor->frame)
+      return;
+   out += sprintf(out, "\033[%d;1f", compositor->numLines+1); // (cursor kept below the screen)
+   write_all(compositor->frame, out-compositor->frame);
+   compositor->frames++;
+   compositor->cellsWritten += cells;
+   compositor->bytesWritten += out-compositor->frame;
+}
+
+static void write_all(char* buf, size_t size)
+{
+   while (size > 0)
+   {
+      ssize_t n = write(STDOUT_FILENO, buf, size);
+      if (n <= 0)
+         return; // (terminal gone)
+      buf += n;
+      size -= n;
+   }
+}
+
+/* (mutex locked) cells outside the screen are clipped */
+static void compose_cell(int line, int column, char* glyph)
+{
+   if (line < 0 || line >= compositor->numLines || column < 0 || column >= compositor->numColumns)
+      return;
+
+   Cell* cell = compositor->screen + line*compositor->numColumns + column;
+   if (strcmp(cell->glyph, glyph) == 0)
+      return;
+   strcpy(cell->glyph, glyph);
+   if (column < compositor->damageFirst[line])
+      compositor->damageFirst[line] = column;
+   if (column > compositor->damageLast[line])
+      compositor->damageLast[line] = column;
+}
+
+/* next UTF8 character of text (empty glyph for a terminal escape sequence, which is skipped) */
+static char* next_glyph(char* text, char* glyph)
+{
+   if (*text == '\033')
+   {
+      text++;
+      if (*text == '[')
+         for(text++; *text != '\0' && (*text < '@' || *text > '~'); text++)
+            ;
+      if (*text != '\0')
+         text++;
+      glyph[0] = '\0';
+      return text;
+   }
+
+   unsigned char first = (unsigned char)*text;
+   int n = first < 0x80 ? 1 : first >= 0xF0 ? 4 : first >= 0xE0 ? 3 : first >= 0xC0 ? 2 : 1;
+   int i;
+   for(i = 0; i < n && text[i] != '\0'; i++)
+      glyph[i] = text[i];
+   glyph[i] = '\0';
+   return text+i;
+}
@@ -0,0 +1,63 @@
+/**
+ *  \brief Damage-tracking compositor of the window mode logs
+ *
+ * In window mode every log repaints the whole window of its entity (a box
+ * regenerated by gen_boxes).  Instead of handing the logs to the logger,
+ * they are composed into a framebuffer of the screen, shared by all
+ * processes, recording per line the columns whose cells changed.  A thread
+ * of the main process renders at most maxFps frames per second: it diffs the
+ * damaged cells against those last written to the terminal and writes only
+ * the changed ones (a cursor move per run of cells), the whole frame in a
+ * single write().  A cell changed back within a frame is not written at all.
+ * In line mode (and before the compositor is launched) logs go straight to
+ * the logger.
+ */
+
+#ifndef COMPOSITOR_H
+#define COMPOSITOR_H
+
+#include <stdio.h>
+#include <semaphore.h>
+#include "utf8.h"
+#include "global.h"
+
+#define DEFAULT_MAX_FPS 30
+
+typedef struct _Cell_
+{
+   char glyph[MAX_UTF8_STRING+1];  // one UTF8 character
+} Cell;
+
+typedef struct _Compositor_
+{
+   int numLines;
+   int numColumns;
+   int maxFps;
+   int launched;
+
+   sem_t mutex;
+   // protected by mutex:
+   Cell* screen;          // [numLines*numColumns] as logged
+   int* damageFirst;      // [numLines] first column changed since the last frame (numColumns if none)
+   int* damageLast;       // [numLines] last column changed since the last frame (-1 if none)
+   long logs;
+   long logBytes;
+
+   // (compositor thread only)
+   Cell* shown;           // [numLines*numColumns] as written to the terminal
+   char* frame;           // output of one frame
+   long frames;
+   long cellsWritten;
+   long bytesWritten;
+} Compositor;
+
+size_t sizeof_compositor_arrays(int num_lines, int num_columns);
+void init_compositor(Compositor* compositor, int num_lines, int num_columns, int max_fps, int pshared, Storage* storage);
+void launch_compositor();         // (window mode) clears the screen and starts rendering frames
+void term_compositor();           // renders the last frame, the cursor left below the screen
+
+void compose_log(int logId, char* text); // (instead of send_log)
+
+void report_compositor(FILE* out); // one report line (window mode)
+
+#endif
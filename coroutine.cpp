@@ -0,0 +1,475 @@
+#include <stdlib.h>
+#include <time.h>
+#include <stdio.h>
+#include <pthread.h>
+#include <ucontext.h>
+#include <sys/mman.h>
+#include "dbc.h"
+#include "utils.h"
+#include "thread.h"
+#include "coroutine.h"
+
+typedef struct _Coroutine_
+{
+   ucontext_t context;
+   void* (*func)(void*);
+   void* arg;
+   int wakeups;    // pending resumes (-1: suspended, waiting for one)
+   int finished;
+   int prev;       // links of the run queue holding it
+   int next;
+} Coroutine;
+
+/* run queue (double linked through the coroutines, so it never fills up) */
+typedef struct _RunQueue_
+{
+   pthread_mutex_t mutex;
+   int first;      // oldest (stolen from here)
+   int last;       // newest (its owner takes from here)
+   int runNext;    // last coroutine woken by the owner, run before the others (-1 if none)
+} RunQueue;
+
+typedef struct _Worker_
+{
+   pthread_t thread;
+   RunQueue queue;
+   long busyNs;
+   long totalNs;
+   long runs;
+   long steals;
+} Worker;
+
+// each coroutine lives at the top of its own slot, and its stack takes the rest,
+// growing down to a canary at the slot bottom: an overflow overwrites it first, and
+// it is checked whenever the coroutine gives its worker back
+// (one mapping for all, so memory is only committed for the pages actually touched:
+// a single page for the header and the top of a shallow stack; the canary is the
+// untouched zeros of the bottom page, read through the shared zero page, and there
+// are no guard pages, as each would split the mapping and the mappings of a process
+// are limited to some 65k)
+#define SLOT_HEADER ((sizeof(Coroutine)+63)/64*64)
+#define CANARY_WORDS 8
+
+static char* slots = NULL;
+static size_t slotsSize = 0;
+static int numCoroutines = 0;
+
+static Worker* workers = NULL;
+static int numWorkers = 0;
+static RunQueue injected;         // coroutines made runnable outside the workers
+
+static int numQueued = 0;         // runnable coroutines in all queues
+static int numIdle = 0;           // workers sleeping for lack of work
+static pthread_mutex_t idleMutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t idleCond = PTHREAD_COND_INITIALIZER;       // runnable coroutine, or all finished
+
+static void (*workerEnter)(int worker) = NULL;
+static void (*workerLeave)(int worker) = NULL;
+
+static int numFinished = 0;
+static pthread_mutex_t finishedMutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t finishedCond = PTHREAD_COND_INITIALIZER;
+
+static __thread int running = -1;                 // coroutine run by the calling worker
+static __thread int workerIndex = -1;             // index of the calling worker
+static __thread ucontext_t* workerContext = NULL;
+
+static Coroutine* coroutine(int id);
+static long* canary(int id);
+static int stack_overflown(int id);
+static void init_queue(RunQueue* queue);
+static void push_last(RunQueue* queue, int id);
+static int take_last(RunQueue* queue);
+static int take_first(RunQueue* queue);
+static void make_runnable(int id, int lifo);
+static int find_runnable(int w);
+static void* worker(void* arg);
+static void work(int w, void (*idle)());
+static void trampoline(int id);
+static ucontext_t* worker_context();
+static int current_worker();
+static long now_ns();
+
+void init_coroutines(int num_coroutines, int num_workers)
+{
+   require (num_coroutines > 0, concat_3str("invalid number of coroutines (", int2str(num_coroutines), ")"));
+   require (num_workers > 0, concat_3str("invalid number of workers (", int2str(num_workers), ")"));
+   require (slots == NULL, "coroutines already initialized");
+
+   numCoroutines = num_coroutines;
+   numWorkers = num_workers;
+   slotsSize = (size_t)num_coroutines*COROUTINE_STACK_SIZE;
+   slots = (char*)mmap(NULL, slotsSize, PROT_READ|PROT_WRITE, MAP_PRIVATE|MAP_ANONYMOUS|MAP_NORESERVE, -1, 0);
+   check (slots != MAP_FAILED, "unable to map the coroutines stacks");
+   workers = (Worker*)mem_alloc(num_workers*sizeof(Worker));
+   for(int i = 0; i < num_workers; i++)
+   {
+      init_queue(&workers[i].queue);
+      workers[i].busyNs = workers[i].totalNs = 0;
+      workers[i].runs = workers[i].steals = 0;
+   }
+   init_queue(&injected);
+   numQueued = numIdle = numFinished = 0;
+}
+
+void term_coroutines()
+{
+   require (slots != NULL, "coroutines not initialized");
+
+   for(int i = 0; i < numWorkers; i++)
+      mutex_destroy(&workers[i].queue.mutex);
+   mutex_destroy(&injected.mutex);
+   munmap(slots, slotsSize);
+   mem_free(workers);
+   slots = NULL;
+}
+
+void create_coroutine(int id, void* (*func)(void*), void* arg)
+{
+   require (slots != NULL, "coroutines not initialized");
+   require (id >= 0 && id < numCoroutines, concat_3str("invalid coroutine (", int2str(id), ")"));
+   require (func != NULL, "function argument required");
+
+   Coroutine* c = coroutine(id);
+   getcontext(&c->context);
+   c->context.uc_stack.ss_sp = canary(id)+CANARY_WORDS;
+   c->context.uc_stack.ss_size = COROUTINE_STACK_SIZE-SLOT_HEADER-CANARY_WORDS*sizeof(long);
+   c->context.uc_link = NULL;
+   makecontext(&c->context, (void (*)())trampoline, 1, id);
+   c->func = func;
+   c->arg = arg;
+   c->wakeups = 0;
+   c->finished = 0;
+   make_runnable(id, 0);
+}
+
+void on_coroutine_workers(void (*enter)(int worker), void (*leave)(int worker))
+{
+   workerEnter = enter;
+   workerLeave = leave;
+}
+
+void start_coroutines()
+{
+   require (slots != NULL, "coroutines not initialized");
+
+   // spread the initial coroutines, so that workers do not start by stealing one at a time
+   int w = 0;
+   int id;
+   while((id = take_first(&injected)) != -1)
+   {
+      push_last(&workers[w].queue, id);
+      w = (w+1)%numWorkers;
+   }
+   for(int i = 0; i < numWorkers; i++)
+      thread_create(&workers[i].thread, NULL, worker, (void*)(long)i);
+}
+
+void run_coroutines(void (*idle)())
+{
+   require (slots != NULL, "coroutines not initialized");
+   require (numWorkers == 1, "only a single worker runs in the calling thread");
+   require (idle != NULL, "idle function required");
+
+   int id;
+   while((id = take_first(&injected)) != -1)
+      push_last(&workers[0].queue, id);
+   work(0, idle);
+}
+
+void join_coroutine(int id)
+{
+   require (slots != NULL, "coroutines not initialized");
+   require (id >= 0 && id < numCoroutines, concat_3str("invalid coroutine (", int2str(id), ")"));
+   require (current_coroutine() == -1, "coroutines cannot join coroutines");
+
+   mutex_lock(&finishedMutex);
+   while(!coroutine(id)->finished)
+      cond_wait(&finishedCond, &finishedMutex);
+   mutex_unlock(&finishedMutex);
+}
+
+void stop_coroutines()
+{
+   require (slots != NULL, "coroutines not initialized");
+
+   for(int i = 0; i < numWorkers; i++)
+      thread_join(workers[i].thread, NULL);
+}
+
+/* (not inlined: a coroutine may resume in a different worker, so thread locals must be read anew) */
+__attribute__((noinline)) int current_coroutine()
+{
+   return running;
+}
+
+void suspend_coroutine()
+{
+   require (current_coroutine() >= 0, "not in a coroutine");
+
+   Coroutine* c = coroutine(current_coroutine());
+   swapcontext(&c->context, worker_context()); // the worker decides whether it really parks
+}
+
+void resume_coroutine(int id)
+{
+   require (id >= 0 && id < numCoroutines, concat_3str("invalid coroutine (", int2str(id), ")"));
+
+   if (__atomic_fetch_add(&coroutine(id)->wakeups, 1, __ATOMIC_ACQ_REL) == -1)
+      make_runnable(id, 1);
+}
+
+int num_coroutine_workers()
+{
+   return numWorkers;
+}
+
+WorkerStats coroutine_worker_stats(int worker)
+{
+   require (slots != NULL, "coroutines not initialized");
+   require (worker >= 0 && worker < numWorkers, concat_3str("invalid worker (", int2str(worker), ")"));
+
+   Worker* w = workers+worker;
+   WorkerStats res;
+   res.utilisation = w->totalNs > 0 ? (double)w->busyNs/w->totalNs : 0.0;
+   res.runs = w->runs;
+   res.steals = w->steals;
+   return res;
+}
+
+static Coroutine* coroutine(int id)
+{
+   return (Coroutine*)(slots+(size_t)(id+1)*COROUTINE_STACK_SIZE-SLOT_HEADER);
+}
+
+/* right below the lowest stack address */
+static long* canary(int id)
+{
+   return (long*)(slots+(size_t)id*COROUTINE_STACK_SIZE);
+}
+
+/* (the stack never writes its canary unless overflown) */
+static int stack_overflown(int id)
+{
+   long* words = canary(id);
+   for(int i = 0; i < CANARY_WORDS; i++)
+      if (words[i] != 0)
+         return 1;
+   return 0;
+}
+
+static void init_queue(RunQueue* queue)
+{
+   mutex_init(&queue->mutex, NULL);
+   queue->first = queue->last = -1;
+   queue->runNext = -1;
+}
+
+static void push_last(RunQueue* queue, int id)
+{
+   mutex_lock(&queue->mutex);
+   Coroutine* c = coroutine(id);
+   c->prev = queue->last;
+   c->next = -1;
+   if (queue->last == -1)
+      queue->first = id;
+   else
+      coroutine(queue->last)->next = id;
+   queue->last = id;
+   mutex_unlock(&queue->mutex);
+}
+
+/* owner side: run next coroutine, else the newest one (-1 if empty) */
+static int take_last(RunQueue* queue)
+{
+   mutex_lock(&queue->mutex);
+   int res = queue->runNext;
+   if (res != -1)
+      queue->runNext = -1;
+   else if (queue->last != -1)
+   {
+      res = queue->last;
+      queue->last = coroutine(res)->prev;
+      if (queue->last == -1)
+         queue->first = -1;
+      else
+         coroutine(queue->last)->next = -1;
+   }
+   mutex_unlock(&queue->mutex);
+   return res;
+}
+
+/* thief side: oldest coroutine, else the run next one (-1 if empty) */
+static int take_first(RunQueue* queue)
+{
+   mutex_lock(&queue->mutex);
+   int res = queue->first;
+   if (res != -1)
+   {
+      queue->first = coroutine(res)->next;
+      if (queue->first == -1)
+         queue->last = -1;
+      else
+         coroutine(queue->first)->prev = -1;
+   }
+   else if (queue->runNext != -1)
+   {
+      res = queue->runNext;
+      queue->runNext = -1;
+   }
+   mutex_unlock(&queue->mutex);
+   return res;
+}
+
+/*
+ * Queue a runnable coroutine in the calling worker (injected queue outside workers).
+ * A lifo wakeup takes the run next place (the coroutine it displaces goes to the
+ * queue), so that a woken coroutine runs right after its waker, while the data
+ * they share is still in cache.
+ */
+static void make_runnable(int id, int lifo)
+{
+   int w = current_worker();
+   if (w == -1)
+      push_last(&injected, id);
+   else
+   {
+      RunQueue* queue = &workers[w].queue;
+      if (lifo)
+      {
+         mutex_lock(&queue->mutex);
+         int displaced = queue->runNext;
+         queue->runNext = id;
+         mutex_unlock(&queue->mutex);
+         id = displaced;
+      }
+      if (id != -1)
+         push_last(queue, id);
+   }
+   // (sequentially consistent with the idle check in worker, so no wakeup is lost)
+   __atomic_add_fetch(&numQueued, 1, __ATOMIC_SEQ_CST);
+   if (__atomic_load_n(&numIdle, __ATOMIC_SEQ_CST) > 0)
+   {
+      mutex_lock(&idleMutex);
+      cond_signal(&idleCond);
+      mutex_unlock(&idleMutex);
+   }
+}
+
+/* own queue, then the injected one, then steal from the others (-1 if no work) */
+static int find_runnable(int w)
+{
+   int res = take_last(&workers[w].queue);
+   if (res == -1)
+      res = take_first(&injected);
+   for(int i = 1; res == -1 && i < numWorkers; i++)
+   {
+      res = take_first(&workers[(w+i)%numWorkers].queue);
+      if (res != -1)
+         workers[w].steals++;
+   }
+   if (res != -1)
+      __atomic_sub_fetch(&numQueued, 1, __ATOMIC_SEQ_CST);
+   return res;
+}
+
+static void* worker(void* arg)
+{
+   int w = (int)(long)arg;
+   if (workerEnter != NULL)
+      workerEnter(w);
+   work(w, NULL);
+   if (workerLeave != NULL)
+      workerLeave(w);
+   return NULL;
+}
+
+/* worker w loop, until all coroutines finish (idle, if any, waits for work instead of the other workers) */
+static void work(int w, void (*idle)())
+{
+   ucontext_t context;
+   workerIndex = w;
+   workerContext = &context;
+   long start = now_ns();
+   for(;;)
+   {
+      int id = find_runnable(w);
+      if (id == -1 && idle != NULL)
+      {
+         if (numFinished == numCoroutines)
+            break;
+         idle();
+         continue;
+      }
+      if (id == -1)
+      {
+         mutex_lock(&idleMutex);
+         __atomic_add_fetch(&numIdle, 1, __ATOMIC_SEQ_CST);
+         while(__atomic_load_n(&numQueued, __ATOMIC_SEQ_CST) <= 0 && numFinished < numCoroutines)
+            cond_wait(&idleCond, &idleMutex);
+         __atomic_sub_fetch(&numIdle, 1, __ATOMIC_SEQ_CST);
+         int done = numFinished == numCoroutines;
+         mutex_unlock(&idleMutex);
+         if (done)
+            break;
+         continue;
+      }
+      Coroutine* c = coroutine(id);
+      long t0 = now_ns();
+      running = id;
+      swapcontext(&context, &c->context);
+      running = -1;
+      if (stack_overflown(id))
+      {
+         fprintf(stderr, "ERROR: stack overflow in coroutine %d\n", id);
+         exit(EXIT_FAILURE);
+      }
+      workers[w].busyNs += now_ns()-t0;
+      workers[w].runs++;
+      if (c->finished)
+      {
+         mutex_lock(&finishedMutex);
+         cond_broadcast(&finishedCond);
+         mutex_unlock(&finishedMutex);
+         mutex_lock(&idleMutex);
+         numFinished++;
+         if (numFinished == numCoroutines)
+            cond_broadcast(&idleCond);
+         mutex_unlock(&idleMutex);
+      }
+      // suspended: parks only if not already resumed meanwhile
+      // (decided here, once its context is saved, so no other worker runs it too soon)
+      else if (__atomic_fetch_sub(&c->wakeups, 1, __ATOMIC_ACQ_REL) > 0)
+         make_runnable(id, 1);
+   }
+   workers[w].totalNs = now_ns()-start;
+   workerIndex = -1;
+   workerContext = NULL;
+}
+
+static void trampoline(int id)
+{
+   Coroutine* c = coroutine(id);
+   c->func(c->arg);
+   mutex_lock(&finishedMutex);
+   c->finished = 1;
+   mutex_unlock(&finishedMutex);
+   setcontext(worker_context());
+}
+
+__attribute__((noinline)) static ucontext_t* worker_context()
+{
+   return workerContext;
+}
+
+__attribute__((noinline)) static int current_worker()
+{
+   return workerIndex;
+}
+
+static long now_ns()
+{
+   struct timespec t;
+   clock_gettime(CLOCK_MONOTONIC, &t);
+   return t.tv_sec*1000000000L + t.tv_nsec;
+}
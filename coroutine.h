@@ -0,0 +1,47 @@
+/**
+ * \brief coroutines run by a pool of worker threads
+ *
+ * Each coroutine has its own stack (committed by the kernel only as it is
+ * touched, and ending in a canary: an overflow is reported as an error
+ * when the coroutine next suspends), so straight-line blocking code runs
+ * unchanged: blocking is a suspension that gives the worker back to the
+ * scheduler, and the coroutine is later resumed by whichever worker picks
+ * it up.
+ * Coroutines are identified by an index in [0, num_coroutines[.
+ *
+ * Each worker has its own run queue: it runs the newest coroutine first
+ * (a woken coroutine right after its waker), and when out of work it steals
+ * the oldest one from another worker.
+ */
+
+#ifndef COROUTINE_H
+#define COROUTINE_H
+
+#define COROUTINE_STACK_SIZE (64*1024)
+
+typedef struct _WorkerStats_
+{
+   double utilisation;  // fraction of its lifetime running coroutines
+   long runs;           // coroutine runs (until each suspension)
+   long steals;         // coroutines taken from other workers
+} WorkerStats;
+
+void init_coroutines(int num_coroutines, int num_workers);
+void term_coroutines();
+
+void create_coroutine(int id, void* (*func)(void*), void* arg);
+void on_coroutine_workers(void (*enter)(int worker), void (*leave)(int worker)); // (before start) run in each worker thread
+void start_coroutines();          // launch the worker threads
+void run_coroutines(void (*idle)()); // or run the single worker in the calling thread, until all terminate
+                                     // (idle is called when no coroutine is runnable, to wait for resumes)
+void join_coroutine(int id);      // (outside coroutines) wait for its termination
+void stop_coroutines();           // wait for the workers (all coroutines must terminate)
+
+int current_coroutine();          // -1 if not running in a coroutine
+void suspend_coroutine();         // until resumed (a previous resume is consumed at once)
+void resume_coroutine(int id);
+
+int num_coroutine_workers();
+WorkerStats coroutine_worker_stats(int worker); // (once stopped)
+
+#endif
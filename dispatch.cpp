@@ -0,0 +1,94 @@
+#include <string.h>
+#include "dbc.h"
+#include "global.h"
+#include "utils.h"
+#include "timer.h"
+#include "dispatch.h"
+
+#define EXPRESS_BARBER 1
+
+static double fifo_score(WaitingClient* client, int barberID);
+static double sjf_score(WaitingClient* client, int barberID);
+static double aging_score(WaitingClient* client, int barberID);
+static double express_score(WaitingClient* client, int barberID);
+
+static const struct
+{
+   const char* name;
+   int queued;
+   int timed;
+   double (*score)(WaitingClient* client, int barberID);
+} policies[] =
+{
+   {"fifo",    1, 0, fifo_score},
+   {"sjf",     0, 0, sjf_score},
+   {"aging",   0, 1, aging_score},
+   {"express", 0, 0, express_score},
+};
+#define NUM_POLICIES ((int)(sizeof(policies)/sizeof(policies[0])))
+
+int dispatch_policy(const char* name)
+{
+   require (name != NULL, "name argument required");
+
+   for(int i = 0; i < NUM_POLICIES; i++)
+      if (strcmp(name, policies[i].name) == 0)
+         return i;
+   return -1;
+}
+
+const char* dispatch_policy_name(int policy)
+{
+   require (policy >= 0 && policy < NUM_POLICIES, concat_3str("invalid dispatch policy (", int2str(policy), ")"));
+
+   return policies[policy].name;
+}
+
+int dispatch_queued(int policy)
+{
+   require (policy >= 0 && policy < NUM_POLICIES, concat_3str("invalid dispatch policy (", int2str(policy), ")"));
+
+   return policies[policy].queued;
+}
+
+int dispatch_timed(int policy)
+{
+   require (policy >= 0 && policy < NUM_POLICIES, concat_3str("invalid dispatch policy (", int2str(policy), ")"));
+
+   return policies[policy].timed;
+}
+
+double dispatch_score(int policy, WaitingClient* client, int barberID)
+{
+   require (policy >= 0 && policy < NUM_POLICIES, concat_3str("invalid dispatch policy (", int2str(policy), ")"));
+   require (client != NULL, "client argument required");
+   require (client->request > 0 && client->request < 8, concat_3str("invalid request (", int2str(client->request), ")"));
+
+   return policies[policy].score(client, barberID);
+}
+
+static double fifo_score(WaitingClient* client, int barberID)
+{
+   return client->order;
+}
+
+static double sjf_score(WaitingClient* client, int barberID)
+{
+   return __builtin_popcount(client->request);
+}
+
+static double aging_score(WaitingClient* client, int barberID)
+{
+   double service = __builtin_popcount(client->request) *
+                    (global->MIN_WORK_TIME_UNITS+global->MAX_WORK_TIME_UNITS)/2.0 * time_unit(); // expected (ms)
+   if (service <= 0)
+      service = 1;
+   return -(client->waited+service)/service;
+}
+
+static double express_score(WaitingClient* client, int barberID)
+{
+   if (barberID == EXPRESS_BARBER && __builtin_popcount(client->request) == 1)
+      return 0;
+   return 1; // (then by arrival order)
+}
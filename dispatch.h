@@ -0,0 +1,39 @@
+/**
+ *  \brief Dispatch policies: the seated client an idle barber takes next.
+ *
+ * FIFO takes the oldest client from the lock-free benches queue.  Every
+ * other policy scores each client waiting in the benches (the lowest score
+ * is served first, ties broken by arrival order):
+ *   - sjf: fewest requested services first (each service takes the same
+ *     random work time units, so this is the shortest job);
+ *   - aging: highest response ratio first, (waited + service time) /
+ *     service time, so short requests still go first but a long one
+ *     gains priority while it waits, and is never starved;
+ *   - express: barber 1 is an express lane, taking single service clients
+ *     before the others; the other barbers take the oldest client.
+ */
+
+#ifndef DISPATCH_H
+#define DISPATCH_H
+
+#define DISPATCH_FIFO    0  // (default)
+#define DISPATCH_SJF     1
+#define DISPATCH_AGING   2
+#define DISPATCH_EXPRESS 3
+
+/* a client waiting in the benches, as seen by the policies */
+typedef struct _WaitingClient_
+{
+   int clientID;
+   int request;
+   int order;       // arrival order
+   long waited;     // ms seated (only measured for timed policies)
+} WaitingClient;
+
+int dispatch_policy(const char* name); // -1 if invalid
+const char* dispatch_policy_name(int policy);
+int dispatch_queued(int policy);       // served from the benches queue (no scores)
+int dispatch_timed(int policy);        // scores depend on the time waited
+double dispatch_score(int policy, WaitingClient* client, int barberID); // lowest served first
+
+#endif
@@ -6,3 +6,42 @@
 
 Parameters* global = NULL;
 
+const char* const glyph[NUM_GLYPHS] = {
+   SCISSOR_TEXT,
+   COMB_TEXT,
+   RAZOR_TEXT,
+   COMPLETE_TEXT,
+   INCOMPLETE_TEXT,
+   SPLASH_TEXT,
+   BOX_HORIZONTAL_TEXT,
+   BOX_HORIZONTAL_DOWN_TEXT,
+   BOX_VERTICAL_TEXT,
+};
+
+
+#define STORAGE_ALIGNMENT CACHE_LINE_SIZE
+
+size_t storage_size(size_t size)
+{
+   return (size + STORAGE_ALIGNMENT-1) / STORAGE_ALIGNMENT * STORAGE_ALIGNMENT;
+}
+
+void init_storage(Storage* storage, void* mem, size_t size)
+{
+   require (storage != NULL, "storage argument required");
+   require (mem != NULL, "memory argument required");
+   require ((size_t)mem % STORAGE_ALIGNMENT == 0, "misaligned memory");
+
+   storage->next = (char*)mem;
+   storage->end = (char*)mem + size;
+}
+
+void* storage_alloc(Storage* storage, size_t size)
+{
+   require (storage != NULL, "storage argument required");
+   require (storage->next + storage_size(size) <= storage->end, "storage exhausted");
+
+   void* res = storage->next;
+   storage->next += storage_size(size);
+   return res;
+}
@@ -39,6 +39,7 @@ typedef struct _Parameters_
    //   - each client goes [MIN_BARBER_SHOP_TRIPS;MAX_BARBER_SHOP_TRIPS] random times to barber shop
    //   - random time spending outside barber shop [MIN_OUTSIDE_TIME_UNITS;MAX_OUTSIDE_TIME_UNITS
    //   - PROB_REQUEST_* determines the probability to choose the specific service
+   //   - MAX_BENCHES_WAIT_TIME_UNITS a client waits for a benches seat before giving up (-1: no limit)
    int NUM_CLIENTS;
    int MIN_BARBER_SHOP_TRIPS;
    int MAX_BARBER_SHOP_TRIPS;
@@ -47,12 +48,17 @@ typedef struct _Parameters_
    int PROB_REQUEST_HAIRCUT;
    int PROB_REQUEST_WASHHAIR;
    int PROB_REQUEST_SHAVE;
-} Parameters;
+   int MAX_BENCHES_WAIT_TIME_UNITS;
+
+   // simulation run:
+   int HEADLESS; // no prompt and no rendering (JSON summary at exit)
 
- 
-#define SHM_SHOP_KEY 0x1111
-#define SHM_BARBERS_KEY 0x4444
-#define SHM_CLIENTS_KEY 0x7777
+   // barbers:
+   //   - DISPATCH_POLICY chooses the next client taken from the benches (dispatch.h)
+   //   - BATCH_CHAIR_SERVICES serves shave and haircut together, in the same chair
+   int DISPATCH_POLICY;
+   int BATCH_CHAIR_SERVICES;
+} Parameters;
 
 // requests mask
 #define HAIRCUT_REQ    1 // H 
@@ -61,7 +67,7 @@ typedef struct _Parameters_
 
 extern Parameters* global; // global variable with simulation parameters
 
-// simulation limits:
+// rendering limits (headless runs are only limited by the available memory):
 #define MAX_BARBERS 20 // is also max. barber bench seats
 #define MAX_BARBER_CHAIRS 10 // position with only one digit!
 #define MAX_NUM_TOOLS 99 // max. scissors, combs and razors
@@ -69,30 +75,81 @@ extern Parameters* global; // global variable with simulation parameters
 #define MAX_CLIENT_BENCHES_SEATS 20  // also limits number of client benches
 #define MAX_CLIENTS 99
 
+#define CACHE_LINE_SIZE 64
+#define CACHE_ALIGNED __attribute__((aligned(CACHE_LINE_SIZE))) // starts (and pads) its own cache line
+
+/*
+ * Contiguous storage for the runtime sized state of the simulation (in the
+ * process engine, a single shared memory segment).  Each module reports the
+ * size of its arrays (sizeof_*_arrays) and takes them from the storage on init.
+ * Allocations start at cache line boundaries (the memory must be so aligned).
+ */
+typedef struct _Storage_
+{
+   char* next;
+   char* end;
+} Storage;
+
+size_t storage_size(size_t size); // size rounded up to the storage alignment
+void init_storage(Storage* storage, void* mem, size_t size);
+void* storage_alloc(Storage* storage, size_t size);
+
+/*
+ * Glyphs of the rendered shop, interned at compile time: each is a constant
+ * UTF8 string (ASCII in ASCII_MODE), so rendering neither allocates nor
+ * looks up character names.
+ */
+enum
+{
+   SCISSOR_GLYPH,
+   COMB_GLYPH,
+   RAZOR_GLYPH,
+   COMPLETE_GLYPH,
+   INCOMPLETE_GLYPH,
+   SPLASH_GLYPH,
+   BOX_HORIZONTAL_GLYPH,
+   BOX_HORIZONTAL_DOWN_GLYPH,
+   BOX_VERTICAL_GLYPH,
+   NUM_GLYPHS
+};
+
+extern const char* const glyph[NUM_GLYPHS];
+
 #ifdef ASCII_MODE
 
-#define SCISSOR              (char*)"Sc"
-#define COMB                 (char*)"Cb"
-#define RAZOR                (char*)"Rz"
-#define COMPLETE             (char*)"o"
-#define INCOMPLETE           (char*)" "
-#define SPLASH               (char*)"wash!"
-#define BOX_HORIZONTAL       (char*)"-"
-#define BOX_HORIZONTAL_DOWN  (char*)"+"
-#define BOX_VERTICAL         (char*)"|"
+#define SCISSOR_TEXT              "Sc"
+#define COMB_TEXT                 "Cb"
+#define RAZOR_TEXT                "Rz"
+#define COMPLETE_TEXT             "o"
+#define INCOMPLETE_TEXT           " "
+#define SPLASH_TEXT               "wash!"
+#define BOX_HORIZONTAL_TEXT       "-"
+#define BOX_HORIZONTAL_DOWN_TEXT  "+"
+#define BOX_VERTICAL_TEXT         "|"
 
 #else
 
-#define SCISSOR              string_concat(NULL, 0, code2utf8(NULL, 0x2702), (char*)" ", NULL)
-#define COMB                 string_concat(NULL, 0, code2utf8(NULL, get_code_utf8((char*)"LEFT-SQUARE-BRACKET-WITH-QUILL")), (char*)" ", NULL)
-#define RAZOR                string_concat(NULL, 0, code2utf8(NULL, get_code_utf8((char*)"DAGGER-KNIFE")), (char*)" ", NULL)
-#define COMPLETE             code2utf8(NULL, get_code_utf8((char*)"MEDIUM-BLACK-CIRCLE"))
-#define INCOMPLETE           code2utf8(NULL, get_code_utf8((char*)"MEDIUM-WHITE-CIRCLE"))
-#define SPLASH               string_concat(NULL, 0, code2utf8(NULL, get_code_utf8((char*)"SPLASHING")), (char*)" ", code2utf8(NULL, get_code_utf8((char*)"SPLASHING")),NULL)
-#define BOX_HORIZONTAL       code2utf8(NULL, get_code_utf8((char*)"BOX-HORIZONTAL"))
-#define BOX_HORIZONTAL_DOWN  code2utf8(NULL, get_code_utf8((char*)"BOX-HORIZONTAL-DOWN"))
-#define BOX_VERTICAL         code2utf8(NULL, get_code_utf8((char*)"BOX-VERTICAL"))
+#define SCISSOR_TEXT              "\u2702 "            // BLACK-SCISSORS
+#define COMB_TEXT                 "\u2045 "            // LEFT-SQUARE-BRACKET-WITH-QUILL
+#define RAZOR_TEXT                "\U0001F5E1 "        // DAGGER-KNIFE
+#define COMPLETE_TEXT             "\u26AB"             // MEDIUM-BLACK-CIRCLE
+#define INCOMPLETE_TEXT           "\u26AA"             // MEDIUM-WHITE-CIRCLE
+#define SPLASH_TEXT               "\U0001F4A6 \U0001F4A6" // SPLASHING
+#define BOX_HORIZONTAL_TEXT       "\u2500"
+#define BOX_HORIZONTAL_DOWN_TEXT  "\u252C"
+#define BOX_VERTICAL_TEXT         "\u2502"
 
 #endif
 
+// (string literals above, for compile time concatenation; below, as the logger and gen_boxes take them)
+#define SCISSOR              (char*)glyph[SCISSOR_GLYPH]
+#define COMB                 (char*)glyph[COMB_GLYPH]
+#define RAZOR                (char*)glyph[RAZOR_GLYPH]
+#define COMPLETE             (char*)glyph[COMPLETE_GLYPH]
+#define INCOMPLETE           (char*)glyph[INCOMPLETE_GLYPH]
+#define SPLASH               (char*)glyph[SPLASH_GLYPH]
+#define BOX_HORIZONTAL       (char*)glyph[BOX_HORIZONTAL_GLYPH]
+#define BOX_HORIZONTAL_DOWN  (char*)glyph[BOX_HORIZONTAL_DOWN_GLYPH]
+#define BOX_VERTICAL         (char*)glyph[BOX_VERTICAL_GLYPH]
+
 #endif
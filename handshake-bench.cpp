@@ -0,0 +1,271 @@
+/**
+ *  \brief Ping-pong benchmark of the barber/client services handshake
+ *
+ * A barber process and a client process (real time, shared memory) go
+ * through the handshake of each service as in the barber shop: the barber
+ * publishes the service, the client tells it is seated, the barber tells
+ * it is done and, after the last service of each client, the client
+ * releases the barber.  The handshake runs over a service channel (one
+ * futex word), or over the four semaphores it replaced, and the
+ * throughput of both is reported.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <getopt.h>
+#include <string.h>
+#include <time.h>
+#include <sys/wait.h>
+#include "dbc.h"
+#include "global.h"
+#include "utils.h"
+#include "process.h"
+#include "sim-clock.h"
+#include "service.h"
+
+#define CHANNEL 0
+#define SEMAPHORES 1
+
+typedef struct _Bench_
+{
+   ServiceChannel channel;
+   // semaphores mode:
+   Service service;
+   ClockSem assigned;
+   ClockSem started;
+   ClockSem done;
+   ClockSem released;
+   long errors;        // services received other than published
+} Bench;
+
+static int numClients = 100000;
+static int servicesPerClient = 2;
+static int modes[2] = {1, 1};
+
+static SimClock* benchClock;
+static Bench* bench;
+
+static void help(char* prog);
+static void processArgs(int argc, char* argv[]);
+static double run(int mode);
+static void barber(int mode);
+static void client(int mode);
+
+int main(int argc, char* argv[])
+{
+   processArgs(argc, argv);
+
+   printf("mode,clients,services,seconds,services_per_s,ns_per_service,errors\n");
+   for(int mode = CHANNEL; mode <= SEMAPHORES; mode++)
+      if (modes[mode])
+      {
+         long services = (long)numClients*servicesPerClient;
+         double secs = run(mode);
+         printf("%s,%d,%ld,%.3f,%.0f,%.0f,%ld\n", mode == CHANNEL ? "channel" : "semaphores",
+                numClients, services, secs, services/secs, secs*1e9/services, bench->errors);
+      }
+   return 0;
+}
+
+/* one benchmark run (seconds until both processes end) */
+static double run(int mode)
+{
+   size_t size = storage_size(sizeof(SimClock)) + sizeof_sim_clock_arrays(2, 0) + storage_size(sizeof(Bench));
+   int shmid = pshmget(IPC_PRIVATE, size, 0600|IPC_CREAT);
+   void* mem = pshmat(shmid, NULL, 0);
+   Storage storage;
+   init_storage(&storage, mem, size);
+   benchClock = (SimClock*)storage_alloc(&storage, sizeof(SimClock));
+   init_sim_clock(benchClock, 2, 0, 0, 1, &storage);
+   bench = (Bench*)storage_alloc(&storage, sizeof(Bench));
+   init_service_channel(&bench->channel);
+   clock_sem_init(&bench->assigned, 0);
+   clock_sem_init(&bench->started, 0);
+   clock_sem_init(&bench->done, 0);
+   clock_sem_init(&bench->released, 0);
+   bench->errors = 0;
+
+   fflush(stdout); // (otherwise also flushed by each child)
+   struct timespec t0, t1;
+   clock_gettime(CLOCK_MONOTONIC, &t0);
+   pid_t pids[2];
+   for(int i = 0; i < 2; i++)
+   {
+      pids[i] = pfork();
+      if (pids[i] == 0)
+      {
+         if (i == 0)
+            barber(mode);
+         else
+            client(mode);
+         exit(EXIT_SUCCESS);
+      }
+   }
+   int status;
+   for(int i = 0; i < 2; i++)
+      pwaitpid(pids[i], &status, 0);
+   clock_gettime(CLOCK_MONOTONIC, &t1);
+
+   clock_sem_destroy(&bench->assigned);
+   clock_sem_destroy(&bench->started);
+   clock_sem_destroy(&bench->done);
+   clock_sem_destroy(&bench->released);
+   term_sim_clock(benchClock);
+   shmctl(shmid, IPC_RMID, NULL);
+   return (t1.tv_sec-t0.tv_sec) + (t1.tv_nsec-t0.tv_nsec)/1000000000.0;
+}
+
+static void barber(int mode)
+{
+   for(int c = 1; c <= numClients; c++)
+   {
+      for(int i = 0; i < servicesPerClient; i++)
+      {
+         Service s;
+         set_barber_chair_service(&s, 1, c, i, HAIRCUT_REQ);
+         if (mode == CHANNEL)
+         {
+            bench->channel.service = s;
+            post_service_step(&bench->channel, SERVICE_ASSIGNED);
+            wait_service_step(&bench->channel, SERVICE_STARTED);
+            post_service_step(&bench->channel, SERVICE_DONE);
+         }
+         else
+         {
+            bench->service = s;
+            clock_sem_post(&bench->assigned);
+            clock_sem_wait(&bench->started);
+            clock_sem_post(&bench->done);
+         }
+      }
+      if (mode == CHANNEL)
+         wait_service_step(&bench->channel, SERVICE_RELEASED);
+      else
+         clock_sem_wait(&bench->released);
+   }
+}
+
+static void client(int mode)
+{
+   for(int c = 1; c <= numClients; c++)
+   {
+      for(int i = 0; i < servicesPerClient; i++)
+      {
+         Service s;
+         if (mode == CHANNEL)
+         {
+            wait_service_step(&bench->channel, SERVICE_ASSIGNED);
+            s = bench->channel.service;
+            post_service_step(&bench->channel, SERVICE_STARTED);
+            wait_service_step_past(&bench->channel, SERVICE_STARTED);
+         }
+         else
+         {
+            clock_sem_wait(&bench->assigned);
+            s = bench->service;
+            clock_sem_post(&bench->started);
+            clock_sem_wait(&bench->done);
+         }
+         if (s.clientID != c || s.pos != i)
+            bench->errors++;
+      }
+      if (mode == CHANNEL)
+         post_service_step(&bench->channel, SERVICE_RELEASED);
+      else
+         clock_sem_post(&bench->released);
+   }
+}
+
+/*********************************************************************/
+
+static void help(char* prog)
+{
+   require (prog != NULL, "program name argument required");
+
+   printf("\n");
+   printf("Usage: %s [OPTION] ...\n", prog);
+   printf("\n");
+   printf("Services handshake ping-pong benchmark: one barber and one client process\n");
+   printf("go through the handshake of each service; writes one CSV line per mode.\n");
+   printf("\n");
+   printf("Options:\n");
+   printf("\n");
+   printf("  -h,--help                                   show this help\n");
+   printf("  -n,--num-clients <N>\n");
+   printf("     number of clients served (default is %d)\n", numClients);
+   printf("  -s,--services <N>\n");
+   printf("     services per client (default is %d)\n", servicesPerClient);
+   printf("  -m,--mode <channel|semaphores>\n");
+   printf("     run a single mode (default is both)\n");
+   printf("\n");
+}
+
+static void processArgs(int argc, char* argv[])
+{
+   require (argc >= 0 && argv != NULL && argv[0] != NULL, "invalid main arguments");
+
+   static struct option long_options[] =
+   {
+      {"help",                         no_argument,       NULL, 'h'},
+      {"num-clients",                  required_argument, NULL, 'n'},
+      {"services",                     required_argument, NULL, 's'},
+      {"mode",                         required_argument, NULL, 'm'},
+      {0, 0, NULL, 0}
+   };
+   int op=0;
+
+   while (op != -1)
+   {
+      int option_index = 0;
+
+      op = getopt_long(argc, argv, "hn:s:m:", long_options, &option_index);
+      int st,n;
+      switch (op)
+      {
+         case -1:
+            break;
+
+         case 'h':
+            help(argv[0]);
+            exit(EXIT_SUCCESS);
+
+         case 'n':
+         case 's':
+            st = sscanf(optarg, "%d", &n);
+            if (st != 1 || n < 1)
+            {
+               fprintf(stderr, "ERROR: invalid value \"%s\" for -%c\n", optarg, (char)op);
+               exit(EXIT_FAILURE);
+            }
+            if (op == 'n')
+               numClients = n;
+            else
+               servicesPerClient = n;
+            break;
+
+         case 'm':
+            if (strcmp(optarg, "channel") == 0)
+               modes[SEMAPHORES] = 0;
+            else if (strcmp(optarg, "semaphores") == 0)
+               modes[CHANNEL] = 0;
+            else
+            {
+               fprintf(stderr, "ERROR: invalid mode \"%s\"\n", optarg);
+               exit(EXIT_FAILURE);
+            }
+            break;
+
+         default:
+            help(argv[0]);
+            exit(EXIT_FAILURE);
+            break;
+      }
+   }
+
+   if (optind < argc)
+   {
+      fprintf(stderr, "ERROR: invalid extra arguments\n");
+      exit(EXIT_FAILURE);
+   }
+}
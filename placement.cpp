@@ -0,0 +1,376 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sched.h>
+#include <dirent.h>
+#include <sys/resource.h>
+#include <sys/syscall.h>
+#include <linux/perf_event.h>
+#include <linux/mempolicy.h>
+#include "dbc.h"
+#include "utils.h"
+#include "placement.h"
+
+#define MAX_NODES ((int)(8*sizeof(unsigned long))) // (a single word node mask)
+
+typedef struct _CPUInfo_
+{
+   int cpu;
+   int node;
+   int package;
+   int core;
+   int coreRank;     // position of its core within its node
+   int siblingRank;  // position within its core
+} CPUInfo;
+
+static const char* names[] = {"none", "compact", "scatter", "barbers-isolated"};
+#define NUM_POLICIES ((int)(sizeof(names)/sizeof(names[0])))
+
+static Placement* placement = NULL;
+static unsigned long unitNodes = 0;     // nodes of the pinned units
+static int memoryNode = -1;             // node preferred for the shared state (-1 if none)
+
+static __thread int migrationsCounter = -1;
+static __thread struct rusage enterUsage;
+
+static void assign_cpus();
+static void read_topology(CPUInfo* info, int cpu);
+static int read_int(const char* path, int def);
+static int num_system_nodes();
+static int compact_order(const void* a, const void* b);
+static int scatter_order(const void* a, const void* b);
+static void summarise(FILE* out, const char* kind, int first, int num);
+static void json_units(FILE* out, int first, int num);
+
+int placement_policy(const char* name)
+{
+   require (name != NULL, "name argument required");
+
+   for(int i = 0; i < NUM_POLICIES; i++)
+      if (strcmp(name, names[i]) == 0)
+         return i;
+   return -1;
+}
+
+const char* placement_name(int policy)
+{
+   require (policy >= 0 && policy < NUM_POLICIES, concat_3str("invalid placement policy (", int2str(policy), ")"));
+
+   return names[policy];
+}
+
+size_t sizeof_placement_arrays(int num_barber_units, int num_client_units)
+{
+   require (num_barber_units >= 0 && num_client_units >= 0 && num_barber_units+num_client_units > 0, "invalid number of units");
+
+   return storage_size((num_barber_units+num_client_units)*sizeof(UnitCounters));
+}
+
+void init_placement(Placement* p, int policy, int num_barber_units, int num_client_units, Storage* storage)
+{
+   require (p != NULL, "placement argument required");
+   require (policy >= 0 && policy < NUM_POLICIES, concat_3str("invalid placement policy (", int2str(policy), ")"));
+   require (num_barber_units >= 0 && num_client_units >= 0 && num_barber_units+num_client_units > 0, "invalid number of units");
+   require (storage != NULL, "storage argument required");
+
+   p->policy = policy;
+   p->numBarberUnits = num_barber_units;
+   p->numClientUnits = num_client_units;
+   p->unit = (UnitCounters*)storage_alloc(storage, (num_barber_units+num_client_units)*sizeof(UnitCounters));
+   for(int i = 0; i < num_barber_units+num_client_units; i++)
+   {
+      p->unit[i].cpu = -1;
+      p->unit[i].migrations = -1;
+      p->unit[i].voluntarySwitches = 0;
+      p->unit[i].involuntarySwitches = 0;
+   }
+   placement = p;
+
+   if (policy != PLACEMENT_NONE)
+      assign_cpus();
+}
+
+void place_memory(void* mem, size_t size)
+{
+   require (placement != NULL, "placement not initialized");
+   require (mem != NULL && (size_t)mem % sysconf(_SC_PAGESIZE) == 0, "page aligned memory required");
+
+   if (placement->policy == PLACEMENT_NONE || num_system_nodes() <= 1)
+      return;
+
+   unsigned long mask;
+   int mode;
+   if (placement->policy == PLACEMENT_SCATTER && __builtin_popcountl(unitNodes) > 1)
+   {
+      mode = MPOL_INTERLEAVE;
+      mask = unitNodes;
+   }
+   else
+   {
+      mode = MPOL_PREFERRED;
+      mask = 1UL << memoryNode;
+   }
+   // (pages touched so far are only mapped by the calling process, so they can be moved)
+   if (syscall(SYS_mbind, mem, size, mode, &mask, (unsigned long)MAX_NODES+1, MPOL_MF_MOVE) != 0)
+      perror("WARNING: shared state not placed on its NUMA node (mbind)");
+}
+
+void enter_placement(int unit)
+{
+   require (placement != NULL, "placement not initialized");
+   require (unit >= 0 && unit < placement->numBarberUnits+placement->numClientUnits, concat_3str("invalid unit (", int2str(unit), ")"));
+
+   UnitCounters* u = placement->unit+unit;
+   if (u->cpu != -1)
+   {
+      cpu_set_t set;
+      CPU_ZERO(&set);
+      CPU_SET(u->cpu, &set);
+      check (sched_setaffinity(0, sizeof(set), &set) == 0, concat_3str("unable to pin to CPU ", int2str(u->cpu), ""));
+   }
+
+   // counted from the pinning on (the calling thread only)
+   struct perf_event_attr attr;
+   memset(&attr, 0, sizeof(attr));
+   attr.size = sizeof(attr);
+   attr.type = PERF_TYPE_SOFTWARE;
+   attr.config = PERF_COUNT_SW_CPU_MIGRATIONS;
+   migrationsCounter = (int)syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0);
+   getrusage(RUSAGE_THREAD, &enterUsage);
+}
+
+void leave_placement(int unit)
+{
+   require (placement != NULL, "placement not initialized");
+   require (unit >= 0 && unit < placement->numBarberUnits+placement->numClientUnits, concat_3str("invalid unit (", int2str(unit), ")"));
+
+   UnitCounters* u = placement->unit+unit;
+   struct rusage usage;
+   getrusage(RUSAGE_THREAD, &usage);
+   u->voluntarySwitches = usage.ru_nvcsw - enterUsage.ru_nvcsw;
+   u->involuntarySwitches = usage.ru_nivcsw - enterUsage.ru_nivcsw;
+   if (migrationsCounter != -1)
+   {
+      unsigned long long value;
+      if (read(migrationsCounter, &value, sizeof(value)) == (ssize_t)sizeof(value))
+         u->migrations = (long)value;
+      close(migrationsCounter);
+      migrationsCounter = -1;
+   }
+}
+
+void report_placement(FILE* out)
+{
+   require (placement != NULL, "placement not initialized");
+   require (out != NULL, "output file argument required");
+
+   fprintf(out, "  placement: %s\n", placement_name(placement->policy));
+   summarise(out, "barber units", 0, placement->numBarberUnits);
+   summarise(out, "client units", placement->numBarberUnits, placement->numClientUnits);
+}
+
+void json_placement(FILE* out)
+{
+   require (placement != NULL, "placement not initialized");
+   require (out != NULL, "output file argument required");
+
+   fprintf(out, "{\n");
+   fprintf(out, "    \"policy\": \"%s\",\n", placement_name(placement->policy));
+   fprintf(out, "    \"barber_units\": ");
+   json_units(out, 0, placement->numBarberUnits);
+   fprintf(out, ",\n    \"client_units\": ");
+   json_units(out, placement->numBarberUnits, placement->numClientUnits);
+   fprintf(out, "\n  }");
+}
+
+/* cpu of each unit, from the CPUs the simulation may run on */
+static void assign_cpus()
+{
+   cpu_set_t set;
+   CPU_ZERO(&set);
+   check (sched_getaffinity(0, sizeof(set), &set) == 0, "unable to get the CPUs available");
+   int n = CPU_COUNT(&set);
+   CPUInfo* cpus = (CPUInfo*)mem_alloc(n*sizeof(CPUInfo));
+   for(int c = 0, i = 0; i < n; c++)
+      if (CPU_ISSET(c, &set))
+         read_topology(cpus+(i++), c);
+
+   qsort(cpus, n, sizeof(CPUInfo), compact_order);
+   for(int i = 0; i < n; i++)
+   {
+      cpus[i].coreRank = cpus[i].siblingRank = 0;
+      if (i > 0 && cpus[i].node == cpus[i-1].node)
+      {
+         int sameCore = cpus[i].package == cpus[i-1].package && cpus[i].core == cpus[i-1].core;
+         cpus[i].coreRank = cpus[i-1].coreRank + !sameCore;
+         cpus[i].siblingRank = sameCore ? cpus[i-1].siblingRank+1 : 0;
+      }
+   }
+   if (placement->policy == PLACEMENT_SCATTER)
+      qsort(cpus, n, sizeof(CPUInfo), scatter_order);
+
+   int numBarbers = placement->numBarberUnits;
+   int numUnits = numBarbers+placement->numClientUnits;
+   int barberCpus = n > 1 ? (numBarbers < n-1 ? numBarbers : n-1) : 0; // (barbers isolated)
+   for(int u = 0; u < numUnits; u++)
+   {
+      int i;
+      if (placement->policy == PLACEMENT_SCATTER)
+         i = u % n;
+      else if (placement->policy == PLACEMENT_COMPACT)
+         i = numUnits <= n ? u : (int)((long)u*n/numUnits);
+      else if (barberCpus == 0)
+         i = 0;
+      else if (u < numBarbers)
+         i = u % barberCpus;
+      else
+         i = barberCpus + (u-numBarbers) % (n-barberCpus);
+      placement->unit[u].cpu = cpus[i].cpu;
+   }
+
+   // shared state node: the one of most barbers (of most units if there are none)
+   int count[MAX_NODES];
+   memset(count, 0, sizeof(count));
+   unitNodes = 0;
+   for(int u = 0; u < numUnits; u++)
+      for(int i = 0; i < n; i++)
+         if (cpus[i].cpu == placement->unit[u].cpu)
+         {
+            unitNodes |= 1UL << cpus[i].node;
+            if (u < numBarbers || numBarbers == 0)
+               count[cpus[i].node]++;
+            break;
+         }
+   memoryNode = 0;
+   for(int i = 1; i < MAX_NODES; i++)
+      if (count[i] > count[memoryNode])
+         memoryNode = i;
+   mem_free(cpus);
+}
+
+static void read_topology(CPUInfo* info, int cpu)
+{
+   char path[128];
+   info->cpu = cpu;
+   info->node = 0;
+   sprintf(path, "/sys/devices/system/cpu/cpu%d", cpu);
+   DIR* dir = opendir(path);
+   if (dir != NULL)
+   {
+      struct dirent* entry;
+      int node;
+      while((entry = readdir(dir)) != NULL)
+         if (sscanf(entry->d_name, "node%d", &node) == 1 && node >= 0 && node < MAX_NODES)
+            info->node = node;
+      closedir(dir);
+   }
+   sprintf(path, "/sys/devices/system/cpu/cpu%d/topology/physical_package_id", cpu);
+   info->package = read_int(path, 0);
+   sprintf(path, "/sys/devices/system/cpu/cpu%d/topology/core_id", cpu);
+   info->core = read_int(path, cpu);
+}
+
+static int read_int(const char* path, int def)
+{
+   int res = def;
+   FILE* f = fopen(path, "r");
+   if (f != NULL)
+   {
+      if (fscanf(f, "%d", &res) != 1)
+         res = def;
+      fclose(f);
+   }
+   return res;
+}
+
+static int num_system_nodes()
+{
+   int res = 0;
+   DIR* dir = opendir("/sys/devices/system/node");
+   if (dir != NULL)
+   {
+      struct dirent* entry;
+      int node;
+      while((entry = readdir(dir)) != NULL)
+         if (sscanf(entry->d_name, "node%d", &node) == 1)
+            res++;
+      closedir(dir);
+   }
+   return res;
+}
+
+/* node, package, core, then cpu */
+static int compact_order(const void* a, const void* b)
+{
+   const CPUInfo* x = (const CPUInfo*)a;
+   const CPUInfo* y = (const CPUInfo*)b;
+   if (x->node != y->node)
+      return x->node - y->node;
+   if (x->package != y->package)
+      return x->package - y->package;
+   if (x->core != y->core)
+      return x->core - y->core;
+   return x->cpu - y->cpu;
+}
+
+/* the first core of each node, then the second one, ..., and only then their siblings */
+static int scatter_order(const void* a, const void* b)
+{
+   const CPUInfo* x = (const CPUInfo*)a;
+   const CPUInfo* y = (const CPUInfo*)b;
+   if (x->siblingRank != y->siblingRank)
+      return x->siblingRank - y->siblingRank;
+   if (x->coreRank != y->coreRank)
+      return x->coreRank - y->coreRank;
+   if (x->node != y->node)
+      return x->node - y->node;
+   return x->cpu - y->cpu;
+}
+
+static void summarise(FILE* out, const char* kind, int first, int num)
+{
+   if (num == 0)
+      return;
+
+   long migrations = 0, maxMigrations = 0, switches = 0, maxSwitches = 0;
+   int measured = 1;
+   for(int i = first; i < first+num; i++)
+   {
+      UnitCounters* u = placement->unit+i;
+      long s = u->voluntarySwitches + u->involuntarySwitches;
+      switches += s;
+      if (s > maxSwitches)
+         maxSwitches = s;
+      if (u->migrations < 0)
+         measured = 0;
+      else
+      {
+         migrations += u->migrations;
+         if (u->migrations > maxMigrations)
+            maxMigrations = u->migrations;
+      }
+   }
+   if (measured)
+      fprintf(out, "  %s: %.1f migrations (max. %ld), %.1f context switches (max. %ld) per unit\n",
+              kind, (double)migrations/num, maxMigrations, (double)switches/num, maxSwitches);
+   else
+      fprintf(out, "  %s: migrations not measured, %.1f context switches (max. %ld) per unit\n",
+              kind, (double)switches/num, maxSwitches);
+}
+
+static void json_units(FILE* out, int first, int num)
+{
+   fprintf(out, "[");
+   for(int i = first; i < first+num; i++)
+   {
+      UnitCounters* u = placement->unit+i;
+      fprintf(out, "%s{\"cpu\": %d, \"migrations\": ", i > first ? ", " : "", u->cpu);
+      if (u->migrations < 0)
+         fprintf(out, "null");
+      else
+         fprintf(out, "%ld", u->migrations);
+      fprintf(out, ", \"voluntary_switches\": %ld, \"involuntary_switches\": %ld}", u->voluntarySwitches, u->involuntarySwitches);
+   }
+   fprintf(out, "]");
+}
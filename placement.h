@@ -0,0 +1,60 @@
+/**
+ *  \brief Placement of barbers and clients on CPUs
+ *
+ * Barber units (a barber process or thread) and client units (a client
+ * process or thread, or a worker running clients as coroutines) are pinned
+ * to the CPUs the simulation may run on, by a policy:
+ *   - compact: consecutive units share a CPU, then the sibling CPUs of a
+ *     core, a package and a NUMA node, so that as few CPUs as possible are
+ *     used;
+ *   - scatter: units are dealt round-robin over the CPUs, alternating NUMA
+ *     nodes first, then cores;
+ *   - barbers-isolated: barbers get CPUs of their own (all but one, at
+ *     most), and clients share the others.
+ * On a NUMA machine the shared state is kept on the node of the barbers
+ * (which touch it the most), or interleaved over the nodes when scattered.
+ * Each unit records the CPU migrations and context switches of its
+ * lifetime for the run report, whichever the policy.
+ */
+
+#ifndef PLACEMENT_H
+#define PLACEMENT_H
+
+#include <stdio.h>
+#include "global.h"
+
+#define PLACEMENT_NONE             0  // left to the kernel (default)
+#define PLACEMENT_COMPACT          1
+#define PLACEMENT_SCATTER          2
+#define PLACEMENT_BARBERS_ISOLATED 3
+
+typedef struct _UnitCounters_
+{
+   int cpu;                    // pinned to (-1 if not pinned)
+   long migrations;            // (-1 if not measured)
+   long voluntarySwitches;
+   long involuntarySwitches;
+} CACHE_ALIGNED UnitCounters;  // (written by its own unit only)
+
+typedef struct _Placement_
+{
+   int policy;
+   int numBarberUnits;
+   int numClientUnits;
+   UnitCounters* unit;         // [numBarberUnits+numClientUnits] barber units first
+} Placement;
+
+int placement_policy(const char* name); // -1 if invalid
+const char* placement_name(int policy);
+
+size_t sizeof_placement_arrays(int num_barber_units, int num_client_units);
+void init_placement(Placement* placement, int policy, int num_barber_units, int num_client_units, Storage* storage);
+void place_memory(void* mem, size_t size); // (page aligned) before the units start; pages already touched are moved
+
+void enter_placement(int unit);   // (from the unit's own thread) pin it and start its counters
+void leave_placement(int unit);   // (from the unit's own thread) record its counters
+
+void report_placement(FILE* out);
+void json_placement(FILE* out);
+
+#endif
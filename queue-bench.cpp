@@ -0,0 +1,280 @@
+/**
+ *  \brief Contention benchmark of the client queue
+ *
+ * Client processes enqueue and barber processes dequeue, as fast as they
+ * can, through a ClientQueue in a shared memory segment.  The queue is
+ * used lock-free, or with every operation under one process-shared
+ * semaphore (as when the client benches mutex serialized it), and the
+ * throughput of both is reported.  As in the barber shop, clients only
+ * enqueue while there is a free benches seat, so the queue never holds
+ * more items than its capacity.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <getopt.h>
+#include <string.h>
+#include <time.h>
+#include <sched.h>
+#include <semaphore.h>
+#include <sys/wait.h>
+#include "dbc.h"
+#include "global.h"
+#include "utils.h"
+#include "process.h"
+#include "client-queue.h"
+
+#define LOCK_FREE 0
+#define SEMAPHORE 1
+
+typedef struct _Bench_
+{
+   ClientQueue queue;
+   sem_t mutex;       // semaphore mode
+   int freeSeats;
+   int go;            // all processes created
+   long dequeued;
+   long orderErrors;  // order numbers out of FIFO order, as seen by one barber
+} Bench;
+
+static int numBarbers = 20;
+static int numClients = 99;
+static int capacity = 6;
+static int itemsPerClient = 10000;
+static int modes[2] = {1, 1};
+
+static Bench* bench;
+
+static void help(char* prog);
+static void processArgs(int argc, char* argv[]);
+static double run(int mode);
+static void client(int id, int mode);
+static void barber(int mode);
+
+int main(int argc, char* argv[])
+{
+   processArgs(argc, argv);
+
+   printf("mode,barbers,clients,capacity,items,seconds,items_per_s,order_errors\n");
+   for(int mode = LOCK_FREE; mode <= SEMAPHORE; mode++)
+      if (modes[mode])
+      {
+         long items = (long)numClients*itemsPerClient;
+         double secs = run(mode);
+         printf("%s,%d,%d,%d,%ld,%.3f,%.0f,%ld\n", mode == LOCK_FREE ? "lock-free" : "semaphore",
+                numBarbers, numClients, capacity, items, secs, items/secs, bench->orderErrors);
+      }
+   return 0;
+}
+
+/* one benchmark run (seconds from the start signal until every process ends) */
+static double run(int mode)
+{
+   size_t size = storage_size(sizeof(Bench)) + sizeof_client_queue_arrays(capacity);
+   int shmid = pshmget(IPC_PRIVATE, size, 0600|IPC_CREAT);
+   void* mem = pshmat(shmid, NULL, 0);
+   Storage storage;
+   init_storage(&storage, mem, size);
+   bench = (Bench*)storage_alloc(&storage, sizeof(Bench));
+   init_client_queue(&bench->queue, capacity, &storage);
+   psem_init(&bench->mutex, 1, 1);
+   bench->freeSeats = capacity;
+   bench->go = 0;
+   bench->dequeued = 0;
+   bench->orderErrors = 0;
+
+   fflush(stdout); // (otherwise also flushed by each child)
+   int numProcs = numBarbers+numClients;
+   pid_t* pids = (pid_t*)mem_alloc(numProcs*sizeof(pid_t));
+   for(int i = 0; i < numProcs; i++)
+   {
+      pids[i] = pfork();
+      if (pids[i] == 0)
+      {
+         while(!__atomic_load_n(&bench->go, __ATOMIC_ACQUIRE))
+            sched_yield();
+         if (i < numBarbers)
+            barber(mode);
+         else
+            client(i-numBarbers+1, mode);
+         exit(EXIT_SUCCESS);
+      }
+   }
+
+   struct timespec t0, t1;
+   clock_gettime(CLOCK_MONOTONIC, &t0);
+   __atomic_store_n(&bench->go, 1, __ATOMIC_RELEASE);
+   int status;
+   for(int i = 0; i < numProcs; i++)
+      pwaitpid(pids[i], &status, 0);
+   clock_gettime(CLOCK_MONOTONIC, &t1);
+
+   check (bench->dequeued == (long)numClients*itemsPerClient, "items lost");
+
+   mem_free(pids);
+   psem_destroy(&bench->mutex);
+   term_client_queue(&bench->queue);
+   shmctl(shmid, IPC_RMID, NULL);
+   return (t1.tv_sec-t0.tv_sec) + (t1.tv_nsec-t0.tv_nsec)/1000000000.0;
+}
+
+static void client(int id, int mode)
+{
+   RQItem item = {id, 0, HAIRCUT_REQ, 0};
+   for(int i = 0; i < itemsPerClient; i++)
+   {
+      // take a benches seat
+      int seats = __atomic_load_n(&bench->freeSeats, __ATOMIC_RELAXED);
+      while(seats == 0 || !__atomic_compare_exchange_n(&bench->freeSeats, &seats, seats-1, 0, __ATOMIC_ACQUIRE, __ATOMIC_RELAXED))
+      {
+         if (seats == 0)
+         {
+            sched_yield();
+            seats = __atomic_load_n(&bench->freeSeats, __ATOMIC_RELAXED);
+         }
+      }
+      item.benchPos = i;
+      if (mode == SEMAPHORE)
+      {
+         psem_wait(&bench->mutex);
+         in_client_queue(&bench->queue, item);
+         psem_post(&bench->mutex);
+      }
+      else
+         in_client_queue(&bench->queue, item);
+   }
+}
+
+static void barber(int mode)
+{
+   long total = (long)numClients*itemsPerClient;
+   int lastOrder = 0;
+   while(__atomic_load_n(&bench->dequeued, __ATOMIC_RELAXED) < total)
+   {
+      RQItem item;
+      if (mode == SEMAPHORE)
+      {
+         psem_wait(&bench->mutex);
+         item = out_client_queue(&bench->queue);
+         psem_post(&bench->mutex);
+      }
+      else
+         item = out_client_queue(&bench->queue);
+      if (item.benchPos == -1)
+         sched_yield();
+      else
+      {
+         if (item.order <= lastOrder)
+            __atomic_add_fetch(&bench->orderErrors, 1, __ATOMIC_RELAXED);
+         lastOrder = item.order;
+         __atomic_add_fetch(&bench->dequeued, 1, __ATOMIC_RELAXED);
+         __atomic_add_fetch(&bench->freeSeats, 1, __ATOMIC_RELEASE);
+      }
+   }
+}
+
+/*********************************************************************/
+
+static void help(char* prog)
+{
+   require (prog != NULL, "program name argument required");
+
+   printf("\n");
+   printf("Usage: %s [OPTION] ...\n", prog);
+   printf("\n");
+   printf("Client queue contention benchmark: clients enqueue and barbers dequeue\n");
+   printf("(one process each) as fast as they can; writes one CSV line per mode.\n");
+   printf("\n");
+   printf("Options:\n");
+   printf("\n");
+   printf("  -h,--help                                   show this help\n");
+   printf("  -b,--num-barbers <N>\n");
+   printf("     number of barbers (default is %d)\n", numBarbers);
+   printf("  -n,--num-clients <N>\n");
+   printf("     number of clients (default is %d)\n", numClients);
+   printf("  -s,--capacity <N>\n");
+   printf("     queue capacity, i.e. client benches seats (default is %d)\n", capacity);
+   printf("  -i,--items <N>\n");
+   printf("     items enqueued by each client (default is %d)\n", itemsPerClient);
+   printf("  -m,--mode <lock-free|semaphore>\n");
+   printf("     run a single mode (default is both)\n");
+   printf("\n");
+}
+
+static void processArgs(int argc, char* argv[])
+{
+   require (argc >= 0 && argv != NULL && argv[0] != NULL, "invalid main arguments");
+
+   static struct option long_options[] =
+   {
+      {"help",                         no_argument,       NULL, 'h'},
+      {"num-barbers",                  required_argument, NULL, 'b'},
+      {"num-clients",                  required_argument, NULL, 'n'},
+      {"capacity",                     required_argument, NULL, 's'},
+      {"items",                        required_argument, NULL, 'i'},
+      {"mode",                         required_argument, NULL, 'm'},
+      {0, 0, NULL, 0}
+   };
+   int op=0;
+
+   while (op != -1)
+   {
+      int option_index = 0;
+
+      op = getopt_long(argc, argv, "hb:n:s:i:m:", long_options, &option_index);
+      int st,n;
+      switch (op)
+      {
+         case -1:
+            break;
+
+         case 'h':
+            help(argv[0]);
+            exit(EXIT_SUCCESS);
+
+         case 'b':
+         case 'n':
+         case 's':
+         case 'i':
+            st = sscanf(optarg, "%d", &n);
+            if (st != 1 || n < 1)
+            {
+               fprintf(stderr, "ERROR: invalid value \"%s\" for -%c\n", optarg, (char)op);
+               exit(EXIT_FAILURE);
+            }
+            if (op == 'b')
+               numBarbers = n;
+            else if (op == 'n')
+               numClients = n;
+            else if (op == 's')
+               capacity = n;
+            else
+               itemsPerClient = n;
+            break;
+
+         case 'm':
+            if (strcmp(optarg, "lock-free") == 0)
+               modes[SEMAPHORE] = 0;
+            else if (strcmp(optarg, "semaphore") == 0)
+               modes[LOCK_FREE] = 0;
+            else
+            {
+               fprintf(stderr, "ERROR: invalid mode \"%s\"\n", optarg);
+               exit(EXIT_FAILURE);
+            }
+            break;
+
+         default:
+            help(argv[0]);
+            exit(EXIT_FAILURE);
+            break;
+      }
+   }
+
+   if (optind < argc)
+   {
+      fprintf(stderr, "ERROR: invalid extra arguments\n");
+      exit(EXIT_FAILURE);
+   }
+}
@@ -0,0 +1,102 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include "dbc.h"
+#include "utils.h"
+#include "resource-pool.h"
+
+#define WORD_BITS ((int)(8*sizeof(unsigned long)))
+
+static int claim_free_slot(ResourcePool* pool, int start);
+
+size_t sizeof_resource_pool_arrays(int num_slots)
+{
+   require (num_slots > 0, concat_3str("invalid number of slots (", int2str(num_slots), ")"));
+
+   return storage_size(((num_slots+WORD_BITS-1)/WORD_BITS)*sizeof(unsigned long));
+}
+
+void init_resource_pool(ResourcePool* pool, int num_slots, Storage* storage)
+{
+   require (pool != NULL, "pool argument required");
+   require (num_slots > 0, concat_3str("invalid number of slots (", int2str(num_slots), ")"));
+   require (storage != NULL, "storage argument required");
+
+   pool->numSlots = num_slots;
+   pool->numWords = (num_slots+WORD_BITS-1)/WORD_BITS;
+   pool->free = (unsigned long*)storage_alloc(storage, pool->numWords*sizeof(unsigned long));
+   for(int w = 0; w < pool->numWords; w++)
+      pool->free[w] = 0;
+   for(int slot = 0; slot < num_slots; slot++)
+      pool->free[slot/WORD_BITS] |= 1UL << (slot%WORD_BITS);
+   pool->available = num_slots;
+   clock_sem_init(&pool->waiters, 0);
+}
+
+void term_resource_pool(ResourcePool* pool)
+{
+   require (pool != NULL, "pool argument required");
+
+   clock_sem_destroy(&pool->waiters);
+}
+
+int acquire_resource_pool(ResourcePool* pool)
+{
+   require (pool != NULL, "pool argument required");
+
+   if (__atomic_fetch_sub(&pool->available, 1, __ATOMIC_ACQUIRE) <= 0)
+      clock_sem_wait(&pool->waiters); // a slot is promised by its releaser
+   int res = claim_free_slot(pool, random_int(0, pool->numSlots-1));
+
+   ensure (res >= 0 && res < pool->numSlots, "");
+
+   return res;
+}
+
+void release_resource_pool(ResourcePool* pool, int slot)
+{
+   require (pool != NULL, "pool argument required");
+   require (slot >= 0 && slot < pool->numSlots, concat_3str("invalid slot (", int2str(slot), ")"));
+
+   unsigned long mask = 1UL << (slot%WORD_BITS);
+   unsigned long old = __atomic_fetch_or(&pool->free[slot/WORD_BITS], mask, __ATOMIC_RELEASE);
+   check ((old & mask) == 0, "slot not acquired");
+   // the bit is set before the slot is promised, so every promise finds one
+   if (__atomic_fetch_add(&pool->available, 1, __ATOMIC_RELEASE) < 0)
+      clock_sem_post(&pool->waiters);
+}
+
+int num_free_resource_pool(ResourcePool* pool)
+{
+   require (pool != NULL, "pool argument required");
+
+   int res = __atomic_load_n(&pool->available, __ATOMIC_RELAXED);
+   return res < 0 ? 0 : res;
+}
+
+/* first free slot from start onwards (wrapping around); the caller holds a
+ * promise, so a free bit exists, although a concurrent claim may take the
+ * one seen and a release may set one already scanned (then scan again) */
+static int claim_free_slot(ResourcePool* pool, int start)
+{
+   int w0 = start/WORD_BITS;
+   int b0 = start%WORD_BITS;
+   for(;;)
+   {
+      for(int i = 0; i <= pool->numWords; i++)
+      {
+         int w = (w0+i) % pool->numWords;
+         unsigned long mask = ~0UL;
+         if (i == 0)
+            mask <<= b0;              // from the start slot
+         else if (i == pool->numWords)
+            mask = ~(~0UL << b0);     // back at the start word: the slots before it
+         unsigned long bits;
+         while((bits = __atomic_load_n(&pool->free[w], __ATOMIC_RELAXED) & mask) != 0)
+         {
+            unsigned long bit = bits & -bits;
+            if (__atomic_fetch_and(&pool->free[w], ~bit, __ATOMIC_ACQUIRE) & bit)
+               return w*WORD_BITS + __builtin_ctzl(bit);
+         }
+      }
+   }
+}
@@ -0,0 +1,36 @@
+/**
+ *  \brief Pool of identical resources (slots) claimed one at a time.
+ *
+ * The free slots are a bitmap of atomic words (it may live in a shared
+ * memory segment), next to a counter of the free slots not yet promised to
+ * anyone.  Acquiring decrements the counter and, while it stays
+ * non-negative, claims a free bit with an atomic operation, scanning from a
+ * random slot (so placement stays randomised).  Only when no slot is free
+ * does the caller block, in FIFO order, on a semaphore aware of the
+ * simulation clock; a release posts it only if someone is waiting.
+ */
+
+#ifndef RESOURCE_POOL_H
+#define RESOURCE_POOL_H
+
+#include "global.h"
+#include "sim-clock.h"
+
+typedef struct _ResourcePool_
+{
+   int numSlots;
+   int numWords;
+   unsigned long* free;   // [numWords] bit set if the slot is free
+   int available;         // free slots not yet promised (negative: minus the number of waiters)
+   ClockSem waiters;
+} ResourcePool;
+
+size_t sizeof_resource_pool_arrays(int num_slots);
+void init_resource_pool(ResourcePool* pool, int num_slots, Storage* storage); // (simulation clock initialized)
+void term_resource_pool(ResourcePool* pool);
+
+int acquire_resource_pool(ResourcePool* pool);            // returns the claimed slot (blocks while none is free)
+void release_resource_pool(ResourcePool* pool, int slot);
+int num_free_resource_pool(ResourcePool* pool);          // (snapshot)
+
+#endif
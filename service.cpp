@@ -8,7 +8,7 @@ void set_barber_chair_service(Service* service, int barber_id, int client_id, in
    require (barber_id > 0, concat_3str("invalid barber id (", int2str(barber_id), ")"));
    require (client_id > 0, concat_3str("invalid client id (", int2str(client_id), ")"));
    require (pos >= 0, concat_3str("invalid position (", int2str(pos), ")"));
-   require (request == HAIRCUT_REQ || request == SHAVE_REQ, concat_3str("invalid request (", int2str(request), ")"));
+   require (request != 0 && (request & ~(HAIRCUT_REQ|SHAVE_REQ)) == 0, concat_3str("invalid request (", int2str(request), ")")); // (both: a batch)
 
    service->barberChair = 1;
    service->washbasin = 0;
@@ -75,3 +75,35 @@ int service_request(Service* service)
    return service->request;
 }
 
+void init_service_channel(ServiceChannel* channel)
+{
+   require (channel != NULL, "channel argument required");
+
+   clock_word_init(&channel->step, SERVICE_IDLE);
+}
+
+void post_service_step(ServiceChannel* channel, int step)
+{
+   require (channel != NULL, "channel argument required");
+   require (step > SERVICE_IDLE && step <= SERVICE_RELEASED, concat_3str("invalid step (", int2str(step), ")"));
+
+   clock_word_store(&channel->step, step);
+}
+
+void wait_service_step(ServiceChannel* channel, int step)
+{
+   require (channel != NULL, "channel argument required");
+   require (step > SERVICE_IDLE && step <= SERVICE_RELEASED, concat_3str("invalid step (", int2str(step), ")"));
+
+   int current;
+   while((current = clock_word_load(&channel->step)) != step)
+      clock_word_wait(&channel->step, current);
+}
+
+void wait_service_step_past(ServiceChannel* channel, int step)
+{
+   require (channel != NULL, "channel argument required");
+   require (step > SERVICE_IDLE && step <= SERVICE_RELEASED, concat_3str("invalid step (", int2str(step), ")"));
+
+   clock_word_wait(&channel->step, step);
+}
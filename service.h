@@ -7,6 +7,8 @@
 #ifndef SERVICE_H
 #define SERVICE_H
 
+#include "sim-clock.h"
+
 typedef struct _Service_
 {
    int barberChair;
@@ -17,6 +19,22 @@ typedef struct _Service_
    int request;
 } Service;
 
+// handshake steps of the services of a client:
+#define SERVICE_IDLE     0
+#define SERVICE_ASSIGNED 1  // barber: next service published
+#define SERVICE_STARTED  2  // client: seated, the service may start
+#define SERVICE_DONE     3  // barber: service performed (the next SERVICE_ASSIGNED may follow at once)
+#define SERVICE_RELEASED 4  // client: all its services done, barber released
+
+/* barber to client channel: the last handshake step and the service it
+ * refers to, in a single cache line; each side blocks only when the step
+ * it waits for is not there yet */
+typedef struct _ServiceChannel_
+{
+   ClockWord step;
+   Service service;
+} CACHE_ALIGNED ServiceChannel;
+
 void set_barber_chair_service(Service* service, int barber_id, int client_id, int pos, int request);
 void set_washbasin_service(Service* service, int barber_id, int client_id, int pos);
 int is_barber_chair_service(Service* service);
@@ -26,5 +44,10 @@ int service_client_id(Service* service);
 int service_position(Service* service);
 int service_request(Service* service);
 
+void init_service_channel(ServiceChannel* channel);
+void post_service_step(ServiceChannel* channel, int step);
+void wait_service_step(ServiceChannel* channel, int step);       // until it is step
+void wait_service_step_past(ServiceChannel* channel, int step);  // until it is no longer step
+
 
 #endif
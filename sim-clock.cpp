@@ -0,0 +1,722 @@
+#include <stdlib.h>
+#include <unistd.h>
+#include <time.h>
+#include <limits.h>
+#include <sys/syscall.h>
+#include <linux/futex.h>
+#include "dbc.h"
+#include "global.h"
+#include "utils.h"
+#include "timer.h"
+#include "coroutine.h"
+#include "sim-clock.h"
+
+static SimClock* simClock = NULL;   // shared by all processes (inherited through fork)
+static __thread int current = -1; // entity of the calling thread (-1 if not an entity)
+static int localHost = -1;          // host run by the calling process (-1 if none)
+static int localFirst = 0;          // entity of its coroutine 0
+
+static int self();
+static int listed();
+static int hosted();
+static long clock_now();
+static void lock();
+static void unlock();
+static int listed_timedwait(ClockSem* sem, const struct timespec* t);
+static void wait_wakeup(int entity);
+static void post_wakeup(int entity);
+static void delay(long ms);
+static void block_current();
+static void advance();
+static void wake_due(long now);
+static void push_event(ClockEvent event);
+static ClockEvent pop_event();
+static void remove_event(int entity);
+static void place_event(int i, ClockEvent event);
+static void sift_event(int i, ClockEvent event);
+static void unlink_waiter(ClockSem* sem, int entity);
+static int before(ClockEvent* e1, ClockEvent* e2);
+
+size_t sizeof_sim_clock_arrays(int num_entities, int num_hosts)
+{
+   require (num_entities > 0, concat_3str("invalid number of entities (", int2str(num_entities), ")"));
+   require (num_hosts >= 0, concat_3str("invalid number of hosts (", int2str(num_hosts), ")"));
+
+   return storage_size(num_entities*sizeof(ClockEvent)) + storage_size(num_entities*sizeof(sem_t)) +
+          4*storage_size(num_entities*sizeof(int)) + storage_size(num_entities*sizeof(ClockSem*)) +
+          storage_size(num_hosts*sizeof(sem_t)) + storage_size(num_hosts*sizeof(int));
+}
+
+void init_sim_clock(SimClock* clock, int num_entities, int num_hosts, int virtual_time, int pshared, Storage* storage)
+{
+   require (clock != NULL, "clock argument required");
+   require (num_entities > 0, concat_3str("invalid number of entities (", int2str(num_entities), ")"));
+   require (num_hosts >= 0, concat_3str("invalid number of hosts (", int2str(num_hosts), ")"));
+   require (storage != NULL, "storage argument required");
+
+   clock->virtualTime = virtual_time;
+   clock->pshared = pshared;
+   clock_gettime(CLOCK_MONOTONIC, &clock->start);
+
+   psem_init(&clock->mutex, pshared, 1);
+   clock->now = 0;
+   clock->seq = 0;
+   clock->totalEntities = num_entities;
+   clock->numEntities = num_entities;
+   clock->active = num_entities; // all entities are running until they block
+   clock->calendarSize = 0;
+   clock->calendar = (ClockEvent*)storage_alloc(storage, num_entities*sizeof(ClockEvent));
+   clock->wakeup = (sem_t*)storage_alloc(storage, num_entities*sizeof(sem_t));
+   clock->next = (int*)storage_alloc(storage, num_entities*sizeof(int));
+   clock->slot = (int*)storage_alloc(storage, num_entities*sizeof(int));
+   clock->timedSem = (ClockSem**)storage_alloc(storage, num_entities*sizeof(ClockSem*));
+   clock->expired = (int*)storage_alloc(storage, num_entities*sizeof(int));
+   clock->host = (int*)storage_alloc(storage, num_entities*sizeof(int));
+   for(int i = 0; i < num_entities; i++)
+   {
+      psem_init(&clock->wakeup[i], pshared, 0);
+      clock->next[i] = -1;
+      clock->slot[i] = -1;
+      clock->timedSem[i] = NULL;
+      clock->expired[i] = 0;
+      clock->host[i] = -1;
+   }
+   clock->numHosts = num_hosts;
+   clock->hostWakeup = (sem_t*)storage_alloc(storage, num_hosts*sizeof(sem_t));
+   clock->hostPending = (int*)storage_alloc(storage, num_hosts*sizeof(int));
+   for(int i = 0; i < num_hosts; i++)
+   {
+      psem_init(&clock->hostWakeup[i], pshared, 0);
+      clock->hostPending[i] = -1;
+   }
+
+   simClock = clock;
+}
+
+void term_sim_clock(SimClock* clock)
+{
+   require (clock != NULL, "clock argument required");
+
+   psem_destroy(&clock->mutex);
+   for(int i = 0; i < clock->totalEntities; i++)
+      psem_destroy(&clock->wakeup[i]);
+   for(int i = 0; i < clock->numHosts; i++)
+      psem_destroy(&clock->hostWakeup[i]);
+   simClock = NULL;
+}
+
+void assign_sim_clock_host(int host, int first_entity, int num_entities)
+{
+   require (simClock != NULL, "clock not initialized");
+   require (host >= 0 && host < simClock->numHosts, concat_3str("invalid host (", int2str(host), ")"));
+   require (first_entity >= 0 && num_entities >= 0 && first_entity+num_entities <= simClock->totalEntities,
+            concat_3str("invalid entities of host (", int2str(host), ")"));
+
+   for(int i = first_entity; i < first_entity+num_entities; i++)
+      simClock->host[i] = host;
+}
+
+void host_sim_clock(int host)
+{
+   require (simClock != NULL, "clock not initialized");
+   require (host >= 0 && host < simClock->numHosts, concat_3str("invalid host (", int2str(host), ")"));
+
+   localHost = host;
+   localFirst = 0;
+   while(localFirst < simClock->totalEntities && simClock->host[localFirst] != host)
+      localFirst++;
+}
+
+void wait_host_sim_clock()
+{
+   require (simClock != NULL, "clock not initialized");
+   require (localHost >= 0, "not a host");
+
+   if (simClock->virtualTime)
+      psem_wait(&simClock->hostWakeup[localHost]);
+   else
+   {
+      // real time: also wakes up for the earliest delay due (of any host: whichever is idle wakes it)
+      lock();
+      long due = simClock->calendarSize > 0 ? simClock->calendar[0].time : -1;
+      unlock();
+      if (due == -1)
+         psem_wait(&simClock->hostWakeup[localHost]);
+      else if (due > clock_now())
+      {
+         long ms = due-clock_now();
+         struct timespec t;
+         clock_gettime(CLOCK_REALTIME, &t);
+         t.tv_sec += ms/1000;
+         t.tv_nsec += (ms%1000)*1000000;
+         if (t.tv_nsec >= 1000000000)
+         {
+            t.tv_sec++;
+            t.tv_nsec -= 1000000000;
+         }
+         psem_timedwait(&simClock->hostWakeup[localHost], &t);
+      }
+      lock();
+      wake_due(clock_now());
+      unlock();
+   }
+   lock();
+   int entity = simClock->hostPending[localHost];
+   simClock->hostPending[localHost] = -1;
+   unlock();
+   while(entity != -1) // (detached: no longer shared)
+   {
+      int next = simClock->next[entity];
+      simClock->next[entity] = -1;
+      resume_coroutine(entity-localFirst);
+      entity = next;
+   }
+}
+
+void enter_sim_clock(int entity)
+{
+   require (simClock != NULL, "clock not initialized");
+   require (entity >= 0 && entity < simClock->totalEntities, concat_3str("invalid entity (", int2str(entity), ")"));
+   require (simClock->host[entity] == -1 || entity == self(), "entity must be the running coroutine");
+
+   current = entity;
+}
+
+void leave_sim_clock()
+{
+   require (simClock != NULL, "clock not initialized");
+   require (self() >= 0, "not an entity");
+
+   if (simClock->virtualTime)
+   {
+      lock();
+      simClock->numEntities--;
+      block_current();
+      unlock();
+   }
+   current = -1;
+}
+
+int virtual_time_sim_clock()
+{
+   require (simClock != NULL, "clock not initialized");
+
+   return simClock->virtualTime;
+}
+
+long now_sim_clock()
+{
+   require (simClock != NULL, "clock not initialized");
+
+   long res;
+   if (simClock->virtualTime)
+   {
+      lock();
+      res = simClock->now;
+      unlock();
+   }
+   else
+   {
+      struct timespec t;
+      clock_gettime(CLOCK_MONOTONIC, &t);
+      res = (t.tv_sec-simClock->start.tv_sec)*1000 + (t.tv_nsec-simClock->start.tv_nsec)/1000000;
+   }
+   return res;
+}
+
+long peek_sim_clock()
+{
+   require (simClock != NULL, "clock not initialized");
+
+   if (simClock->virtualTime)
+      return __atomic_load_n(&simClock->now, __ATOMIC_RELAXED);
+   return now_sim_clock();
+}
+
+void spend_sim_clock(int time_units)
+{
+   require (time_units >= 0, concat_3str("invalid time units (", int2str(time_units), ")"));
+
+   if (simClock == NULL || (!simClock->virtualTime && !hosted()))
+      spend(time_units);
+   else
+      delay((long)time_units*time_unit());
+}
+
+void pace_sim_clock()
+{
+   spend_sim_clock(random_int(global->MIN_VITALITY_TIME_UNITS, global->MAX_VITALITY_TIME_UNITS));
+}
+
+void sleep_sim_clock(int seconds)
+{
+   require (seconds >= 0, concat_3str("invalid seconds (", int2str(seconds), ")"));
+
+   if (simClock == NULL || (!simClock->virtualTime && !hosted()))
+      sleep(seconds);
+   else
+      delay(seconds*1000L);
+}
+
+void clock_sem_init(ClockSem* sem, unsigned int value)
+{
+   require (simClock != NULL, "clock not initialized");
+   require (sem != NULL, "semaphore argument required");
+
+   psem_init(&sem->sem, simClock->pshared, listed() ? 0 : value);
+   sem->value = value;
+   sem->first = sem->last = -1;
+}
+
+void clock_sem_destroy(ClockSem* sem)
+{
+   require (sem != NULL, "semaphore argument required");
+
+   psem_destroy(&sem->sem);
+}
+
+void clock_sem_wait(ClockSem* sem)
+{
+   require (sem != NULL, "semaphore argument required");
+
+   if (!listed())
+      psem_wait(&sem->sem);
+   else
+   {
+      int entity = self();
+      require (entity >= 0, "only barbers and clients may block in virtual time (or with coroutine hosts)");
+
+      lock();
+      if (sem->value > 0)
+      {
+         sem->value--;
+         unlock();
+      }
+      else
+      {
+         simClock->next[entity] = -1;
+         if (sem->last == -1)
+            sem->first = entity;
+         else
+            simClock->next[sem->last] = entity;
+         sem->last = entity;
+         block_current();
+         unlock();
+         wait_wakeup(entity);
+      }
+   }
+}
+
+int clock_sem_timedwait(ClockSem* sem, int time_units)
+{
+   require (sem != NULL, "semaphore argument required");
+   require (time_units >= 0, concat_3str("invalid time units (", int2str(time_units), ")"));
+
+   int res;
+   long ms = (long)time_units*time_unit();
+   if (!listed() || (!simClock->virtualTime && !hosted()))
+   {
+      struct timespec t;
+      clock_gettime(CLOCK_REALTIME, &t);
+      t.tv_sec += ms/1000;
+      t.tv_nsec += (ms%1000)*1000000;
+      if (t.tv_nsec >= 1000000000)
+      {
+         t.tv_sec++;
+         t.tv_nsec -= 1000000000;
+      }
+      if (!listed())
+         res = psem_timedwait(&sem->sem, &t);
+      else
+         res = listed_timedwait(sem, &t);
+   }
+   else
+   {
+      int entity = self();
+      require (entity >= 0, "only barbers and clients may block in virtual time (or with coroutine hosts)");
+
+      lock();
+      if (sem->value > 0)
+      {
+         sem->value--;
+         unlock();
+         res = 1;
+      }
+      else if (ms == 0)
+      {
+         unlock();
+         res = 0;
+      }
+      else
+      {
+         // waiting in the semaphore list and in the calendar:
+         // whichever comes first (post or expiration) cancels the other
+         simClock->next[entity] = -1;
+         if (sem->last == -1)
+            sem->first = entity;
+         else
+            simClock->next[sem->last] = entity;
+         sem->last = entity;
+         simClock->timedSem[entity] = sem;
+         simClock->expired[entity] = 0;
+         ClockEvent event = {clock_now()+ms, simClock->seq++, entity};
+         push_event(event);
+         block_current();
+         unlock();
+         wait_wakeup(entity);
+         res = !simClock->expired[entity];
+      }
+   }
+   return res;
+}
+
+void clock_sem_post(ClockSem* sem)
+{
+   require (sem != NULL, "semaphore argument required");
+
+   if (!listed())
+      psem_post(&sem->sem);
+   else
+   {
+      lock();
+      if (sem->first != -1)
+      {
+         int entity = sem->first;
+         sem->first = simClock->next[entity];
+         if (sem->first == -1)
+            sem->last = -1;
+         if (simClock->timedSem[entity] != NULL)
+         {
+            simClock->timedSem[entity] = NULL;
+            if (simClock->slot[entity] != -1) // (a real time wait of an entity not hosted is not in the calendar)
+               remove_event(entity);
+         }
+         simClock->active++;
+         post_wakeup(entity);
+      }
+      else
+         sem->value++;
+      unlock();
+   }
+}
+
+void clock_word_init(ClockWord* word, int value)
+{
+   require (simClock != NULL, "clock not initialized");
+   require (word != NULL, "word argument required");
+
+   word->value = value;
+   word->waiters = 0;
+   word->waiter = -1;
+}
+
+int clock_word_load(ClockWord* word)
+{
+   require (word != NULL, "word argument required");
+
+   return __atomic_load_n(&word->value, __ATOMIC_ACQUIRE);
+}
+
+void clock_word_wait(ClockWord* word, int value)
+{
+   require (word != NULL, "word argument required");
+
+   if (!listed())
+   {
+      int op = simClock->pshared ? FUTEX_WAIT : FUTEX_WAIT_PRIVATE;
+      while(__atomic_load_n(&word->value, __ATOMIC_ACQUIRE) == value)
+      {
+         __atomic_add_fetch(&word->waiters, 1, __ATOMIC_SEQ_CST);
+         syscall(SYS_futex, &word->value, op, value, NULL, NULL, 0); // (returns at once if changed)
+         __atomic_sub_fetch(&word->waiters, 1, __ATOMIC_RELAXED);
+      }
+   }
+   else
+   {
+      int entity = self();
+      require (entity >= 0, "only barbers and clients may block in virtual time (or with coroutine hosts)");
+
+      while(__atomic_load_n(&word->value, __ATOMIC_ACQUIRE) == value)
+      {
+         int blocked = 0;
+         lock();
+         if (__atomic_load_n(&word->value, __ATOMIC_ACQUIRE) == value)
+         {
+            check (word->waiter == -1, "a single entity may wait on a word");
+            __atomic_store_n(&word->waiter, entity, __ATOMIC_SEQ_CST);
+            if (__atomic_load_n(&word->value, __ATOMIC_SEQ_CST) != value) // stored meanwhile
+               word->waiter = -1;
+            else
+            {
+               block_current();
+               blocked = 1;
+            }
+         }
+         unlock();
+         if (blocked)
+            wait_wakeup(entity);
+      }
+   }
+}
+
+void clock_word_store(ClockWord* word, int value)
+{
+   require (word != NULL, "word argument required");
+
+   __atomic_store_n(&word->value, value, __ATOMIC_SEQ_CST);
+   if (!listed())
+   {
+      if (__atomic_load_n(&word->waiters, __ATOMIC_SEQ_CST) > 0)
+         syscall(SYS_futex, &word->value, simClock->pshared ? FUTEX_WAKE : FUTEX_WAKE_PRIVATE, INT_MAX, NULL, NULL, 0);
+   }
+   else if (__atomic_load_n(&word->waiter, __ATOMIC_SEQ_CST) != -1)
+   {
+      lock();
+      int entity = word->waiter;
+      if (entity != -1)
+      {
+         word->waiter = -1;
+         simClock->active++;
+         post_wakeup(entity);
+      }
+      unlock();
+   }
+}
+
+/* entity of the caller (-1 if not an entity) */
+static int self()
+{
+   return localHost >= 0 && current_coroutine() >= 0 ? localFirst+current_coroutine() : current;
+}
+
+/*
+ * entities block in the waiting lists of the clock (rather than in the semaphores and
+ * futexes of the kernel): always in virtual time, and in real time with coroutine hosts,
+ * whose coroutines must suspend instead of blocking their worker
+ */
+static int listed()
+{
+   return simClock->virtualTime || simClock->numHosts > 0;
+}
+
+/* caller is a coroutine of its host process */
+static int hosted()
+{
+   return localHost >= 0 && current_coroutine() >= 0;
+}
+
+/* time of the calendar events: simulated in virtual time, elapsed (ms) in real time */
+static long clock_now()
+{
+   return simClock->virtualTime ? simClock->now : now_sim_clock();
+}
+
+static void lock()
+{
+   psem_wait(&simClock->mutex);
+}
+
+static void unlock()
+{
+   psem_post(&simClock->mutex);
+}
+
+/* real time timed wait, in the waiting list of sem, of an entity not hosted (0 if t expired first) */
+static int listed_timedwait(ClockSem* sem, const struct timespec* t)
+{
+   int entity = self();
+   require (entity >= 0, "only barbers and clients may block with coroutine hosts");
+
+   lock();
+   if (sem->value > 0)
+   {
+      sem->value--;
+      unlock();
+      return 1;
+   }
+   simClock->next[entity] = -1;
+   if (sem->last == -1)
+      sem->first = entity;
+   else
+      simClock->next[sem->last] = entity;
+   sem->last = entity;
+   simClock->timedSem[entity] = sem;
+   unlock();
+   if (psem_timedwait(&simClock->wakeup[entity], t))
+      return 1;
+   // whichever comes first (post or expiration) cancels the other
+   lock();
+   int expired = simClock->timedSem[entity] == sem;
+   if (expired)
+   {
+      unlink_waiter(sem, entity);
+      simClock->timedSem[entity] = NULL;
+   }
+   unlock();
+   if (!expired)
+      psem_wait(&simClock->wakeup[entity]); // posted meanwhile
+   return !expired;
+}
+
+/* block until the clock wakes up entity (the caller) */
+static void wait_wakeup(int entity)
+{
+   if (simClock->host[entity] == -1)
+      psem_wait(&simClock->wakeup[entity]);
+   else
+      suspend_coroutine();
+}
+
+/* (mutex must be locked) */
+static void post_wakeup(int entity)
+{
+   int host = simClock->host[entity];
+   if (host == -1)
+      psem_post(&simClock->wakeup[entity]);
+   else if (host == localHost)
+      resume_coroutine(entity-localFirst);
+   else
+   {
+      simClock->next[entity] = simClock->hostPending[host];
+      simClock->hostPending[host] = entity;
+      psem_post(&simClock->hostWakeup[host]);
+   }
+}
+
+/* virtual time (or hosted real time) delay of the current entity (no effect outside entities) */
+static void delay(long ms)
+{
+   int entity = self();
+   if (entity >= 0 && ms > 0)
+   {
+      lock();
+      ClockEvent event = {clock_now()+ms, simClock->seq++, entity};
+      push_event(event);
+      block_current();
+      unlock();
+      wait_wakeup(entity);
+   }
+}
+
+/* current entity can no longer progress (mutex must be locked) */
+static void block_current()
+{
+   if (!simClock->virtualTime) // (real time progresses by itself)
+      return;
+   simClock->active--;
+   check (simClock->active >= 0, "");
+   if (simClock->active == 0)
+      advance();
+}
+
+/* no entity is able to progress: jump to the next wakeup time (mutex must be locked) */
+static void advance()
+{
+   if (simClock->calendarSize > 0)
+   {
+      __atomic_store_n(&simClock->now, simClock->calendar[0].time, __ATOMIC_RELAXED); // (also peeked unlocked)
+      wake_due(simClock->now);
+   }
+}
+
+/* wake up the entities of the calendar events due at now (mutex must be locked) */
+static void wake_due(long now)
+{
+   while(simClock->calendarSize > 0 && simClock->calendar[0].time <= now)
+   {
+      ClockEvent event = pop_event();
+      if (simClock->timedSem[event.entity] != NULL) // timed wait expired
+      {
+         unlink_waiter(simClock->timedSem[event.entity], event.entity);
+         simClock->timedSem[event.entity] = NULL;
+         simClock->expired[event.entity] = 1;
+      }
+      simClock->active++;
+      post_wakeup(event.entity);
+   }
+}
+
+static int before(ClockEvent* e1, ClockEvent* e2)
+{
+   return e1->time < e2->time || (e1->time == e2->time && e1->seq < e2->seq);
+}
+
+static void push_event(ClockEvent event)
+{
+   check (simClock->calendarSize < simClock->totalEntities, "");
+
+   sift_event(simClock->calendarSize++, event);
+}
+
+static ClockEvent pop_event()
+{
+   check (simClock->calendarSize > 0, "");
+
+   ClockEvent res = simClock->calendar[0];
+   simClock->slot[res.entity] = -1;
+   ClockEvent last = simClock->calendar[--simClock->calendarSize];
+   if (simClock->calendarSize > 0)
+      sift_event(0, last);
+   return res;
+}
+
+/* cancel the pending wakeup of an entity */
+static void remove_event(int entity)
+{
+   int i = simClock->slot[entity];
+   check (i >= 0 && i < simClock->calendarSize, "");
+
+   simClock->slot[entity] = -1;
+   ClockEvent last = simClock->calendar[--simClock->calendarSize];
+   if (i < simClock->calendarSize)
+      sift_event(i, last);
+}
+
+static void place_event(int i, ClockEvent event)
+{
+   simClock->calendar[i] = event;
+   simClock->slot[event.entity] = i;
+}
+
+/* put event in the (free) position i of the heap, moving it up or down as required */
+static void sift_event(int i, ClockEvent event)
+{
+   while(i > 0 && before(&event, &simClock->calendar[(i-1)/2]))
+   {
+      place_event(i, simClock->calendar[(i-1)/2]);
+      i = (i-1)/2;
+   }
+   for(;;)
+   {
+      int child = 2*i+1;
+      if (child >= simClock->calendarSize)
+         break;
+      if (child+1 < simClock->calendarSize && before(&simClock->calendar[child+1], &simClock->calendar[child]))
+         child++;
+      if (!before(&simClock->calendar[child], &event))
+         break;
+      place_event(i, simClock->calendar[child]);
+      i = child;
+   }
+   place_event(i, event);
+}
+
+/* remove entity from the waiting list of sem */
+static void unlink_waiter(ClockSem* sem, int entity)
+{
+   int prev = -1;
+   int e = sem->first;
+   while(e != entity)
+   {
+      check (e != -1, "");
+      prev = e;
+      e = simClock->next[e];
+   }
+   if (prev == -1)
+      sem->first = simClock->next[entity];
+   else
+      simClock->next[prev] = simClock->next[entity];
+   if (sem->last == entity)
+      sem->last = prev;
+   simClock->next[entity] = -1;
+}
@@ -0,0 +1,110 @@
+/**
+ * \brief simulation clock (real or virtual time)
+ *
+ * Every delay and every blocking wait of barbers and clients goes through
+ * this module.  In real time they are plain sleeps and POSIX semaphores.
+ * In virtual time a delay becomes a timestamped wakeup in a global event
+ * calendar, and the clock jumps to the earliest wakeup as soon as no entity
+ * is able to progress (all of them are either delayed or blocked).
+ * Entities may also be coroutines of a host process (a contiguous range of
+ * entities, the first one being its coroutine 0): blocking then suspends the
+ * coroutine instead of its worker thread, and a wakeup posted from another
+ * process is handed to the host through its pending list.  With hosts, real
+ * time waits also go through the waiting lists of the clock, and a hosted
+ * delay is a calendar event at its real time, woken by whichever host is
+ * idle when it is due.
+ * The pace of the model is a random vitality delay per step of a barber or
+ * client (each change it makes to its state or to the shop), taken
+ * explicitly, so logging those changes never delays anyone.
+ */
+
+#ifndef SIM_CLOCK_H
+#define SIM_CLOCK_H
+
+#include <semaphore.h>
+#include "global.h"
+
+typedef struct _ClockEvent_
+{
+   long time;   // simulated time (ms) of the wakeup
+   long seq;    // insertion order (FIFO among equal times)
+   int entity;
+} ClockEvent;
+
+/* semaphore aware of the simulation clock */
+typedef struct _ClockSem_
+{
+   sem_t sem;        // real time
+   int value;        // virtual time
+   int first;        // virtual time: FIFO of waiting entities (-1 if empty)
+   int last;
+} ClockSem;
+
+/* word awaited to change by one entity at a time (a futex in real time) */
+typedef struct _ClockWord_
+{
+   int value;
+   int waiters;      // real time: threads waiting in the futex
+   int waiter;       // virtual time: waiting entity (-1 if none)
+} ClockWord;
+
+typedef struct _SimClock_
+{
+   int virtualTime;
+   int pshared;
+   struct timespec start;
+
+   // virtual time:
+   sem_t mutex;
+   long now;                              // simulated time (ms)
+   long seq;
+   int totalEntities;
+   int numEntities;                       // entities not yet terminated
+   int active;                            // entities able to progress
+   int calendarSize;
+   ClockEvent* calendar;                  // [totalEntities] binary heap ordered by (time, seq)
+   sem_t* wakeup;                         // [totalEntities]
+   int* next;                             // [totalEntities] links of semaphores waiting lists
+   int* slot;                             // [totalEntities] calendar position of each entity wakeup (-1 if none)
+   ClockSem** timedSem;                   // [totalEntities] semaphore of a timed wait (NULL if none)
+   int* expired;                          // [totalEntities] last timed wait has expired
+
+   // coroutine hosts (virtual time):
+   int numHosts;
+   int* host;                             // [totalEntities] host running the entity as a coroutine (-1 if none)
+   sem_t* hostWakeup;                     // [numHosts] pending list not empty
+   int* hostPending;                      // [numHosts] entities woken (linked through next, -1 if empty)
+} SimClock;
+
+size_t sizeof_sim_clock_arrays(int num_entities, int num_hosts);
+void init_sim_clock(SimClock* clock, int num_entities, int num_hosts, int virtual_time, int pshared, Storage* storage);
+void term_sim_clock(SimClock* clock);
+
+void assign_sim_clock_host(int host, int first_entity, int num_entities);
+void host_sim_clock(int host);    // calling process runs the entities of host as its coroutines
+void wait_host_sim_clock();       // (hosting process, no coroutine runnable) resume the next entities woken
+                                  // (in real time, also those whose delays are due)
+
+void enter_sim_clock(int entity); // calling thread/process/coroutine becomes the entity
+void leave_sim_clock();
+
+int virtual_time_sim_clock();
+long now_sim_clock();             // ms since the simulation start
+long peek_sim_clock();            // (same, without locking: a timestamp possibly just behind the clock)
+
+void spend_sim_clock(int time_units);
+void pace_sim_clock();            // a step of the calling barber/client (a random vitality time)
+void sleep_sim_clock(int seconds);
+
+void clock_sem_init(ClockSem* sem, unsigned int value);
+void clock_sem_destroy(ClockSem* sem);
+void clock_sem_wait(ClockSem* sem);
+int clock_sem_timedwait(ClockSem* sem, int time_units); // 0 if time_units expired before decrementing
+void clock_sem_post(ClockSem* sem);
+
+void clock_word_init(ClockWord* word, int value);
+int clock_word_load(ClockWord* word);
+void clock_word_wait(ClockWord* word, int value); // blocks only while it still holds value
+void clock_word_store(ClockWord* word, int value);
+
+#endif
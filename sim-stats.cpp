@@ -0,0 +1,195 @@
+#include <stdlib.h>
+#include "dbc.h"
+#include "global.h"
+#include "utils.h"
+#include "sim-stats.h"
+
+static SimStats* simStats = NULL; // shared by all processes (inherited through fork)
+
+static void init_series(StatsSeries* series);
+static void add_sample(StatsSeries* series, long ms);
+static void json_series(FILE* out, const char* indent, const char* name, StatsSeries* series);
+static long percentile(StatsSeries* series, int p);
+static int compare_long(const void* a, const void* b);
+
+size_t sizeof_sim_stats_arrays(int num_barbers)
+{
+   require (num_barbers > 0, concat_3str("invalid number of barbers (", int2str(num_barbers), ")"));
+
+   return storage_size(num_barbers*sizeof(long));
+}
+
+void init_sim_stats(SimStats* stats, int num_barbers, int pshared, Storage* storage)
+{
+   require (stats != NULL, "stats argument required");
+   require (num_barbers > 0, concat_3str("invalid number of barbers (", int2str(num_barbers), ")"));
+   require (storage != NULL, "storage argument required");
+
+   psem_init(&stats->mutex, pshared, 1);
+   stats->numBarbers = num_barbers;
+   stats->clientsServed = 0;
+   stats->clientsGaveUp = 0;
+   init_series(&stats->benchTime);
+   init_series(&stats->haircutTime);
+   init_series(&stats->washHairTime);
+   init_series(&stats->shaveTime);
+   stats->barberBusyTime = (long*)storage_alloc(storage, num_barbers*sizeof(long));
+   for(int i = 0; i < num_barbers; i++)
+      stats->barberBusyTime[i] = 0;
+
+   simStats = stats;
+}
+
+void term_sim_stats(SimStats* stats)
+{
+   require (stats != NULL, "stats argument required");
+
+   psem_destroy(&stats->mutex);
+   simStats = NULL;
+}
+
+void client_served_sim_stats()
+{
+   require (simStats != NULL, "stats not initialized");
+
+   psem_wait(&simStats->mutex);
+   simStats->clientsServed++;
+   psem_post(&simStats->mutex);
+}
+
+void client_gave_up_sim_stats()
+{
+   require (simStats != NULL, "stats not initialized");
+
+   psem_wait(&simStats->mutex);
+   simStats->clientsGaveUp++;
+   psem_post(&simStats->mutex);
+}
+
+void bench_time_sim_stats(long ms)
+{
+   require (simStats != NULL, "stats not initialized");
+
+   psem_wait(&simStats->mutex);
+   add_sample(&simStats->benchTime, ms);
+   psem_post(&simStats->mutex);
+}
+
+void service_time_sim_stats(int request, long ms)
+{
+   require (simStats != NULL, "stats not initialized");
+   require (request == HAIRCUT_REQ || request == WASH_HAIR_REQ || request == SHAVE_REQ, concat_3str("invalid request (", int2str(request), ")"));
+
+   psem_wait(&simStats->mutex);
+   switch(request)
+   {
+      case HAIRCUT_REQ:   add_sample(&simStats->haircutTime, ms); break;
+      case WASH_HAIR_REQ: add_sample(&simStats->washHairTime, ms); break;
+      case SHAVE_REQ:     add_sample(&simStats->shaveTime, ms); break;
+   }
+   psem_post(&simStats->mutex);
+}
+
+void busy_time_sim_stats(int barberID, long ms)
+{
+   require (simStats != NULL, "stats not initialized");
+   require (barberID > 0 && barberID <= simStats->numBarbers, concat_3str("invalid barber id (", int2str(barberID), ")"));
+
+   psem_wait(&simStats->mutex);
+   simStats->barberBusyTime[barberID-1] += ms;
+   psem_post(&simStats->mutex);
+}
+
+void json_sim_stats(FILE* out, long elapsed_ms)
+{
+   require (simStats != NULL, "stats not initialized");
+   require (out != NULL, "output file argument required");
+
+   double seconds = elapsed_ms/1000.0;
+   fprintf(out, "{\n");
+   fprintf(out, "    \"elapsed_s\": %.3f,\n", seconds);
+   fprintf(out, "    \"clients_served\": %ld,\n", simStats->clientsServed);
+   fprintf(out, "    \"clients_served_per_s\": %.3f,\n", seconds > 0 ? simStats->clientsServed/seconds : 0.0);
+   fprintf(out, "    \"clients_gave_up\": %ld,\n", simStats->clientsGaveUp);
+   json_series(out, "    ", "bench_time", &simStats->benchTime);
+   fprintf(out, ",\n    \"service_time\": {\n");
+   json_series(out, "      ", "haircut", &simStats->haircutTime);
+   fprintf(out, ",\n");
+   json_series(out, "      ", "wash_hair", &simStats->washHairTime);
+   fprintf(out, ",\n");
+   json_series(out, "      ", "shave", &simStats->shaveTime);
+   fprintf(out, "\n    },\n");
+   double total = 0.0;
+   fprintf(out, "    \"barber_utilisation\": [");
+   for(int i = 0; i < simStats->numBarbers; i++)
+   {
+      double u = elapsed_ms > 0 ? (double)simStats->barberBusyTime[i]/elapsed_ms : 0.0;
+      total += u;
+      fprintf(out, "%s%.4f", i > 0 ? ", " : "", u);
+   }
+   fprintf(out, "],\n");
+   fprintf(out, "    \"mean_barber_utilisation\": %.4f\n", total/simStats->numBarbers);
+   fprintf(out, "  }");
+}
+
+static void init_series(StatsSeries* series)
+{
+   series->count = 0;
+   series->sum = 0.0;
+   series->max = 0;
+   series->numSamples = 0;
+}
+
+/* uniform reservoir sample (algorithm R) */
+static void add_sample(StatsSeries* series, long ms)
+{
+   series->count++;
+   series->sum += ms;
+   if (ms > series->max)
+      series->max = ms;
+   if (series->numSamples < MAX_STATS_SAMPLES)
+      series->samples[series->numSamples++] = ms;
+   else
+   {
+      long r = random() % series->count;
+      if (r < MAX_STATS_SAMPLES)
+         series->samples[r] = ms;
+   }
+}
+
+static void json_series(FILE* out, const char* indent, const char* name, StatsSeries* series)
+{
+   qsort(series->samples, series->numSamples, sizeof(long), compare_long);
+   fprintf(out, "%s\"%s\": {\"count\": %ld, \"mean_ms\": %.3f, \"p50_ms\": %ld, \"p99_ms\": %ld, \"max_ms\": %ld}",
+           indent, name, series->count, series->count > 0 ? series->sum/series->count : 0.0,
+           percentile(series, 50), percentile(series, 99), series->max);
+}
+
+/* one report line of the client benches time */
+void report_bench_time_sim_stats(FILE* out)
+{
+   require (simStats != NULL, "stats not initialized");
+   require (out != NULL, "output file argument required");
+
+   StatsSeries* series = &simStats->benchTime;
+   qsort(series->samples, series->numSamples, sizeof(long), compare_long);
+   fprintf(out, "  client benches time: %.1f ms mean, %ld ms p50, %ld ms p99, %ld ms max (%ld clients)\n",
+           series->count > 0 ? series->sum/series->count : 0.0, percentile(series, 50), percentile(series, 99),
+           series->max, series->count);
+}
+
+/* nearest-rank percentile of the (sorted) samples */
+static long percentile(StatsSeries* series, int p)
+{
+   if (series->numSamples == 0)
+      return 0;
+   int rank = (p*series->numSamples+99)/100;
+   return series->samples[rank > 0 ? rank-1 : 0];
+}
+
+static int compare_long(const void* a, const void* b)
+{
+   long x = *(const long*)a;
+   long y = *(const long*)b;
+   return x < y ? -1 : x > y;
+}
@@ -0,0 +1,55 @@
+/**
+ * \brief simulation statistics
+ *
+ * Throughput and latency measurements shared by all barbers and clients
+ * (times measured with the simulation clock, hence valid in real and in
+ * virtual time).  Latency distributions keep a bounded uniform sample
+ * (reservoir) so that percentiles need no per-run allocation.
+ */
+
+#ifndef SIM_STATS_H
+#define SIM_STATS_H
+
+#include <stdio.h>
+#include <semaphore.h>
+#include "global.h"
+
+#define MAX_STATS_SAMPLES 4096
+
+typedef struct _StatsSeries_
+{
+   long count;
+   double sum;                         // ms
+   long max;                           // ms
+   int numSamples;
+   long samples[MAX_STATS_SAMPLES];    // ms (reservoir)
+} StatsSeries;
+
+typedef struct _SimStats_
+{
+   sem_t mutex;
+   int numBarbers;
+
+   long clientsServed;                 // completed trips to the barber shop
+   long clientsGaveUp;                 // trips given up waiting for a client benches seat
+   StatsSeries benchTime;              // seated in client benches
+   StatsSeries haircutTime;
+   StatsSeries washHairTime;
+   StatsSeries shaveTime;
+   long* barberBusyTime;               // [numBarbers] ms attending clients
+} SimStats;
+
+size_t sizeof_sim_stats_arrays(int num_barbers);
+void init_sim_stats(SimStats* stats, int num_barbers, int pshared, Storage* storage);
+void term_sim_stats(SimStats* stats);
+
+void client_served_sim_stats();
+void client_gave_up_sim_stats();
+void bench_time_sim_stats(long ms);
+void service_time_sim_stats(int request, long ms);
+void busy_time_sim_stats(int barberID, long ms);
+
+void json_sim_stats(FILE* out, long elapsed_ms); // JSON object (sorts the samples)
+void report_bench_time_sim_stats(FILE* out);       // one report line (sorts the samples)
+
+#endif
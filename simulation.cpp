@@ -13,6 +13,7 @@
 #include <string.h>
 #include <time.h>
 #include <sys/wait.h>
+#include <sys/resource.h>
 #include <fcntl.h> 
 #include "dbc.h"
 #include "global.h"
@@ -20,9 +21,34 @@
 #include "box.h"
 #include "timer.h"
 #include "logger.h"
+#include "compositor.h"
 #include "barber.h"
 #include "client.h"
+#include "sim-clock.h"
+#include "sim-stats.h"
+#include "coroutine.h"
+#include "placement.h"
+#include "dispatch.h"
+#include "trace.h"
 
+// execution engines:
+#define PROCESS_ENGINE 0 // one process per barber/client (default)
+#define THREAD_ENGINE  1 // one thread per barber/client
+#define COROUTINE_ENGINE 2 // one coroutine per barber/client, run by a pool of worker threads (virtual time only)
+#define POOL_ENGINE    3 // one process per barber, clients are coroutines of a pool of worker processes
+
+static int engine = PROCESS_ENGINE;
+static int numWorkers = 0;        // coroutine/pool engine worker threads/processes (0: one per online core)
+static int virtualTime = 0;       // discrete-event (virtual) time instead of wall-clock time
+static int placementPolicy = PLACEMENT_NONE; // barbers/clients pinning to CPUs
+static int maxFps = DEFAULT_MAX_FPS;   // window mode frames per second (at most)
+static char* tracePath = NULL;         // binary event trace file (none if NULL)
+
+static SimClock *simClock;
+static SimStats *simStats;
+static Placement *placement;
+static Compositor *compositor = NULL;  // (window mode only)
+static Trace *trace = NULL;            // (if traced)
 static BarberShop *shop;
 static Barber* allBarbers = NULL;
 static Client* allClients = NULL;
@@ -33,19 +59,36 @@ static int logIdClientsDesc;
 static void help(char* prog, Parameters *params);
 static void processArgs(Parameters *params, int argc, char* argv[]);
 static void showParams(Parameters *params);
+static void showEngineReport();
+static void showSummary();
 static void go();
 // CreatChild function
-static void createChild(void* (*func)(void*), void* arg, pid_t * p);
+static void createChild(int unit, void* (*func)(void*), void* arg, pid_t * p);
 static void finish();
 static void initSimulation();
+static void termSimulation();
+static long residentSetSize(pid_t pid);
+static const char* engineName();
+static int sharedMemoryEngine();
+static void* main_client_pool(void* arg);
+static void* main_placed_barber(void* arg);
+static void* main_placed_client(void* arg);
+static void enter_unit(int unit);
+static void leave_unit(int unit);
 
 pid_t* barber_processes;
 pid_t* client_processes;
+pid_t* pool_processes;
+pthread_t* barber_threads;
+pthread_t* client_threads;
 sem_t* barber_chairs_semaphores;
 
-int shm_shop_id;
-int shm_barbers_id;
-int shm_clients_id;
+// engine measurements:
+static double startupTime;     // ms to launch all barbers and clients
+static long startupRSS;        // KB resident after launch (all processes)
+static long simulatedTime;     // ms of simulated time until the last client left
+
+int shm_id;
 
 int main(int argc, char* argv[])
 {
@@ -59,7 +102,7 @@ int main(int argc, char* argv[])
       5, 3, 10,
       //1, 10, 100,
       // clients:
-      10, 1, 3, 5, 30, 60, 30, 20
+      10, 1, 3, 5, 30, 60, 30, 20, -1
       //1, 1, 3, 10, 100, 60, 30, 20
    };
 
@@ -68,13 +111,21 @@ int main(int argc, char* argv[])
    global = (Parameters*)mem_alloc(sizeof(Parameters));
    *global = params;
    processArgs(global, argc, argv);
-   showParams(global);
-   printf("<press RETURN>");
-   getchar();
+   if (!global->HEADLESS)
+   {
+      showParams(global);
+      printf("<press RETURN>");
+      getchar();
+   }
 
    initSimulation();  
    go();
    finish();
+   if (global->HEADLESS)
+      showSummary();
+   else
+      showEngineReport();
+   termSimulation();
 
    return 0;
 }
@@ -88,31 +139,20 @@ static void go()
 
    require (allBarbers != NULL, "list of barbers data structures not created");
    require (allClients != NULL, "list of clients data structures not created");
-   
-   psem_init(&shop->mutex_barber_bench,1,1);                            //Sem to control the barbers bench
-   psem_init(&shop->mutex_client_bench,1,1);                            //sem to control the client_bench
-   psem_init(&shop->mutex_barber_chairs,1,1);                           //sem to control the barber chairs
-   psem_init(&shop->mutex_washbasins,1,1);                              //sem to control the washbasins
 
-   psem_init(&shop->sem_barber_chairs,1,global->NUM_BARBER_CHAIRS);     //Sem to control number of available barber chairs
-   psem_init(&shop->sem_scissors,1,global->NUM_SCISSORS);               //Sem to control number of available scissors
-   psem_init(&shop->sem_combs,1,global->NUM_COMBS);                     //Sem to control number of available combs
-   psem_init(&shop->sem_razors,1,global->NUM_RAZORS);                   //Sem to control number of available razors
-   psem_init(&shop->sem_washbasins,1,global->NUM_WASHBASINS);           //Sem to control number of available washbasins
+   clock_sem_init(&shop->mutex_barber_bench,1);                            //Sem to control the barbers bench
+   clock_sem_init(&shop->mutex_client_bench,1);                            //sem to control the client_bench
+
+   clock_sem_init(&shop->sem_clients_available,0);                         //Sem to wake idle barbers when a client sits in the benches
 
    //We will use semaphores to handle when the client is attended by the barber 
    //Meaning we will create an array of semaphores that correspond to the chairs in the watting room
       
-   for (int i=1; i <= MAX_CLIENTS; i++){
-      psem_init(&shop->sem_clients[i],1,0);                             //Sem to control handshake with barber
-   }
+   for (int i=0; i < global->NUM_CLIENT_BENCHES_SEATS; i++)
+      clock_sem_init(&shop->seatMailbox[i].greeting,0);                    //Sem to control handshake with barber (client seated there)
+
+   clock_sem_init(&shop->sem_benches_seat_handed,0);                       //Sem to hand over a freed client benches seat
 
-   for (int i=1; i <= MAX_BARBERS; i++) {
-      psem_init(&shop->sem_services[i],1,0);                            //Sem to control the service that the barber has assigned to the user
-      psem_init(&shop->sem_services_client[i],1,0);                     //Sem to control when the barber can start the service (the client has to seat first)
-      psem_init(&shop->sem_services_barber[i],1,0);                     //Sem to control when the barber has finished ONE service.
-      psem_init(&shop->sem_services_finish[i],1,0);                     //Sem to control when the barber has finished ALL the services.
-   }
 
 /*
    debug_log(shop,"-------------------------Started Simulation----------------------------");
@@ -144,67 +184,248 @@ static void go()
 
 */
 
-   //We have to create processes for the barbers and clients only
-   barber_processes = (pid_t*)mem_alloc(sizeof(pid_t) * global->NUM_BARBERS);
-   for(int i = 0; i < global->NUM_BARBERS; i++){      
-      createChild(main_barber, allBarbers+i,&barber_processes[i]);      
-   }
-   client_processes = (pid_t*)mem_alloc(sizeof(pid_t) * global->NUM_CLIENTS);
-   for(int i = 0; i < global->NUM_CLIENTS; i++) {
-      createChild(main_client, allClients+i,&client_processes[i]);
+   // the logger (window mode: the compositor), and the trace, must be running before any barber/client logs
+   if (trace != NULL)
+      start_trace(tracePath);
+   if (compositor != NULL)
+      launch_compositor();
+   else
+      launch_logger();
+   if (!global->HEADLESS)
+   {
+      compose_log(logIdBarbersDesc, (char*)"Barbers:");
+      compose_log(logIdClientsDesc, (char*)"Clients:");
    }
-
-   //debug_log(shop,"Finished Launching Processes");
-   
-
-
-   launch_logger();
-   char* descText;
-   descText = (char*)"Barbers:";
-   send_log(logIdBarbersDesc, (char*)descText);
-   descText = (char*)"Clients:";
-   send_log(logIdClientsDesc, (char*)descText);
    show_barber_shop(shop);
    for(int i = 0; i < global->NUM_BARBERS; i++)
       log_barber(allBarbers+i);
    for(int i = 0; i < global->NUM_CLIENTS; i++)
       log_client(allClients+i);
 
+   struct timespec t0, t1;
+   clock_gettime(CLOCK_MONOTONIC, &t0);
+
+   if (engine == COROUTINE_ENGINE)
+   {
+      for(int i = 0; i < global->NUM_BARBERS; i++)
+         create_coroutine(i, main_barber, allBarbers+i);
+      for(int i = 0; i < global->NUM_CLIENTS; i++)
+         create_coroutine(global->NUM_BARBERS+i, main_client, allClients+i);
+      on_coroutine_workers(enter_unit, leave_unit); // (the workers are the placement units)
+      start_coroutines();
+   }
+   else if (engine == THREAD_ENGINE)
+   {
+      barber_threads = (pthread_t*)mem_alloc(sizeof(pthread_t) * global->NUM_BARBERS);
+      for(int i = 0; i < global->NUM_BARBERS; i++)
+         thread_create(&barber_threads[i], NULL, main_placed_barber, allBarbers+i);
+      client_threads = (pthread_t*)mem_alloc(sizeof(pthread_t) * global->NUM_CLIENTS);
+      for(int i = 0; i < global->NUM_CLIENTS; i++)
+         thread_create(&client_threads[i], NULL, main_placed_client, allClients+i);
+   }
+   else if (engine == POOL_ENGINE)
+   {
+      barber_processes = (pid_t*)mem_alloc(sizeof(pid_t) * global->NUM_BARBERS);
+      for(int i = 0; i < global->NUM_BARBERS; i++)
+         createChild(i, main_barber, allBarbers+i, &barber_processes[i]);
+      pool_processes = (pid_t*)mem_alloc(sizeof(pid_t) * numWorkers);
+      for(int i = 0; i < numWorkers; i++)
+         createChild(global->NUM_BARBERS+i, main_client_pool, (void*)(long)i, &pool_processes[i]);
+   }
+   else
+   {
+      //We have to create processes for the barbers and clients only
+      barber_processes = (pid_t*)mem_alloc(sizeof(pid_t) * global->NUM_BARBERS);
+      for(int i = 0; i < global->NUM_BARBERS; i++){      
+         createChild(i, main_barber, allBarbers+i,&barber_processes[i]);      
+      }
+      client_processes = (pid_t*)mem_alloc(sizeof(pid_t) * global->NUM_CLIENTS);
+      for(int i = 0; i < global->NUM_CLIENTS; i++) {
+         createChild(global->NUM_BARBERS+i, main_client, allClients+i,&client_processes[i]);
+      }
+   }
+
+   clock_gettime(CLOCK_MONOTONIC, &t1);
+   startupTime = (t1.tv_sec-t0.tv_sec)*1000.0 + (t1.tv_nsec-t0.tv_nsec)/1000000.0;
+
+   //debug_log(shop,"Finished Launching Processes");
+
+
+   startupRSS = residentSetSize(getpid());
+   if (engine == PROCESS_ENGINE)
+   {
+      for(int i = 0; i < global->NUM_BARBERS; i++)
+         startupRSS += residentSetSize(barber_processes[i]);
+      for(int i = 0; i < global->NUM_CLIENTS; i++)
+         startupRSS += residentSetSize(client_processes[i]);
+   }
+   else if (engine == POOL_ENGINE)
+   {
+      for(int i = 0; i < global->NUM_BARBERS; i++)
+         startupRSS += residentSetSize(barber_processes[i]);
+      for(int i = 0; i < numWorkers; i++)
+         startupRSS += residentSetSize(pool_processes[i]);
+   }
+}
+
+/**
+ * pool worker process: runs its share of the clients as coroutines,
+ * advancing whichever of them the clock wakes up
+ */
+static void* main_client_pool(void* arg)
+{
+   int worker = (int)(long)arg;
+   int first = (int)((long)global->NUM_CLIENTS*worker/numWorkers);
+   int last = (int)((long)global->NUM_CLIENTS*(worker+1)/numWorkers);
+
+   host_sim_clock(worker);
+   init_coroutines(last-first, 1);
+   for(int i = first; i < last; i++)
+      create_coroutine(i-first, main_client, allClients+i);
+   run_coroutines(wait_host_sim_clock);
+   term_coroutines();
+   return NULL;
 }
 
-// CreateChild
-static void createChild(void* (*func)(void*), void* arg, pid_t * p) {
+/**
+ * barber/client thread, placed as its unit (barbers first)
+ */
+static void* main_placed_barber(void* arg)
+{
+   int unit = (int)((Barber*)arg - allBarbers);
+   enter_unit(unit);
+   main_barber(arg);
+   leave_unit(unit);
+   return NULL;
+}
+
+static void* main_placed_client(void* arg)
+{
+   int unit = global->NUM_BARBERS + (int)((Client*)arg - allClients);
+   enter_unit(unit);
+   main_client(arg);
+   leave_unit(unit);
+   return NULL;
+}
+
+/**
+ * a unit (barber/client process or thread, or worker) starts/ends running:
+ * placed, and tracing into its own ring
+ */
+static void enter_unit(int unit)
+{
+   enter_placement(unit);
+   if (trace != NULL)
+      enter_trace(unit);
+}
+
+static void leave_unit(int unit)
+{
+   leave_placement(unit);
+}
+
+// CreateChild (placed as the given unit)
+static void createChild(int unit, void* (*func)(void*), void* arg, pid_t * p) {
    int pid = pfork();
    if(pid == 0){
+      enter_unit(unit);
       func(arg);
+      leave_unit(unit);
       exit(EXIT_SUCCESS);
    } else
       *p = pid;
 }
 
+// resident set size (in KB) of a process (0 if already terminated)
+static long residentSetSize(pid_t pid)
+{
+   long res = 0;
+   char path[64];
+   sprintf(path, "/proc/%d/statm", pid);
+   FILE* f = fopen(path, "r");
+   if (f != NULL)
+   {
+      long size, resident;
+      if (fscanf(f, "%ld %ld", &size, &resident) == 2)
+         res = resident * (sysconf(_SC_PAGESIZE) / 1024);
+      fclose(f);
+   }
+   return res;
+}
+
 /**
  * synchronize with the termination of all active entities (barbers and clients), 
  */
 static void finish()
 {
-   pid_t pid;
    int status;
    /* TODO: change this function to your needs */
-   while ((pid=waitpid(-1,&status,0))!=-1) {
-   //      printf("Process %d terminated\n",pid);
-   }
+
    /*
-    CLEANUP
-    Using shmctl will not only detach the memory but also remove de fragment that was created
+    Barbers only leave when the shop is closed, and that can only happen when
+    every client has finished all its trips to the barber shop.
     */
-   shmctl(shm_clients_id, IPC_RMID, NULL);
-   shmctl(shm_barbers_id, IPC_RMID, NULL);
-   shmctl(shm_shop_id, IPC_RMID, NULL);
+   if (engine == COROUTINE_ENGINE)
+   {
+      for(int i = 0; i < global->NUM_CLIENTS; i++)
+         join_coroutine(global->NUM_BARBERS+i);
+      simulatedTime = now_sim_clock();
+      close_shop(shop);
+      for(int i = 0; i < global->NUM_BARBERS; i++)
+         join_coroutine(i);
+      stop_coroutines();
+   }
+   else if (engine == POOL_ENGINE)
+   {
+      for(int i = 0; i < numWorkers; i++)
+         pwaitpid(pool_processes[i], &status, 0);
+      simulatedTime = now_sim_clock();
+      close_shop(shop);
+      for(int i = 0; i < global->NUM_BARBERS; i++)
+         pwaitpid(barber_processes[i], &status, 0);
+   }
+   else if (engine == THREAD_ENGINE)
+   {
+      for(int i = 0; i < global->NUM_CLIENTS; i++)
+         thread_join(client_threads[i], NULL);
+      simulatedTime = now_sim_clock();
+      close_shop(shop);
+      for(int i = 0; i < global->NUM_BARBERS; i++)
+         thread_join(barber_threads[i], NULL);
+   }
+   else
+   {
+      for(int i = 0; i < global->NUM_CLIENTS; i++)
+         pwaitpid(client_processes[i], &status, 0);
+      simulatedTime = now_sim_clock();
+      close_shop(shop);
+      for(int i = 0; i < global->NUM_BARBERS; i++)
+         pwaitpid(barber_processes[i], &status, 0);
+   }
+
+   if (trace != NULL)
+      stop_trace();
+   if (compositor != NULL)
+      term_compositor();
+   else
+      term_logger();
+}
 
-   fclose(shop->log_file);
+static void termSimulation()
+{
+   term_sim_stats(simStats);
+   term_sim_clock(simClock);
 
-   
-   term_logger();
+   if (engine == COROUTINE_ENGINE)
+      term_coroutines();
+   else if (sharedMemoryEngine())
+   {
+      /*
+       CLEANUP
+       Using shmctl will not only detach the memory but also remove de fragment that was created
+       */
+      shmctl(shm_id, IPC_RMID, NULL);
+   }
 }
 
 static void initSimulation()
@@ -217,16 +438,107 @@ static void initSimulation()
    
    */
 
-   srand(time(0));
-   init_process_logger();
+   srand(time(0) ^ getpid()); // concurrent runs (see sweep) must not share the same seed
+   // (window mode logs are composited, the logger only keeps the registered windows)
+   if (!sharedMemoryEngine() || !line_mode_logger())
+      init_thread_logger();
+   else
+      init_process_logger();
    logger_filter_out_boxes();
 
-   shm_shop_id = pshmget(SHM_SHOP_KEY,sizeof(BarberShop),0644|IPC_CREAT);
-   shop = (BarberShop*)shmat(shm_shop_id, NULL, 0);
-  
+   // all runtime sized state in one block, sized from the parameters;
+   // threads share the address space, so only processes require shared memory
+   // (a private segment, inherited by the children, so that simultaneous runs never collide)
+   int numEntities = global->NUM_BARBERS+global->NUM_CLIENTS;
+   int numHosts = 0;
+   if (engine == COROUTINE_ENGINE || engine == POOL_ENGINE)
+   {
+      if (numWorkers == 0)
+         numWorkers = (int)sysconf(_SC_NPROCESSORS_ONLN);
+      if (engine == POOL_ENGINE && numWorkers > global->NUM_CLIENTS)
+         numWorkers = global->NUM_CLIENTS;
+      numHosts = engine == POOL_ENGINE ? numWorkers : 1;
+   }
+   if (engine == COROUTINE_ENGINE)
+      init_coroutines(numEntities, numWorkers);
+   // placement units: barber processes/threads, and client processes/threads or the workers running them
+   int numBarberUnits = engine == COROUTINE_ENGINE ? 0 : global->NUM_BARBERS;
+   int numClientUnits = engine == COROUTINE_ENGINE || engine == POOL_ENGINE ? numWorkers : global->NUM_CLIENTS;
+   // the rendered screen: the shop, then the barbers and the clients (each row after its title line)
+   int screenLines = 0, screenColumns = 0;
+   if (!line_mode_logger())
+   {
+      screenLines = layout_lines_barber_shop(global->NUM_CLIENT_BENCHES)+1+num_lines_barber()+1+num_lines_client();
+      screenColumns = layout_columns_barber_shop();
+      if (screenColumns < global->NUM_BARBERS*num_columns_barber())
+         screenColumns = global->NUM_BARBERS*num_columns_barber();
+      if (screenColumns < global->NUM_CLIENTS*num_columns_client())
+         screenColumns = global->NUM_CLIENTS*num_columns_client();
+   }
+   size_t size = storage_size(sizeof(SimClock)) + sizeof_sim_clock_arrays(numEntities, numHosts) +
+                 storage_size(sizeof(SimStats)) + sizeof_sim_stats_arrays(global->NUM_BARBERS) +
+                 storage_size(sizeof(Placement)) + sizeof_placement_arrays(numBarberUnits, numClientUnits) +
+                 (screenLines > 0 ? storage_size(sizeof(Compositor)) + sizeof_compositor_arrays(screenLines, screenColumns) : 0) +
+                 (tracePath != NULL ? storage_size(sizeof(Trace)) + sizeof_trace_arrays(numBarberUnits+numClientUnits+1) : 0) +
+                 storage_size(sizeof(BarberShop)) +
+                 sizeof_barber_shop_arrays(global->NUM_BARBERS, global->NUM_BARBER_CHAIRS, global->NUM_WASHBASINS,
+                                           global->NUM_CLIENT_BENCHES_SEATS, global->NUM_CLIENTS) +
+                 storage_size(sizeof_barber()*global->NUM_BARBERS) +
+                 storage_size(sizeof_client()*global->NUM_CLIENTS);
+   void* mem;
+   if (!sharedMemoryEngine())
+   {
+      size_t pageSize = sysconf(_SC_PAGESIZE); // (page aligned, as the placement requires)
+      mem = aligned_alloc(pageSize, (size+pageSize-1)/pageSize*pageSize);
+   }
+   else
+   {
+      shm_id = pshmget(IPC_PRIVATE,size,0600|IPC_CREAT);
+      mem = pshmat(shm_id, NULL, 0);
+   }
+   Storage storage;
+   init_storage(&storage, mem, size);
+
+   simClock = (SimClock*)storage_alloc(&storage, sizeof(SimClock));
+   init_sim_clock(simClock, numEntities, numHosts, virtualTime, sharedMemoryEngine(), &storage);
+   if (engine == COROUTINE_ENGINE)
+   {
+      // the coroutine of each barber/client is its clock entity
+      assign_sim_clock_host(0, 0, numEntities);
+      host_sim_clock(0);
+   }
+   else if (engine == POOL_ENGINE)
+      for(int i = 0; i < numWorkers; i++)
+      {
+         int first = (int)((long)global->NUM_CLIENTS*i/numWorkers);
+         int last = (int)((long)global->NUM_CLIENTS*(i+1)/numWorkers);
+         assign_sim_clock_host(i, global->NUM_BARBERS+first, last-first);
+      }
+
+   simStats = (SimStats*)storage_alloc(&storage, sizeof(SimStats));
+   init_sim_stats(simStats, global->NUM_BARBERS, sharedMemoryEngine(), &storage);
+
+   placement = (Placement*)storage_alloc(&storage, sizeof(Placement));
+   init_placement(placement, placementPolicy, numBarberUnits, numClientUnits, &storage);
+
+   if (screenLines > 0)
+   {
+      compositor = (Compositor*)storage_alloc(&storage, sizeof(Compositor));
+      init_compositor(compositor, screenLines, screenColumns, maxFps, sharedMemoryEngine(), &storage);
+   }
+
+   if (tracePath != NULL)
+   {
+      // a ring per placement unit, and one for the main process
+      trace = (Trace*)storage_alloc(&storage, sizeof(Trace));
+      init_trace(trace, numBarberUnits+numClientUnits+1, &storage);
+   }
+
+   shop = (BarberShop*)storage_alloc(&storage, sizeof(BarberShop));
    init_barber_shop(shop, global->NUM_BARBERS, global->NUM_BARBER_CHAIRS,
                     global->NUM_SCISSORS, global->NUM_COMBS, global->NUM_RAZORS, global->NUM_WASHBASINS,
-                    global->NUM_CLIENT_BENCHES_SEATS, global->NUM_CLIENT_BENCHES);
+                    global->NUM_CLIENT_BENCHES_SEATS, global->NUM_CLIENT_BENCHES,
+                    global->NUM_CLIENTS, &storage);
 
    char* descText;
    descText = (char*)"Barbers:";
@@ -236,8 +548,7 @@ static void initSimulation()
    };
    logIdBarbersDesc = register_logger(descText, num_lines_barber_shop(shop) ,0 , 1, strlen(descText), translationsBarbers);
    
-   shm_barbers_id = pshmget(SHM_BARBERS_KEY,sizeof_barber()*global->NUM_BARBERS,0644|IPC_CREAT);
-   allBarbers = (Barber*)shmat(shm_barbers_id, NULL, 0);
+   allBarbers = (Barber*)storage_alloc(&storage, sizeof_barber()*global->NUM_BARBERS);
    
    for(int i = 0; i < global->NUM_BARBERS; i++)
       init_barber(allBarbers+i, i+1, shop, num_lines_barber_shop(shop)+1, i*num_columns_barber());
@@ -249,12 +560,13 @@ static void initSimulation()
    };
    logIdClientsDesc = register_logger(descText, num_lines_barber_shop(shop)+1+num_lines_barber() ,0 , 1, strlen(descText), translationsClients);
    
-   shm_clients_id = pshmget(SHM_CLIENTS_KEY,sizeof_client()*global->NUM_CLIENTS,0644|IPC_CREAT);
-   allClients = (Client*)shmat(shm_clients_id, NULL, 0);
+   allClients = (Client*)storage_alloc(&storage, sizeof_client()*global->NUM_CLIENTS);
 
    for(int i = 0; i < global->NUM_CLIENTS; i++)
       init_client(allClients+i, i+1, shop, random_int(global->MIN_BARBER_SHOP_TRIPS, global->MAX_BARBER_SHOP_TRIPS), num_lines_barber_shop(shop)+1+num_lines_barber()+1, i*num_columns_client());
 
+   place_memory(mem, size);
+
 
 
 }
@@ -275,6 +587,34 @@ static void help(char* prog, Parameters *params)
    printf("  -h,--help                                   show this help\n");
    printf("  -l,--line-mode\n");
    printf("  -w,--window-mode (default)\n");
+   printf("  -e,--engine=<process|threads|coroutines|pool>\n");
+   printf("     one process (default), one thread or one coroutine per barber/client,\n");
+   printf("     or one process per barber and a pool of worker processes running the clients\n");
+   printf("     (coroutines requires --virtual-time)\n");
+   printf("  -W,--workers <N>\n");
+   printf("     worker threads (coroutines) or processes (pool) running the clients\n");
+   printf("     (default is one per online core)\n");
+   printf("  -P,--placement <none|compact|scatter|barbers-isolated>\n");
+   printf("     pinning of barbers and clients (or the workers running them) to CPUs\n");
+   printf("     (default is none: left to the kernel; barbers-isolated requires barbers in\n");
+   printf("     processes or threads of their own)\n");
+   printf("  -D,--dispatch <fifo|sjf|aging|express>\n");
+   printf("     client an idle barber takes from the benches: the oldest (default), the one\n");
+   printf("     with fewest services, the highest (waiting+service)/service time ratio, or\n");
+   printf("     the oldest but with barber 1 taking single service clients first\n");
+   printf("  -B,--batch-chair-services\n");
+   printf("     a client's shave and haircut in a single visit to the same barber chair\n");
+   printf("     (only the tools are swapped between them)\n");
+   printf("  -F,--max-fps <N>\n");
+   printf("     window mode frames per second, at most (default is %d); each frame writes\n", DEFAULT_MAX_FPS);
+   printf("     only the screen cells changed since the previous one\n");
+   printf("  -T,--trace <FILE>\n");
+   printf("     record a binary trace of every barber/client state change into FILE\n");
+   printf("     (to be read with trace-decode)\n");
+   printf("  -H,--headless\n");
+   printf("     no prompt, no rendering (nor its size limits); prints a JSON summary at exit\n");
+   printf("  -V,--virtual-time\n");
+   printf("     discrete-event simulated time instead of real (wall-clock) time\n");
    printf("  -b,--num-barbers <N>\n");
    printf("     number of barbers (default is %d)\n", params->NUM_BARBERS);
    printf("  -n,--num-clients <N>\n");
@@ -293,6 +633,9 @@ static void help(char* prog, Parameters *params)
    printf("     min./max. number os trips to barber shop by each client (default is [%d,%d])\n",params->MIN_BARBER_SHOP_TRIPS, params->MAX_BARBER_SHOP_TRIPS);
    printf("  -5,--outside-time-units <MIN>,<MAX>\n");
    printf("     min./max. time units for each clients's activity outside the shop (default is [%d,%d])\n",params->MIN_OUTSIDE_TIME_UNITS, params->MAX_OUTSIDE_TIME_UNITS);
+   printf("  -6,--benches-wait-time-units <N>\n");
+   printf("     max. time units a client waits for a client benches seat before giving up (default is %s)\n",
+          params->MAX_BENCHES_WAIT_TIME_UNITS < 0 ? "no limit" : int2str(params->MAX_BENCHES_WAIT_TIME_UNITS));
    printf("  -p,--prob-requests <HAIRCUT>,<WASH_HAIR>,<SHAVE>\n");
    printf("     probability for a client to select each activity (default is [%d,%d,%d])\n",params->PROB_REQUEST_HAIRCUT, params->PROB_REQUEST_WASHHAIR, params->PROB_REQUEST_SHAVE);
    printf("  -v,--vitality-time-units <MIN>,<MAX>\n");
@@ -310,20 +653,30 @@ static void processArgs(Parameters *params, int argc, char* argv[])
    static struct option long_options[] =
    {
       {"help",                         no_argument,       NULL, 'h'},
-      {"--line-mode",                  no_argument,       NULL, 'l'},
-      {"--window-mode",                no_argument,       NULL, 'w'},
-      {"--num-barbers",                required_argument, NULL, 'b'},
-      {"--num-clients",                required_argument, NULL, 'n'},
-      {"--num-chairs",                 required_argument, NULL, 'c'},
-      {"--num-tools",                  required_argument, NULL, 't'},
-      {"--num-basins",                 required_argument, NULL, '1'},
-      {"--num-client-benches-seats",   required_argument, NULL, '2'},
-      {"--work-time-units",            required_argument, NULL, '3'},
-      {"--barber-shop-trips",          required_argument, NULL, '4'},
-      {"--outside-time-units",         required_argument, NULL, '5'},
-      {"--prob-requests",              required_argument, NULL, 'p'},
-      {"--vitality-time-units",        required_argument, NULL, 'v'},
-      {"--time-unit",                  required_argument, NULL, 'u'},
+      {"line-mode",                    no_argument,       NULL, 'l'},
+      {"window-mode",                  no_argument,       NULL, 'w'},
+      {"engine",                       required_argument, NULL, 'e'},
+      {"workers",                      required_argument, NULL, 'W'},
+      {"placement",                    required_argument, NULL, 'P'},
+      {"dispatch",                     required_argument, NULL, 'D'},
+      {"batch-chair-services",         no_argument,       NULL, 'B'},
+      {"max-fps",                      required_argument, NULL, 'F'},
+      {"trace",                        required_argument, NULL, 'T'},
+      {"headless",                     no_argument,       NULL, 'H'},
+      {"virtual-time",                 no_argument,       NULL, 'V'},
+      {"num-barbers",                  required_argument, NULL, 'b'},
+      {"num-clients",                  required_argument, NULL, 'n'},
+      {"num-chairs",                   required_argument, NULL, 'c'},
+      {"num-tools",                    required_argument, NULL, 't'},
+      {"num-basins",                   required_argument, NULL, '1'},
+      {"num-client-benches-seats",     required_argument, NULL, '2'},
+      {"work-time-units",              required_argument, NULL, '3'},
+      {"barber-shop-trips",            required_argument, NULL, '4'},
+      {"outside-time-units",           required_argument, NULL, '5'},
+      {"benches-wait-time-units",      required_argument, NULL, '6'},
+      {"prob-requests",                required_argument, NULL, 'p'},
+      {"vitality-time-units",          required_argument, NULL, 'v'},
+      {"time-units",                   required_argument, NULL, 'u'},
       {0, 0, NULL, 0}
    };
    int op=0;
@@ -332,7 +685,7 @@ static void processArgs(Parameters *params, int argc, char* argv[])
    {
       int option_index = 0;
 
-      op = getopt_long(argc, argv, "hlwb:n:c:t:1:2:3:4:5:p:v:u:", long_options, &option_index);
+      op = getopt_long(argc, argv, "hlwe:W:P:D:BF:T:HVb:n:c:t:1:2:3:4:5:6:p:v:u:", long_options, &option_index);
       int st,n,o,p,min,max;
       switch (op)
       {
@@ -353,9 +706,79 @@ static void processArgs(Parameters *params, int argc, char* argv[])
                set_window_mode_logger();
             break;
 
+         case 'e':
+            if (strcmp(optarg, "process") == 0 || strcmp(optarg, "processes") == 0)
+               engine = PROCESS_ENGINE;
+            else if (strcmp(optarg, "thread") == 0 || strcmp(optarg, "threads") == 0)
+               engine = THREAD_ENGINE;
+            else if (strcmp(optarg, "coroutine") == 0 || strcmp(optarg, "coroutines") == 0)
+               engine = COROUTINE_ENGINE;
+            else if (strcmp(optarg, "pool") == 0)
+               engine = POOL_ENGINE;
+            else
+            {
+               fprintf(stderr, "ERROR: invalid engine \"%s\"\n", optarg);
+               exit(EXIT_FAILURE);
+            }
+            break;
+
+         case 'W':
+            st = sscanf(optarg, "%d", &n);
+            if (st != 1 || n < 1)
+            {
+               fprintf(stderr, "ERROR: invalid number of workers \"%s\"\n", optarg);
+               exit(EXIT_FAILURE);
+            }
+            numWorkers = n;
+            break;
+
+         case 'P':
+            placementPolicy = placement_policy(optarg);
+            if (placementPolicy == -1)
+            {
+               fprintf(stderr, "ERROR: invalid placement \"%s\"\n", optarg);
+               exit(EXIT_FAILURE);
+            }
+            break;
+
+         case 'D':
+            params->DISPATCH_POLICY = dispatch_policy(optarg);
+            if (params->DISPATCH_POLICY == -1)
+            {
+               fprintf(stderr, "ERROR: invalid dispatch policy \"%s\"\n", optarg);
+               exit(EXIT_FAILURE);
+            }
+            break;
+
+         case 'B':
+            params->BATCH_CHAIR_SERVICES = 1;
+            break;
+
+         case 'F':
+            st = sscanf(optarg, "%d", &n);
+            if (st != 1 || n < 1 || n > 1000)
+            {
+               fprintf(stderr, "ERROR: invalid frame rate \"%s\" (1 to 1000)\n", optarg);
+               exit(EXIT_FAILURE);
+            }
+            maxFps = n;
+            break;
+
+         case 'T':
+            tracePath = optarg;
+            break;
+
+         case 'H':
+            params->HEADLESS = 1;
+            break;
+
+         case 'V':
+            virtualTime = 1;
+            break;
+
          case 'b':
             st = sscanf(optarg, "%d", &n);
-            if (st != 1 || n < 1 || n > MAX_BARBERS)
+            if (st != 1 || n < 1)
             {
                fprintf(stderr, "ERROR: invalid number of barbers \"%s\"\n", optarg);
                exit(EXIT_FAILURE);
@@ -365,7 +788,7 @@ static void processArgs(Parameters *params, int argc, char* argv[])
 
          case 'n':
             st = sscanf(optarg, "%d", &n);
-            if (st != 1 || n < 1 || n > MAX_CLIENTS)
+            if (st != 1 || n < 1)
             {
                fprintf(stderr, "ERROR: invalid number of clients \"%s\"\n", optarg);
                exit(EXIT_FAILURE);
@@ -375,7 +798,7 @@ static void processArgs(Parameters *params, int argc, char* argv[])
 
          case 'c':
             st = sscanf(optarg, "%d", &n);
-            if (st != 1 || n < 1 || n > MAX_BARBER_CHAIRS)
+            if (st != 1 || n < 1)
             {
                fprintf(stderr, "ERROR: invalid number of barber chairs \"%s\"\n", optarg);
                exit(EXIT_FAILURE);
@@ -385,7 +808,7 @@ static void processArgs(Parameters *params, int argc, char* argv[])
 
          case 't':
             st = sscanf(optarg, "%d,%d,%d", &n, &o, &p);
-            if (st != 3 || n < 1 || n > MAX_NUM_TOOLS || o < 1 || o > MAX_NUM_TOOLS || p < 1 || p > MAX_NUM_TOOLS)
+            if (st != 3 || n < 1 || o < 1 || p < 1)
             {
                fprintf(stderr, "ERROR: invalid number of tools \"%s\"\n", optarg);
                exit(EXIT_FAILURE);
@@ -397,7 +820,7 @@ static void processArgs(Parameters *params, int argc, char* argv[])
 
          case '1':
             st = sscanf(optarg, "%d", &n);
-            if (st != 1 || n < 1 || n > MAX_WASHBASINS)
+            if (st != 1 || n < 1)
             {
                fprintf(stderr, "ERROR: invalid number of washbasins \"%s\"\n", optarg);
                exit(EXIT_FAILURE);
@@ -407,7 +830,7 @@ static void processArgs(Parameters *params, int argc, char* argv[])
 
          case '2':
             st = sscanf(optarg, "%d,%d", &n, &o);
-            if (st != 2 || n < 1 || n > MAX_CLIENT_BENCHES_SEATS || o < 1 || o > n)
+            if (st != 2 || n < 1 || o < 1 || o > n)
             {
                fprintf(stderr, "ERROR: invalid number of client benches seats \"%s\"\n", optarg);
                exit(EXIT_FAILURE);
@@ -449,6 +872,16 @@ static void processArgs(Parameters *params, int argc, char* argv[])
             params->MAX_OUTSIDE_TIME_UNITS = max;
             break;
 
+         case '6':
+            st = sscanf(optarg, "%d", &n);
+            if (st != 1 || n < 0)
+            {
+               fprintf(stderr, "ERROR: invalid client benches wait time units \"%s\"\n", optarg);
+               exit(EXIT_FAILURE);
+            }
+            params->MAX_BENCHES_WAIT_TIME_UNITS = n;
+            break;
+
          case 'p':
             st = sscanf(optarg, "%d,%d,%d", &n, &o, &p);
             if (st != 3 || n < 0 || n > 100 || o < 0 || o > 100 || p < 0 || p > 100)
@@ -494,6 +927,38 @@ static void processArgs(Parameters *params, int argc, char* argv[])
       fprintf(stderr, "ERROR: invalid extra arguments\n");
       exit(EXIT_FAILURE);
    }
+
+   // coroutines suspend on the virtual clock (a real time wait would block its worker;
+   // only the single worker of a pool process waits for the real time wakeups of its clients)
+   if (engine == COROUTINE_ENGINE && !virtualTime)
+   {
+      fprintf(stderr, "ERROR: the %s engine requires --virtual-time\n", engineName());
+      exit(EXIT_FAILURE);
+   }
+
+   // coroutine barbers share the workers with the clients
+   if (engine == COROUTINE_ENGINE && placementPolicy == PLACEMENT_BARBERS_ISOLATED)
+   {
+      fprintf(stderr, "ERROR: the %s engine cannot isolate barbers (they run in the client workers)\n", engineName());
+      exit(EXIT_FAILURE);
+   }
+
+   // nothing is rendered in headless mode (window mode would still draw the screen)
+   if (params->HEADLESS && !line_mode_logger())
+      set_line_mode_logger();
+
+   // only headless runs go beyond the rendering limits
+   if (!params->HEADLESS &&
+       (params->NUM_BARBERS > MAX_BARBERS || params->NUM_CLIENTS > MAX_CLIENTS ||
+        params->NUM_BARBER_CHAIRS > MAX_BARBER_CHAIRS || params->NUM_WASHBASINS > MAX_WASHBASINS ||
+        params->NUM_SCISSORS > MAX_NUM_TOOLS || params->NUM_COMBS > MAX_NUM_TOOLS || params->NUM_RAZORS > MAX_NUM_TOOLS ||
+        params->NUM_CLIENT_BENCHES_SEATS > MAX_CLIENT_BENCHES_SEATS))
+   {
+      fprintf(stderr, "ERROR: at most %d barbers, %d clients, %d barber chairs, %d washbasins, %d tools of each kind\n"
+                      "       and %d client benches seats can be rendered (use --headless for larger shops)\n",
+              MAX_BARBERS, MAX_CLIENTS, MAX_BARBER_CHAIRS, MAX_WASHBASINS, MAX_NUM_TOOLS, MAX_CLIENT_BENCHES_SEATS);
+      exit(EXIT_FAILURE);
+   }
 }
 
 static void showParams(Parameters *params)
@@ -501,7 +966,8 @@ static void showParams(Parameters *params)
    require (params != NULL, "parameters argument required");
 
    printf("\n");
-   printf("Simulation parameters (%s):\n", line_mode_logger() ? "line mode" : "window mode");
+   printf("Simulation parameters (%s, %s engine, %s time, %s placement):\n", line_mode_logger() ? "line mode" : "window mode",
+          engineName(), virtualTime ? "virtual" : "real", placement_name(placementPolicy));
    printf("  --num-barbers: %d\n", params->NUM_BARBERS);
    printf("  --num-clients: %d\n", params->NUM_CLIENTS);
    printf("  --num-chairs: %d\n", params->NUM_BARBER_CHAIRS);
@@ -511,9 +977,96 @@ static void showParams(Parameters *params)
    printf("  --work-time-units: [%d,%d]\n", params->MIN_WORK_TIME_UNITS, params->MAX_WORK_TIME_UNITS);
    printf("  --barber-shop-trips: [%d,%d]\n", params->MIN_BARBER_SHOP_TRIPS, params->MAX_BARBER_SHOP_TRIPS);
    printf("  --outside-time-units: [%d,%d]\n", params->MIN_OUTSIDE_TIME_UNITS, params->MAX_OUTSIDE_TIME_UNITS);
+   if (params->MAX_BENCHES_WAIT_TIME_UNITS < 0)
+      printf("  --benches-wait-time-units: no limit\n");
+   else
+      printf("  --benches-wait-time-units: %d\n", params->MAX_BENCHES_WAIT_TIME_UNITS);
    printf("  --prob-requests: [haircut:%d,wash-hair:%d,shave:%d]\n", params->PROB_REQUEST_HAIRCUT, params->PROB_REQUEST_WASHHAIR, params->PROB_REQUEST_SHAVE);
    printf("  --vitality-time-units: [%d,%d]\n", params->MIN_VITALITY_TIME_UNITS, params->MAX_VITALITY_TIME_UNITS);
    printf("  --time-unit: %d ms\n", time_unit());
+   printf("  --max-fps: %d\n", maxFps);
+   printf("  --trace: %s\n", tracePath != NULL ? tracePath : "none");
+   printf("  --dispatch: %s\n", dispatch_policy_name(params->DISPATCH_POLICY));
+   printf("  --batch-chair-services: %s\n", params->BATCH_CHAIR_SERVICES ? "yes" : "no");
    printf("\n");
 }
 
+
+static void showEngineReport()
+{
+   struct rusage self, children;
+   getrusage(RUSAGE_SELF, &self);
+   getrusage(RUSAGE_CHILDREN, &children);
+   int numEntities = global->NUM_BARBERS + global->NUM_CLIENTS;
+   long voluntary = self.ru_nvcsw + children.ru_nvcsw;
+   long involuntary = self.ru_nivcsw + children.ru_nivcsw;
+
+   printf("\n");
+   printf("Engine report (%s, %d barbers, %d clients):\n", engineName(),
+          global->NUM_BARBERS, global->NUM_CLIENTS);
+   printf("  startup: %.3f ms (%.3f ms per entity)\n", startupTime, startupTime/numEntities);
+   printf("  resident memory after startup: %ld KB (%ld KB per entity)\n", startupRSS, startupRSS/numEntities);
+   printf("  peak resident memory: %ld KB (largest process)\n", self.ru_maxrss > children.ru_maxrss ? self.ru_maxrss : children.ru_maxrss);
+   printf("  context switches: %ld voluntary, %ld involuntary (%ld per entity)\n", voluntary, involuntary, (voluntary+involuntary)/numEntities);
+   printf("  %s time until the last client left: %.3f s\n", virtualTime ? "simulated" : "elapsed", simulatedTime/1000.0);
+   printf("  cpu time: %.3f s user, %.3f s system\n",
+          self.ru_utime.tv_sec + children.ru_utime.tv_sec + (self.ru_utime.tv_usec + children.ru_utime.tv_usec)/1000000.0,
+          self.ru_stime.tv_sec + children.ru_stime.tv_sec + (self.ru_stime.tv_usec + children.ru_stime.tv_usec)/1000000.0);
+   if (engine == COROUTINE_ENGINE)
+      for(int i = 0; i < num_coroutine_workers(); i++)
+      {
+         WorkerStats w = coroutine_worker_stats(i);
+         printf("  worker %d: %.1f%% busy, %ld runs, %ld steals\n", i, 100.0*w.utilisation, w.runs, w.steals);
+      }
+   report_placement(stdout);
+   if (compositor != NULL)
+      report_compositor(stdout);
+   printf("  dispatch: %s\n", dispatch_policy_name(global->DISPATCH_POLICY));
+   printf("  batch chair services: %s\n", global->BATCH_CHAIR_SERVICES ? "yes" : "no");
+   report_bench_time_sim_stats(stdout);
+   report_trace(stdout);
+   printf("\n");
+}
+
+/**
+ * headless run summary (JSON)
+ */
+static void showSummary()
+{
+   printf("{\n");
+   printf("  \"engine\": \"%s\",\n", engineName());
+   printf("  \"virtual_time\": %s,\n", virtualTime ? "true" : "false");
+   printf("  \"num_barbers\": %d,\n", global->NUM_BARBERS);
+   printf("  \"num_clients\": %d,\n", global->NUM_CLIENTS);
+   printf("  \"time_unit_ms\": %d,\n", time_unit());
+   printf("  \"dispatch\": \"%s\",\n", dispatch_policy_name(global->DISPATCH_POLICY));
+   printf("  \"batch_chair_services\": %s,\n", global->BATCH_CHAIR_SERVICES ? "true" : "false");
+   if (engine == COROUTINE_ENGINE)
+   {
+      printf("  \"workers\": [");
+      for(int i = 0; i < num_coroutine_workers(); i++)
+      {
+         WorkerStats w = coroutine_worker_stats(i);
+         printf("%s{\"utilisation\": %.4f, \"runs\": %ld, \"steals\": %ld}", i > 0 ? ", " : "", w.utilisation, w.runs, w.steals);
+      }
+      printf("],\n");
+   }
+   printf("  \"placement\": ");
+   json_placement(stdout);
+   printf(",\n");
+   printf("  \"stats\": ");
+   json_sim_stats(stdout, simulatedTime);
+   printf("\n}\n");
+}
+
+static const char* engineName()
+{
+   return engine == POOL_ENGINE ? "pool" : engine == COROUTINE_ENGINE ? "coroutines" :
+          engine == THREAD_ENGINE ? "threads" : "process";
+}
+
+/* barbers and clients in several processes (state in a shared memory segment) */
+static int sharedMemoryEngine()
+{
+   return engine == PROCESS_ENGINE || engine == POOL_ENGINE;
+}
@@ -0,0 +1,443 @@
+/**
+ *  \brief Parallel parameter sweep of the barber shop simulation
+ *
+ * Runs the simulation (headless) once per configuration, as many runs at a
+ * time as there are cores, and collects their summaries into one CSV table.
+ * Each run is an isolated process with private shared memory segments, so
+ * simultaneous runs never interfere.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <getopt.h>
+#include <string.h>
+#include <sys/wait.h>
+#include "dbc.h"
+#include "utils.h"
+#include "process.h"
+
+#define MAX_CONFIGS 4096
+#define MAX_AXES 16
+#define MAX_AXIS_VALUES 64
+#define MAX_OPTIONS_LENGTH 1024
+#define MAX_ARGS 128
+#define MAX_SUMMARY_LENGTH 8192
+
+/* summary values reported for each run (section restricts the search to a nested object) */
+static const struct
+{
+   const char* column;
+   const char* section;
+   const char* key;
+} metrics[] =
+{
+   {"elapsed_s",            NULL,           "elapsed_s"},
+   {"clients_served",       NULL,           "clients_served"},
+   {"clients_served_per_s", NULL,           "clients_served_per_s"},
+   {"clients_gave_up",      NULL,           "clients_gave_up"},
+   {"bench_mean_ms",        "\"bench_time\"", "mean_ms"},
+   {"bench_p50_ms",         "\"bench_time\"", "p50_ms"},
+   {"bench_p99_ms",         "\"bench_time\"", "p99_ms"},
+   {"haircut_mean_ms",      "\"haircut\"",    "mean_ms"},
+   {"wash_hair_mean_ms",    "\"wash_hair\"",  "mean_ms"},
+   {"shave_mean_ms",        "\"shave\"",      "mean_ms"},
+   {"barber_utilisation",   NULL,           "mean_barber_utilisation"},
+};
+#define NUM_METRICS ((int)(sizeof(metrics)/sizeof(metrics[0])))
+
+typedef struct _Axis_
+{
+   char option;                     // simulation (short) option
+   int numValues;
+   char* values[MAX_AXIS_VALUES];
+} Axis;
+
+typedef struct _Run_
+{
+   char options[MAX_OPTIONS_LENGTH]; // simulation options of this configuration
+   pid_t pid;
+   FILE* output;                     // simulation summary (JSON)
+   int ok;
+   double metric[NUM_METRICS];
+} Run;
+
+static int numAxes = 0;
+static Axis axes[MAX_AXES];
+static int numRuns = 0;
+static Run runs[MAX_CONFIGS];
+static int jobs = 0;
+static char* simulation = NULL;
+static char* outputFile = NULL;
+static int numCommon = 0;
+static char** common = NULL;          // options common to all runs
+
+/* internal functions */
+static void help(char* prog);
+static void processArgs(int argc, char* argv[]);
+static void addAxis(char option, char* values);
+static void addConfig(const char* options);
+static void readConfigs(char* file);
+static void genGrid(int axis, char* options);
+static void launch(Run* run);
+static void collect(Run* run, int status);
+static int jsonNumber(char* json, const char* section, const char* key, double* value);
+static void writeCSV(FILE* out);
+
+int main(int argc, char* argv[])
+{
+   processArgs(argc, argv);
+   if (numAxes > 0)
+      genGrid(0, (char*)"");
+   if (numRuns == 0)
+   {
+      fprintf(stderr, "ERROR: no configurations (use a grid option or --file)\n");
+      exit(EXIT_FAILURE);
+   }
+
+   int next = 0;
+   int running = 0;
+   while(next < numRuns || running > 0)
+   {
+      if (next < numRuns && running < jobs)
+      {
+         launch(runs+next);
+         next++;
+         running++;
+      }
+      else
+      {
+         int status;
+         pid_t pid = pwait(&status);
+         for(int i = 0; i < next; i++)
+            if (runs[i].pid == pid)
+            {
+               collect(runs+i, status);
+               running--;
+               break;
+            }
+      }
+   }
+
+   FILE* out = stdout;
+   if (outputFile != NULL)
+   {
+      out = fopen(outputFile, "w");
+      if (out == NULL)
+      {
+         fprintf(stderr, "ERROR: unable to create \"%s\"\n", outputFile);
+         exit(EXIT_FAILURE);
+      }
+   }
+   writeCSV(out);
+   if (out != stdout)
+      fclose(out);
+
+   return 0;
+}
+
+/**
+ * start one headless simulation, its summary written into an anonymous temporary file
+ */
+static void launch(Run* run)
+{
+   require (run != NULL, "run argument required");
+
+   char* args[MAX_ARGS];
+   int n = 0;
+   args[n++] = simulation;
+   args[n++] = (char*)"--headless";
+   for(int i = 0; i < numCommon && n < MAX_ARGS-1; i++)
+      args[n++] = common[i];
+   char options[MAX_OPTIONS_LENGTH];
+   strcpy(options, run->options);
+   for(char* tok = strtok(options, " \t\n"); tok != NULL && n < MAX_ARGS-1; tok = strtok(NULL, " \t\n"))
+      args[n++] = tok;
+   args[n] = NULL;
+
+   run->output = tmpfile();
+   if (run->output == NULL)
+   {
+      fprintf(stderr, "ERROR: unable to create a temporary file\n");
+      exit(EXIT_FAILURE);
+   }
+   fflush(stdout);
+   run->pid = pfork();
+   if (run->pid == 0)
+   {
+      dup2(fileno(run->output), STDOUT_FILENO);
+      execvp(simulation, args);
+      fprintf(stderr, "ERROR: unable to execute \"%s\"\n", simulation);
+      exit(EXIT_FAILURE);
+   }
+}
+
+static void collect(Run* run, int status)
+{
+   require (run != NULL, "run argument required");
+
+   char summary[MAX_SUMMARY_LENGTH];
+   rewind(run->output);
+   size_t len = fread(summary, 1, MAX_SUMMARY_LENGTH-1, run->output);
+   summary[len] = '\0';
+   fclose(run->output);
+   run->output = NULL;
+
+   run->ok = WIFEXITED(status) && WEXITSTATUS(status) == 0;
+   for(int m = 0; run->ok && m < NUM_METRICS; m++)
+      run->ok = jsonNumber(summary, metrics[m].section, metrics[m].key, &run->metric[m]);
+   if (!run->ok)
+      fprintf(stderr, "WARNING: run failed: %s\n", run->options);
+}
+
+/* value of "key" in a summary (the first after section, if given) */
+static int jsonNumber(char* json, const char* section, const char* key, double* value)
+{
+   char* p = section == NULL ? json : strstr(json, section);
+   if (p == NULL)
+      return 0;
+   char pattern[64];
+   snprintf(pattern, sizeof(pattern), "\"%s\":", key);
+   p = strstr(p, pattern);
+   return p != NULL && sscanf(p+strlen(pattern), "%lf", value) == 1;
+}
+
+static void writeCSV(FILE* out)
+{
+   fprintf(out, "config,options,status");
+   for(int m = 0; m < NUM_METRICS; m++)
+      fprintf(out, ",%s", metrics[m].column);
+   fprintf(out, "\n");
+   for(int i = 0; i < numRuns; i++)
+   {
+      fprintf(out, "%d,\"%s\",%s", i+1, runs[i].options, runs[i].ok ? "ok" : "failed");
+      for(int m = 0; m < NUM_METRICS; m++)
+         if (runs[i].ok)
+            fprintf(out, ",%g", runs[i].metric[m]);
+         else
+            fprintf(out, ",");
+      fprintf(out, "\n");
+   }
+}
+
+/* cartesian product of all axes values (first axis varies slowest) */
+static void genGrid(int axis, char* options)
+{
+   if (axis == numAxes)
+      addConfig(options);
+   else
+   {
+      for(int v = 0; v < axes[axis].numValues; v++)
+      {
+         char buf[MAX_OPTIONS_LENGTH];
+         snprintf(buf, sizeof(buf), "%s%s-%c %s", options, options[0] ? " " : "", axes[axis].option, axes[axis].values[v]);
+         genGrid(axis+1, buf);
+      }
+   }
+}
+
+static void addConfig(const char* options)
+{
+   require (options != NULL, "options argument required");
+
+   if (numRuns == MAX_CONFIGS)
+   {
+      fprintf(stderr, "ERROR: too many configurations (max. %d)\n", MAX_CONFIGS);
+      exit(EXIT_FAILURE);
+   }
+   if (strlen(options) >= MAX_OPTIONS_LENGTH)
+   {
+      fprintf(stderr, "ERROR: configuration too long \"%s\"\n", options);
+      exit(EXIT_FAILURE);
+   }
+   strcpy(runs[numRuns].options, options);
+   runs[numRuns].ok = 0;
+   numRuns++;
+}
+
+/* one configuration (simulation options) per line; empty lines and '#' comments ignored */
+static void readConfigs(char* file)
+{
+   require (file != NULL, "file argument required");
+
+   FILE* f = fopen(file, "r");
+   if (f == NULL)
+   {
+      fprintf(stderr, "ERROR: unable to open \"%s\"\n", file);
+      exit(EXIT_FAILURE);
+   }
+   char line[MAX_OPTIONS_LENGTH];
+   while(fgets(line, sizeof(line), f) != NULL)
+   {
+      line[strcspn(line, "#\n")] = '\0';
+      char* s = line + strspn(line, " \t");
+      int len = strlen(s);
+      while(len > 0 && (s[len-1] == ' ' || s[len-1] == '\t'))
+         s[--len] = '\0';
+      if (len > 0)
+         addConfig(s);
+   }
+   fclose(f);
+}
+
+static void addAxis(char option, char* values)
+{
+   if (numAxes == MAX_AXES)
+   {
+      fprintf(stderr, "ERROR: too many grid options\n");
+      exit(EXIT_FAILURE);
+   }
+   Axis* axis = axes + numAxes++;
+   axis->option = option;
+   axis->numValues = 0;
+   for(char* tok = strtok(string_clone(values), "/"); tok != NULL; tok = strtok(NULL, "/"))
+   {
+      if (axis->numValues == MAX_AXIS_VALUES)
+      {
+         fprintf(stderr, "ERROR: too many values for -%c (max. %d)\n", option, MAX_AXIS_VALUES);
+         exit(EXIT_FAILURE);
+      }
+      axis->values[axis->numValues++] = tok;
+   }
+   if (axis->numValues == 0)
+   {
+      fprintf(stderr, "ERROR: no values for -%c\n", option);
+      exit(EXIT_FAILURE);
+   }
+}
+
+/*********************************************************************/
+
+static void help(char* prog)
+{
+   require (prog != NULL, "program name argument required");
+
+   printf("\n");
+   printf("Usage: %s [OPTION] ... [-- SIMULATION-OPTION ...]\n", prog);
+   printf("\n");
+   printf("Runs the simulation once for each configuration (several at a time) and\n");
+   printf("writes one CSV line per configuration with throughput and waiting times.\n");
+   printf("SIMULATION-OPTIONs are common to all runs (e.g. -- -V -u 1).\n");
+   printf("\n");
+   printf("Options:\n");
+   printf("\n");
+   printf("  -h,--help                                   show this help\n");
+   printf("  -j,--jobs <N>\n");
+   printf("     number of simultaneous runs (default is the number of cores: %ld)\n", sysconf(_SC_NPROCESSORS_ONLN));
+   printf("  -o,--output <FILE>\n");
+   printf("     CSV output file (default is the standard output)\n");
+   printf("  -f,--file <FILE>\n");
+   printf("     list of configurations: simulation options, one configuration per line\n");
+   printf("  -s,--simulation <PATH>\n");
+   printf("     simulation program (default is simulation in this program's directory)\n");
+   printf("\n");
+   printf("Grid options (values separated by '/', all combinations are run):\n");
+   printf("\n");
+   printf("  -b,--num-barbers <N>/...\n");
+   printf("  -n,--num-clients <N>/...\n");
+   printf("  -c,--num-chairs <N>/...\n");
+   printf("  -t,--num-tools <SCISSORS>,<COMBS>,<RAZORS>/...\n");
+   printf("  -1,--num-basins <N>/...\n");
+   printf("  -2,--num-client-benches-seats <TOTAL_SEATS>,<NUM_BENCHES>/...\n");
+   printf("  -3,--work-time-units <MIN>,<MAX>/...\n");
+   printf("  -4,--barber-shop-trips <MIN>,<MAX>/...\n");
+   printf("  -5,--outside-time-units <MIN>,<MAX>/...\n");
+   printf("  -6,--benches-wait-time-units <N>/...\n");
+   printf("  -p,--prob-requests <HAIRCUT>,<WASH_HAIR>,<SHAVE>/...\n");
+   printf("  -e,--engine <process|threads|coroutines|pool>/...\n");
+   printf("\n");
+   printf("Example:\n");
+   printf("  %s -b 2/4/8 -c 2/4 -t 2,2,1/4,4,2 -o plan.csv -- -V -u 1\n", prog);
+   printf("\n");
+}
+
+static void processArgs(int argc, char* argv[])
+{
+   require (argc >= 0 && argv != NULL && argv[0] != NULL, "invalid main arguments");
+
+   static struct option long_options[] =
+   {
+      {"help",                         no_argument,       NULL, 'h'},
+      {"jobs",                         required_argument, NULL, 'j'},
+      {"output",                       required_argument, NULL, 'o'},
+      {"file",                         required_argument, NULL, 'f'},
+      {"simulation",                   required_argument, NULL, 's'},
+      {"num-barbers",                  required_argument, NULL, 'b'},
+      {"num-clients",                  required_argument, NULL, 'n'},
+      {"num-chairs",                   required_argument, NULL, 'c'},
+      {"num-tools",                    required_argument, NULL, 't'},
+      {"num-basins",                   required_argument, NULL, '1'},
+      {"num-client-benches-seats",     required_argument, NULL, '2'},
+      {"work-time-units",              required_argument, NULL, '3'},
+      {"barber-shop-trips",            required_argument, NULL, '4'},
+      {"outside-time-units",           required_argument, NULL, '5'},
+      {"benches-wait-time-units",      required_argument, NULL, '6'},
+      {"prob-requests",                required_argument, NULL, 'p'},
+      {"engine",                       required_argument, NULL, 'e'},
+      {0, 0, NULL, 0}
+   };
+   int op=0;
+
+   while (op != -1)
+   {
+      int option_index = 0;
+
+      op = getopt_long(argc, argv, "hj:o:f:s:b:n:c:t:1:2:3:4:5:6:p:e:", long_options, &option_index);
+      int st,n;
+      switch (op)
+      {
+         case -1:
+            break;
+
+         case 'h':
+            help(argv[0]);
+            exit(EXIT_SUCCESS);
+
+         case 'j':
+            st = sscanf(optarg, "%d", &n);
+            if (st != 1 || n < 1)
+            {
+               fprintf(stderr, "ERROR: invalid number of jobs \"%s\"\n", optarg);
+               exit(EXIT_FAILURE);
+            }
+            jobs = n;
+            break;
+
+         case 'o':
+            outputFile = optarg;
+            break;
+
+         case 'f':
+            readConfigs(optarg);
+            break;
+
+         case 's':
+            simulation = optarg;
+            break;
+
+         case 'b': case 'n': case 'c': case 't': case '1': case '2':
+         case '3': case '4': case '5': case '6': case 'p': case 'e':
+            addAxis((char)op, optarg);
+            break;
+
+         default:
+            help(argv[0]);
+            exit(EXIT_FAILURE);
+            break;
+      }
+   }
+
+   numCommon = argc - optind;
+   common = argv + optind;
+
+   if (jobs == 0)
+      jobs = sysconf(_SC_NPROCESSORS_ONLN) > 0 ? sysconf(_SC_NPROCESSORS_ONLN) : 1;
+
+   if (simulation == NULL)
+   {
+      char* slash = strrchr(argv[0], '/');
+      int dirLength = slash == NULL ? 1 : slash - argv[0];
+      simulation = (char*)mem_alloc(dirLength + strlen("/simulation") + 1);
+      sprintf(simulation, "%.*s/simulation", dirLength, slash == NULL ? "." : argv[0]);
+   }
+}
@@ -3,13 +3,26 @@
 #include "global.h"
 #include "utils.h"
 #include "box.h"
+#include "box-template.h"
 #include "logger.h"
+#include "compositor.h"
+#include "sim-clock.h"
+#include "barber-chair.h"
 #include "tools-pot.h"
 
 static const int skel_length = 20*5*2+1; // extra space for (pessimistic) utf8 encoding!
 static char skel[skel_length];
+static BoxTemplate skel_boxes;
+
+#define FIELD_BITS 16
+#define FIELD_MASK ((1UL << FIELD_BITS) - 1)
+#define WAITER (1UL << 3*FIELD_BITS)
 
 static char* to_string_tools_pot(ToolsPot* pot);
+static unsigned long packed(int tools);
+static int fits(unsigned long available, int tools);
+static int take_tools(ToolsPot* pot, int tools, int waiter);
+static void hand_over_tools(ToolsPot* pot);
 
 int num_lines_tools_pot()
 {
@@ -21,14 +34,25 @@ int num_columns_tools_pot()
    return 19;
 }
 
-void init_tools_pot(ToolsPot* pot, int num_scissors, int num_combs, int num_razors, int line, int column)
+size_t sizeof_tools_pot_arrays(int num_barbers)
+{
+   require (num_barbers > 0, concat_3str("invalid number of barbers (", int2str(num_barbers), ")"));
+
+   return 2*storage_size((num_barbers+1)*sizeof(int)) + storage_size((num_barbers+1)*sizeof(ClockSem));
+}
+
+void init_tools_pot(ToolsPot* pot, int num_scissors, int num_combs, int num_razors, int num_barbers,
+                    int line, int column, Storage* storage)
 {
    require (pot != NULL, "pot argument required");
-   require (num_scissors > 0 && num_scissors <= MAX_NUM_TOOLS, concat_5str("invalid number of scissors (", int2str(num_scissors), " not in [1,", int2str(MAX_NUM_TOOLS), "])"));
-   require (num_combs > 0 && num_combs <= MAX_NUM_TOOLS, concat_5str("invalid number of combs (", int2str(num_combs), " not in [1,", int2str(MAX_NUM_TOOLS), "])"));
-   require (num_razors > 0 && num_razors <= MAX_NUM_TOOLS, concat_5str("invalid number of razors (", int2str(num_razors), " not in [1,", int2str(MAX_NUM_TOOLS), "])"));
+   require (num_scissors > 0 && (global->HEADLESS || num_scissors <= MAX_NUM_TOOLS), concat_5str("invalid number of scissors (", int2str(num_scissors), " not in [1,", int2str(MAX_NUM_TOOLS), "])"));
+   require (num_combs > 0 && (global->HEADLESS || num_combs <= MAX_NUM_TOOLS), concat_5str("invalid number of combs (", int2str(num_combs), " not in [1,", int2str(MAX_NUM_TOOLS), "])"));
+   require (num_razors > 0 && (global->HEADLESS || num_razors <= MAX_NUM_TOOLS), concat_5str("invalid number of razors (", int2str(num_razors), " not in [1,", int2str(MAX_NUM_TOOLS), "])"));
+   require ((unsigned long)num_scissors <= FIELD_MASK && (unsigned long)num_combs <= FIELD_MASK && (unsigned long)num_razors <= FIELD_MASK, "too many tools");
+   require (num_barbers > 0 && (unsigned long)num_barbers <= FIELD_MASK, concat_3str("invalid number of barbers (", int2str(num_barbers), ")"));
    require (line >= 0, concat_3str("Invalid line (", int2str(line), ")"));
    require (column >= 0, concat_3str("Invalid column (", int2str(column), ")"));
+   require (storage != NULL, "storage argument required");
 
    gen_rect(skel, skel_length, 5, 19, 0xF, 1);
    gen_overlap_boxes(skel, 0, skel,
@@ -38,14 +62,28 @@ void init_tools_pot(ToolsPot* pot, int num_scissors, int num_combs, int num_razo
                      NULL);
    check (num_lines_tools_pot() == string_num_lines((char*)skel), "");
    check (num_columns_tools_pot() == string_num_columns((char*)skel), "");
-   pot->availScissors = num_scissors;
-   pot->availCombs = num_combs;
-   pot->availRazors = num_razors;
-   pot->internal = NULL;
+   if (!global->HEADLESS && !compiled_box_template(&skel_boxes))
+      init_box_template(&skel_boxes, skel);
+   pot->numScissors = num_scissors;
+   pot->numCombs = num_combs;
+   pot->numRazors = num_razors;
+   pot->available = num_scissors*packed(SCISSOR_TOOL) + num_combs*packed(COMB_TOOL) + num_razors*packed(RAZOR_TOOL);
+   clock_sem_init(&pot->mutex, 1);
+   pot->firstWaiter = pot->lastWaiter = -1;
+   pot->waiterNext = (int*)storage_alloc(storage, (num_barbers+1)*sizeof(int));
+   pot->waiterTools = (int*)storage_alloc(storage, (num_barbers+1)*sizeof(int));
+   pot->waiterSem = (ClockSem*)storage_alloc(storage, (num_barbers+1)*sizeof(ClockSem));
+   for(int i = 0; i <= num_barbers; i++)
+   {
+      pot->waiterNext[i] = -1;
+      pot->waiterTools[i] = 0;
+      clock_sem_init(pot->waiterSem+i, 0);
+   }
+   pot->internal = (char*)mem_alloc(skel_length + 1);
    static char* translations[] = {
-      string_concat(NULL, 0, (char*)" (", SCISSOR,(char*)")",NULL), (char*)"",
-      string_concat(NULL, 0, (char*)" (", COMB,   (char*)")",NULL), (char*)"",
-      string_concat(NULL, 0, (char*)" (", RAZOR,  (char*)")",NULL), (char*)"",
+      (char*)" (" SCISSOR_TEXT ")", (char*)"",
+      (char*)" (" COMB_TEXT ")", (char*)"",
+      (char*)" (" RAZOR_TEXT ")", (char*)"",
       NULL
    };
    pot->logId = register_logger((char*)"Tools Pot:", line ,column , num_lines_tools_pot(), num_columns_tools_pot(), translations);
@@ -66,8 +104,8 @@ void log_tools_pot(ToolsPot* pot)
 {
    require (pot != NULL, "pot argument required");
 
-   spend(random_int(global->MIN_VITALITY_TIME_UNITS, global->MAX_VITALITY_TIME_UNITS));
-   send_log(pot->logId, to_string_tools_pot(pot));
+   if (!global->HEADLESS)
+      compose_log(pot->logId, to_string_tools_pot(pot));
 }
 
 static char* to_string_tools_pot(ToolsPot* pot)
@@ -75,63 +113,129 @@ static char* to_string_tools_pot(ToolsPot* pot)
    if (pot->internal == NULL)
       pot->internal = (char*)mem_alloc(skel_length + 1);
 
-   return gen_boxes(pot->internal, skel_length, skel,
-                    SCISSOR, int2nstr(pot->availScissors, 2),
-                    COMB,    int2nstr(pot->availCombs, 2),
-                    RAZOR,   int2nstr(pot->availRazors, 2));
+   return gen_box_template(&skel_boxes, pot->internal, skel_length,
+                           SCISSOR, int2nstr(available_tools(pot, SCISSOR_TOOL), 2),
+                           COMB,    int2nstr(available_tools(pot, COMB_TOOL), 2),
+                           RAZOR,   int2nstr(available_tools(pot, RAZOR_TOOL), 2));
 }
 
-void pick_scissor(ToolsPot* pot)
+int available_tools(ToolsPot* pot, int tool)
 {
    require (pot != NULL, "pot argument required");
-   require (pot->availScissors > 0, pot->availScissors == 0 ? "scissor not available" : concat_3str("invalid number of scissors (", int2str(pot->availScissors), ")"));
+   require (tool == SCISSOR_TOOL || tool == COMB_TOOL || tool == RAZOR_TOOL, concat_3str("invalid tool (", int2str(tool), ")"));
 
-   pot->availScissors--;
-   log_tools_pot(pot);
+   return (__atomic_load_n(&pot->available, __ATOMIC_RELAXED) / packed(tool)) & FIELD_MASK;
 }
 
-void pick_comb(ToolsPot* pot)
+void pick_tools(ToolsPot* pot, int barberID, int tools)
 {
    require (pot != NULL, "pot argument required");
-   require (pot->availCombs > 0, pot->availCombs == 0 ? "comb not available" : concat_3str("invalid number of combs (", int2str(pot->availCombs), ")"));
+   require (barberID > 0, concat_3str("invalid barber id (", int2str(barberID), ")"));
+   require (tools > 0 && (tools & ~(SCISSOR_TOOL|COMB_TOOL|RAZOR_TOOL)) == 0, concat_3str("invalid tools mask (", int2str(tools), ")"));
 
-   pot->availCombs--;
+   if (!take_tools(pot, tools, 0))
+   {
+      // take them, or become a waiter, in a single update
+      clock_sem_wait(&pot->mutex);
+      unsigned long old = __atomic_load_n(&pot->available, __ATOMIC_RELAXED);
+      int granted;
+      do
+         granted = (old & (FIELD_MASK*WAITER)) == 0 && fits(old, tools);
+      while(!__atomic_compare_exchange_n(&pot->available, &old, granted ? old-packed(tools) : old+WAITER,
+                                         1, __ATOMIC_ACQUIRE, __ATOMIC_RELAXED));
+      if (!granted)
+      {
+         pot->waiterNext[barberID] = -1;
+         pot->waiterTools[barberID] = tools;
+         if (pot->lastWaiter == -1)
+            pot->firstWaiter = barberID;
+         else
+            pot->waiterNext[pot->lastWaiter] = barberID;
+         pot->lastWaiter = barberID;
+         hand_over_tools(pot); // (it may go ahead of the others)
+      }
+      clock_sem_post(&pot->mutex);
+      if (!granted)
+         clock_sem_wait(pot->waiterSem+barberID);
+   }
+   pace_sim_clock();
    log_tools_pot(pot);
 }
 
-void pick_razor(ToolsPot* pot)
+void return_tools(ToolsPot* pot, int tools)
 {
    require (pot != NULL, "pot argument required");
-   require (pot->availRazors > 0, pot->availRazors == 0 ? "razor not available" : concat_3str("invalid number of razors (", int2str(pot->availRazors), ")"));
+   require (tools > 0 && (tools & ~(SCISSOR_TOOL|COMB_TOOL|RAZOR_TOOL)) == 0, concat_3str("invalid tools mask (", int2str(tools), ")"));
 
-   pot->availRazors--;
+   unsigned long res = __atomic_add_fetch(&pot->available, packed(tools), __ATOMIC_RELEASE);
+   check (((res / packed(SCISSOR_TOOL)) & FIELD_MASK) <= (unsigned long)pot->numScissors &&
+          ((res / packed(COMB_TOOL)) & FIELD_MASK) <= (unsigned long)pot->numCombs &&
+          ((res / packed(RAZOR_TOOL)) & FIELD_MASK) <= (unsigned long)pot->numRazors, "tools not picked");
+   if ((res & (FIELD_MASK*WAITER)) != 0)
+   {
+      clock_sem_wait(&pot->mutex);
+      hand_over_tools(pot);
+      clock_sem_post(&pot->mutex);
+   }
+   pace_sim_clock();
    log_tools_pot(pot);
 }
 
-void return_scissor(ToolsPot* pot)
+/* one unit in the field of each tool of the mask */
+static unsigned long packed(int tools)
 {
-   require (pot != NULL, "pot argument required");
-   require (pot->availScissors < MAX_NUM_TOOLS, concat_3str("invalid number of scissors (", int2str(pot->availScissors), ")"));
-
-   pot->availScissors++;
-   log_tools_pot(pot);
+   return ((tools & SCISSOR_TOOL) ? 1UL : 0) |
+          ((tools & COMB_TOOL) ? 1UL << FIELD_BITS : 0) |
+          ((tools & RAZOR_TOOL) ? 1UL << 2*FIELD_BITS : 0);
 }
 
-void return_comb(ToolsPot* pot)
+static int fits(unsigned long available, int tools)
 {
-   require (pot != NULL, "pot argument required");
-   require (pot->availCombs < MAX_NUM_TOOLS, concat_3str("invalid number of combs (", int2str(pot->availCombs), ")"));
-
-   pot->availCombs++;
-   log_tools_pot(pot);
+   int res = 1;
+   for(int tool = SCISSOR_TOOL; res && tool <= RAZOR_TOOL; tool <<= 1)
+      res = !(tools & tool) || ((available / packed(tool)) & FIELD_MASK) > 0;
+   return res;
 }
 
-void return_razor(ToolsPot* pot)
+/* takes all the tools, if available: for a waiting barber, also removing
+ * it from the waiters count, otherwise only if nobody is waiting */
+static int take_tools(ToolsPot* pot, int tools, int waiter)
 {
-   require (pot != NULL, "pot argument required");
-   require (pot->availRazors < MAX_NUM_TOOLS, concat_3str("invalid number of razors (", int2str(pot->availRazors), ")"));
-
-   pot->availRazors++;
-   log_tools_pot(pot);
+   unsigned long old = __atomic_load_n(&pot->available, __ATOMIC_RELAXED);
+   do
+      if (!fits(old, tools) || (!waiter && (old & (FIELD_MASK*WAITER)) != 0))
+         return 0;
+   while(!__atomic_compare_exchange_n(&pot->available, &old, old - packed(tools) - (waiter ? WAITER : 0),
+                                      1, __ATOMIC_ACQUIRE, __ATOMIC_RELAXED));
+   return 1;
 }
 
+/* (mutex held) hands the available tools over to waiting barbers, in FIFO
+ * order, but past a waiter lacking tools only to those needing none of its
+ * tools (so that it is not starved) */
+static void hand_over_tools(ToolsPot* pot)
+{
+   int blocked = 0;
+   int prev = -1;
+   for(int id = pot->firstWaiter; id != -1; )
+   {
+      int next = pot->waiterNext[id];
+      if ((pot->waiterTools[id] & blocked) == 0 && take_tools(pot, pot->waiterTools[id], 1))
+      {
+         if (prev == -1)
+            pot->firstWaiter = next;
+         else
+            pot->waiterNext[prev] = next;
+         if (pot->lastWaiter == id)
+            pot->lastWaiter = prev;
+         pot->waiterNext[id] = -1;
+         clock_sem_post(pot->waiterSem+id);
+      }
+      else
+      {
+         blocked |= pot->waiterTools[id];
+         prev = id;
+      }
+      id = next;
+   }
+}
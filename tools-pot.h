@@ -7,11 +7,30 @@
 #ifndef TOOLS_POT_H
 #define TOOLS_POT_H
 
+#include "global.h"
+#include "sim-clock.h"
+
+/* A barber picks all the tools of a service at once (tools mask of
+ * barber-chair.h), or waits holding none of them.  The available tools (and
+ * the number of waiting barbers) are packed in a single word, updated with
+ * one compare-and-swap; waiting barbers are served in FIFO order, except
+ * that a later one may go ahead if it needs none of the tools earlier ones
+ * are waiting for. */
 typedef struct _ToolsPot_
 {
-   int availScissors;
-   int availCombs;
-   int availRazors;
+   int numScissors;
+   int numCombs;
+   int numRazors;
+   unsigned long available;   // 16 bits each: scissors, combs, razors, waiting barbers
+
+   // barbers waiting for their tools (FIFO protected by mutex):
+   ClockSem mutex;
+   int firstWaiter;           // barber id (-1 if none)
+   int lastWaiter;
+   int* waiterNext;           // [numBarbers+1] indexed by barber id
+   int* waiterTools;          // [numBarbers+1]
+   ClockSem* waiterSem;       // [numBarbers+1] tools handed over
+
    int logId;
    char* internal;
 } ToolsPot;
@@ -19,16 +38,14 @@ typedef struct _ToolsPot_
 int num_lines_tools_pot();
 int num_columns_tools_pot();
 
-void init_tools_pot(ToolsPot* pot, int num_scissors, int num_combs, int num_razors, int line, int column);
+size_t sizeof_tools_pot_arrays(int num_barbers);
+void init_tools_pot(ToolsPot* pot, int num_scissors, int num_combs, int num_razors, int num_barbers,
+                    int line, int column, Storage* storage);
 void term_tools_pot(ToolsPot* pot);
 void log_tools_pot(ToolsPot* pot);
 
-void pick_scissor(ToolsPot* pot);
-void pick_comb(ToolsPot* pot);
-void pick_razor(ToolsPot* pot);
-
-void return_scissor(ToolsPot* pot);
-void return_comb(ToolsPot* pot);
-void return_razor(ToolsPot* pot);
+int available_tools(ToolsPot* pot, int tool); // (snapshot)
+void pick_tools(ToolsPot* pot, int barberID, int tools);  // all of them (blocks until they are available)
+void return_tools(ToolsPot* pot, int tools);
 
 #endif
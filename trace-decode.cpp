@@ -0,0 +1,191 @@
+/**
+ *  \brief Decoder of the barber shop binary event traces
+ *
+ * Reads a trace file recorded by the simulation (--trace), merges the
+ * records of all its rings by time (records of the same ring, and of the
+ * same time, keep their order) and prints one text line per state change,
+ * optionally only those of one barber or client.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <getopt.h>
+#include <string.h>
+#include "dbc.h"
+#include "global.h"
+#include "utils.h"
+#include "trace.h"
+
+static const char* kindName[] = {"barber", "client"};
+static const char* resourceName[] = {"", "barber bench", "client benches", "barber chair", "washbasin"};
+
+static char* path = NULL;
+static int onlyKind = -1;         // (-1: every entity)
+static int onlyEntity = 0;
+
+static void help(char* prog);
+static void processArgs(int argc, char* argv[]);
+static int compare_records(const void* a, const void* b);
+static const char* state_name(TraceHeader* header, int kind, int state);
+
+/* records sorted with their position in the file (merge order) */
+typedef struct _Entry_
+{
+   TraceRecord record;
+   long pos;
+} Entry;
+
+int main(int argc, char* argv[])
+{
+   processArgs(argc, argv);
+
+   FILE* f = fopen(path, "rb");
+   if (f == NULL)
+   {
+      perror(path);
+      exit(EXIT_FAILURE);
+   }
+   TraceHeader header;
+   if (fread(&header, sizeof(header), 1, f) != 1 || memcmp(header.magic, TRACE_MAGIC, sizeof(header.magic)) != 0 ||
+       header.recordSize != (int)sizeof(TraceRecord))
+   {
+      fprintf(stderr, "ERROR: \"%s\" is not a barber shop trace\n", path);
+      exit(EXIT_FAILURE);
+   }
+
+   long size = 1024;
+   long num = 0;
+   Entry* entries = (Entry*)malloc(size*sizeof(Entry));
+   check (entries != NULL, "out of memory");
+   TraceRecord r;
+   while (fread(&r, sizeof(r), 1, f) == 1)
+   {
+      if (num == size)
+      {
+         size *= 2;
+         entries = (Entry*)realloc(entries, size*sizeof(Entry));
+         check (entries != NULL, "out of memory");
+      }
+      entries[num].record = r;
+      entries[num].pos = num;
+      num++;
+   }
+   fclose(f);
+   qsort(entries, num, sizeof(Entry), compare_records);
+
+   printf("# %d barbers, %d clients, %s time, %ld records\n", header.numBarbers, header.numClients,
+          header.virtualTime ? "virtual" : "real", num);
+   for(long i = 0; i < num; i++)
+   {
+      TraceRecord* e = &entries[i].record;
+      if (onlyKind != -1 && (e->kind != onlyKind || e->entity != onlyEntity))
+         continue;
+      char requests[4] = {
+         (e->request & HAIRCUT_REQ) ?   'H' : ':',
+         (e->request & WASH_HAIR_REQ) ? 'W' : ':',
+         (e->request & SHAVE_REQ) ?     'S' : ':',
+         '\0'
+      };
+      char resource[32] = "";
+      if (e->resourceKind != TRACE_NO_RESOURCE && e->resourceKind < sizeof(resourceName)/sizeof(resourceName[0]))
+         sprintf(resource, "%s %d", resourceName[e->resourceKind], e->resource+1);
+      printf("%10.3f s  %s %4d  %-13s -> %-13s  %-18s %s\n", e->time/1000.0, kindName[e->kind & 1], e->entity,
+             state_name(&header, e->kind & 1, e->from), state_name(&header, e->kind & 1, e->to), resource, requests);
+   }
+   free(entries);
+   return 0;
+}
+
+static int compare_records(const void* a, const void* b)
+{
+   const Entry* ea = (const Entry*)a;
+   const Entry* eb = (const Entry*)b;
+   if (ea->record.time != eb->record.time)
+      return ea->record.time < eb->record.time ? -1 : 1;
+   return ea->pos < eb->pos ? -1 : ea->pos > eb->pos;
+}
+
+static const char* state_name(TraceHeader* header, int kind, int state)
+{
+   if (state >= header->numStates[kind] || state >= MAX_TRACE_STATES)
+      return "?";
+   header->stateName[kind][state][MAX_TRACE_STATE_NAME-1] = '\0';
+   return header->stateName[kind][state];
+}
+
+/*********************************************************************/
+
+static void help(char* prog)
+{
+   require (prog != NULL, "program name argument required");
+
+   printf("\n");
+   printf("Usage: %s [OPTION] ... FILE\n", prog);
+   printf("\n");
+   printf("Prints the barber shop binary event trace FILE (simulation --trace) as text,\n");
+   printf("one line per state change, in time order.\n");
+   printf("\n");
+   printf("Options:\n");
+   printf("\n");
+   printf("  -h,--help                                   show this help\n");
+   printf("  -b,--barber <ID>\n");
+   printf("     only the state changes of this barber\n");
+   printf("  -c,--client <ID>\n");
+   printf("     only the state changes of this client\n");
+   printf("\n");
+}
+
+static void processArgs(int argc, char* argv[])
+{
+   require (argc >= 0 && argv != NULL && argv[0] != NULL, "invalid main arguments");
+
+   static struct option long_options[] =
+   {
+      {"help",                         no_argument,       NULL, 'h'},
+      {"barber",                       required_argument, NULL, 'b'},
+      {"client",                       required_argument, NULL, 'c'},
+      {0, 0, NULL, 0}
+   };
+   int op=0;
+
+   while (op != -1)
+   {
+      int option_index = 0;
+
+      op = getopt_long(argc, argv, "hb:c:", long_options, &option_index);
+      int st,n;
+      switch (op)
+      {
+         case -1:
+            break;
+
+         case 'h':
+            help(argv[0]);
+            exit(EXIT_SUCCESS);
+
+         case 'b':
+         case 'c':
+            st = sscanf(optarg, "%d", &n);
+            if (st != 1 || n < 1)
+            {
+               fprintf(stderr, "ERROR: invalid %s id \"%s\"\n", op == 'b' ? "barber" : "client", optarg);
+               exit(EXIT_FAILURE);
+            }
+            onlyKind = op == 'b' ? TRACE_BARBER : TRACE_CLIENT;
+            onlyEntity = n;
+            break;
+
+         default:
+            help(argv[0]);
+            exit(EXIT_FAILURE);
+            break;
+      }
+   }
+
+   if (argc-optind != 1)
+   {
+      help(argv[0]);
+      exit(EXIT_FAILURE);
+   }
+   path = argv[optind];
+}
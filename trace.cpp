@@ -0,0 +1,186 @@
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <sched.h>
+#include "dbc.h"
+#include "global.h"
+#include "utils.h"
+#include "thread.h"
+#include "sim-clock.h"
+#include "barber.h"
+#include "client.h"
+#include "trace.h"
+
+static Trace* trace = NULL;            // shared by all processes (inherited through fork)
+static __thread int traceRing = -1;    // ring of the calling unit (-1: the main process)
+
+// collector (main process):
+static FILE* traceFile = NULL;
+static pthread_t collector;
+static int stopCollecting = 0;
+static long recordsWritten = 0;
+
+static void* main_collector(void* arg);
+static long drain_rings();
+static void state_names(TraceHeader* header, int kind, int num_states, const char* (*name)(int state));
+
+size_t sizeof_trace_arrays(int num_rings)
+{
+   require (num_rings > 0, concat_3str("invalid number of rings (", int2str(num_rings), ")"));
+
+   return storage_size(num_rings*sizeof(TraceRing));
+}
+
+void init_trace(Trace* tr, int num_rings, Storage* storage)
+{
+   require (tr != NULL, "trace argument required");
+   require (num_rings > 0, concat_3str("invalid number of rings (", int2str(num_rings), ")"));
+   require (storage != NULL, "storage argument required");
+
+   tr->numRings = num_rings;
+   tr->ring = (TraceRing*)storage_alloc(storage, num_rings*sizeof(TraceRing));
+   for(int i = 0; i < num_rings; i++)
+   {
+      tr->ring[i].head = 0;
+      tr->ring[i].tail = 0;
+      tr->ring[i].stalls = 0;
+   }
+
+   trace = tr;
+}
+
+void start_trace(const char* path)
+{
+   require (trace != NULL, "trace not initialized");
+   require (path != NULL, "path argument required");
+
+   traceFile = fopen(path, "wb");
+   if (traceFile == NULL)
+   {
+      perror(path);
+      exit(EXIT_FAILURE);
+   }
+   TraceHeader header;
+   memset(&header, 0, sizeof(header));
+   memcpy(header.magic, TRACE_MAGIC, sizeof(header.magic));
+   header.recordSize = sizeof(TraceRecord);
+   header.virtualTime = virtual_time_sim_clock();
+   header.numBarbers = global->NUM_BARBERS;
+   header.numClients = global->NUM_CLIENTS;
+   state_names(&header, TRACE_BARBER, num_states_barber(), state_text_barber);
+   state_names(&header, TRACE_CLIENT, num_states_client(), state_text_client);
+   check (fwrite(&header, sizeof(header), 1, traceFile) == 1, "trace write failed");
+
+   stopCollecting = 0;
+   recordsWritten = 0;
+   thread_create(&collector, NULL, main_collector, NULL);
+}
+
+void stop_trace()
+{
+   require (trace != NULL, "trace not initialized");
+
+   if (traceFile == NULL)
+      return;
+   __atomic_store_n(&stopCollecting, 1, __ATOMIC_RELEASE);
+   thread_join(collector, NULL);
+   check (fclose(traceFile) == 0, "trace write failed");
+   traceFile = NULL;
+}
+
+void enter_trace(int ring)
+{
+   require (trace != NULL, "trace not initialized");
+   require (ring >= 0 && ring < trace->numRings-1, concat_3str("invalid ring (", int2str(ring), ")"));
+
+   traceRing = ring;
+}
+
+void trace_event(int kind, int entity, int from, int to, int resource_kind, int resource, int request)
+{
+   if (trace == NULL)
+      return;
+
+   TraceRing* ring = trace->ring + (traceRing == -1 ? trace->numRings-1 : traceRing);
+   long head = ring->head; // (only this unit appends)
+   if (head - __atomic_load_n(&ring->tail, __ATOMIC_ACQUIRE) == TRACE_RING_SIZE)
+   {
+      ring->stalls++;
+      while (head - __atomic_load_n(&ring->tail, __ATOMIC_ACQUIRE) == TRACE_RING_SIZE)
+         sched_yield();
+   }
+   TraceRecord* r = ring->record + (head & (TRACE_RING_SIZE-1));
+   r->time = (int)peek_sim_clock();
+   r->entity = entity;
+   r->resource = (short)resource;
+   r->kind = (unsigned char)kind;
+   r->resourceKind = (unsigned char)resource_kind;
+   r->from = (unsigned char)from;
+   r->to = (unsigned char)to;
+   r->request = (unsigned char)request;
+   r->unused = 0;
+   __atomic_store_n(&ring->head, head+1, __ATOMIC_RELEASE);
+}
+
+void report_trace(FILE* out)
+{
+   require (out != NULL, "out argument required");
+
+   if (trace == NULL)
+      return;
+   long stalls = 0;
+   for(int i = 0; i < trace->numRings; i++)
+      stalls += trace->ring[i].stalls;
+   fprintf(out, "  trace: %ld records (%ld KB), %ld appends waited for the collector\n",
+           recordsWritten, (long)(sizeof(TraceHeader)+recordsWritten*sizeof(TraceRecord))/1024, stalls);
+}
+
+/* (collector thread) drains the rings every millisecond while nothing is left to drain */
+static void* main_collector(void* arg)
+{
+   struct timespec pause;
+   pause.tv_sec = 0;
+   pause.tv_nsec = 1000000;
+   while (!__atomic_load_n(&stopCollecting, __ATOMIC_ACQUIRE))
+      if (drain_rings() == 0)
+         nanosleep(&pause, NULL);
+   drain_rings();
+   return NULL;
+}
+
+static long drain_rings()
+{
+   long res = 0;
+   for(int i = 0; i < trace->numRings; i++)
+   {
+      TraceRing* ring = trace->ring + i;
+      long tail = ring->tail; // (only the collector drains)
+      long head = __atomic_load_n(&ring->head, __ATOMIC_ACQUIRE);
+      while (tail < head)
+      {
+         long pos = tail & (TRACE_RING_SIZE-1);
+         long n = head-tail;
+         if (n > TRACE_RING_SIZE-pos) // (up to the end of the ring)
+            n = TRACE_RING_SIZE-pos;
+         check (fwrite(ring->record+pos, sizeof(TraceRecord), n, traceFile) == (size_t)n, "trace write failed");
+         tail += n;
+         res += n;
+      }
+      __atomic_store_n(&ring->tail, tail, __ATOMIC_RELEASE);
+   }
+   recordsWritten += res;
+   return res;
+}
+
+static void state_names(TraceHeader* header, int kind, int num_states, const char* (*name)(int state))
+{
+   check (num_states <= MAX_TRACE_STATES, "too many states to trace");
+
+   header->numStates[kind] = num_states;
+   for(int s = 0; s < num_states; s++)
+   {
+      strncpy(header->stateName[kind][s], name(s), MAX_TRACE_STATE_NAME-1);
+      for(int i = strlen(header->stateName[kind][s])-1; i >= 0 && header->stateName[kind][s][i] == ' '; i--)
+         header->stateName[kind][s][i] = '\0'; // (names padded for the boxes)
+   }
+}
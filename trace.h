@@ -0,0 +1,85 @@
+/**
+ *  \brief Binary event trace of the barbers and clients
+ *
+ * Each barber/client log also appends a fixed size record (simulation
+ * time, entity, old and new state, resource held and requests pending) to
+ * the trace ring of its placement unit (process, thread or worker), in
+ * shared memory: no text is rendered and no lock is taken, the producer
+ * only waits when its ring is full.  A collector thread of the main process
+ * drains the rings into the trace file, which starts with a header holding
+ * the state names.  The records of each ring keep their order; the
+ * trace-decode program merges them by time and prints them as text.
+ */
+
+#ifndef TRACE_H
+#define TRACE_H
+
+#include <stdio.h>
+#include "global.h"
+
+#define TRACE_MAGIC "BSTRACE1"
+#define TRACE_RING_SIZE 1024        // records per ring (a power of 2)
+#define MAX_TRACE_STATES 32
+#define MAX_TRACE_STATE_NAME 16
+
+// entity kinds
+#define TRACE_BARBER 0
+#define TRACE_CLIENT 1
+
+// resource kinds
+#define TRACE_NO_RESOURCE     0
+#define TRACE_BARBER_BENCH    1
+#define TRACE_CLIENT_BENCHES  2
+#define TRACE_BARBER_CHAIR    3
+#define TRACE_WASHBASIN       4
+
+typedef struct _TraceRecord_
+{
+   int time;                  // simulation clock (ms)
+   int entity;                // barber/client id
+   short resource;            // position of the resource held (-1 if none)
+   unsigned char kind;        // TRACE_BARBER or TRACE_CLIENT
+   unsigned char resourceKind;
+   unsigned char from;        // state
+   unsigned char to;
+   unsigned char request;     // requests mask pending
+   unsigned char unused;
+} TraceRecord;                // (16 bytes)
+
+/* trace file header (followed by the records) */
+typedef struct _TraceHeader_
+{
+   char magic[8];
+   int recordSize;
+   int virtualTime;
+   int numBarbers;
+   int numClients;
+   int numStates[2];                                          // [kind]
+   char stateName[2][MAX_TRACE_STATES][MAX_TRACE_STATE_NAME]; // [kind][state]
+} TraceHeader;
+
+typedef struct _TraceRing_
+{
+   long head CACHE_ALIGNED;   // records appended (by its unit only)
+   long stalls;               // appends that waited for the collector
+   long tail CACHE_ALIGNED;   // records drained (by the collector only)
+   TraceRecord record[TRACE_RING_SIZE] CACHE_ALIGNED;
+} TraceRing;
+
+typedef struct _Trace_
+{
+   int numRings;
+   TraceRing* ring;           // [numRings] one per placement unit, and the last one for the main process
+} Trace;
+
+size_t sizeof_trace_arrays(int num_rings);
+void init_trace(Trace* trace, int num_rings, Storage* storage);
+void start_trace(const char* path);  // (main process, before any log) writes the header, starts the collector
+void stop_trace();                   // (main process, once every unit is done) drains the rings
+
+void enter_trace(int ring);          // (from the unit's own thread) its records go to that ring
+void trace_event(int kind, int entity, int from, int to, int resource_kind, int resource, int request);
+
+void report_trace(FILE* out);        // one report line
+
+#endif
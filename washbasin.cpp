@@ -3,7 +3,10 @@
 #include "global.h"
 #include "utils.h"
 #include "box.h"
+#include "box-template.h"
 #include "logger.h"
+#include "compositor.h"
+#include "sim-clock.h"
 #include "washbasin.h"
 
 static const char* skel = 
@@ -15,20 +18,23 @@ static const char* skel =
    "|C##|B##|\n"
    "@---+---@";
 
+static int numLines = string_num_lines((char*)skel);       // (skeleton scanned once)
+static int numColumns = string_num_columns((char*)skel);
+static BoxTemplate skel_boxes;      // (compiled by the first init of a rendered shop)
 static int skel_length = num_lines_washbasin()*(num_columns_washbasin()+1)*4; // extra space for (pessimistic) utf8 encoding!
 
-static char* basin_not_used = string_concat(NULL, 0, BOX_HORIZONTAL, BOX_HORIZONTAL, BOX_HORIZONTAL_DOWN, BOX_HORIZONTAL, BOX_HORIZONTAL, NULL); 
+static char* basin_not_used = (char*)BOX_HORIZONTAL_TEXT BOX_HORIZONTAL_TEXT BOX_HORIZONTAL_DOWN_TEXT BOX_HORIZONTAL_TEXT BOX_HORIZONTAL_TEXT;
 
 static char* to_string_washbasin(Washbasin* basin);
 
 int num_lines_washbasin()
 {
-   return string_num_lines((char*)skel);
+   return numLines;
 }
 
 int num_columns_washbasin()
 {
-   return string_num_columns((char*)skel);
+   return numColumns;
 }
 
 void init_washbasin(Washbasin* basin, int id, int line, int column)
@@ -42,14 +48,20 @@ void init_washbasin(Washbasin* basin, int id, int line, int column)
    basin->clientID = 0;
    basin->barberID = 0;
    basin->completionPercentage = -1;
-   basin->internal = NULL;
-   char buf[31];
-   gen_boxes(buf, 30, "Basin #.##: progress:", "#", int2nstr(basin->id, 2));
+   basin->internal = (char*)mem_alloc(skel_length + 1);
    static char* translations[] = {
       SPLASH, (char*)"",
       NULL
    };
-   basin->logId = register_logger(buf, line ,column , num_lines_washbasin(), num_columns_washbasin(), translations);
+   basin->logId = -1;
+   if (!global->HEADLESS) // the logger only registers the areas of a rendered shop
+   {
+      if (!compiled_box_template(&skel_boxes))
+         init_box_template(&skel_boxes, skel);
+      char buf[31];
+      gen_boxes(buf, 30, "Basin #.##: progress:", "#", int2nstr(basin->id, 2));
+      basin->logId = register_logger(buf, line ,column , num_lines_washbasin(), num_columns_washbasin(), translations);
+   }
 }
 
 void term_washbasin(Washbasin* basin)
@@ -67,8 +79,8 @@ void log_washbasin(Washbasin* basin)
 {
    require (basin != NULL, "basin argument required");
 
-   spend(random_int(global->MIN_VITALITY_TIME_UNITS, global->MAX_VITALITY_TIME_UNITS));
-   send_log(basin->logId, to_string_washbasin(basin));
+   if (!global->HEADLESS)
+      compose_log(basin->logId, to_string_washbasin(basin));
 }
 
 static char* to_string_washbasin(Washbasin* basin)
@@ -76,7 +88,7 @@ static char* to_string_washbasin(Washbasin* basin)
    if (basin->internal == NULL)
       basin->internal = (char*)mem_alloc(skel_length + 1);
 
-   return gen_boxes(basin->internal, skel_length, skel,
+   return gen_box_template(&skel_boxes, basin->internal, skel_length,
          empty_washbasin(basin) ? " ---" : perc2str(basin->completionPercentage),
          empty_washbasin(basin) ? basin_not_used : SPLASH,
          empty_washbasin(basin) ? "--" : int2nstr(basin->clientID, 2),
@@ -141,6 +153,7 @@ void reserve_washbasin(Washbasin* basin, int barberID)
 
    basin->barberID = barberID;
    basin->completionPercentage = 0;
+   pace_sim_clock();
    log_washbasin(basin);
 }
 
@@ -153,6 +166,7 @@ void release_washbasin(Washbasin* basin, int barberID)
 
    basin->barberID = 0;
    basin->completionPercentage = -1;
+   pace_sim_clock();
    log_washbasin(basin);
 }
 
@@ -163,6 +177,7 @@ void sit_in_washbasin(Washbasin* basin, int clientID)
    require (!washbasin_with_a_client(basin), "basin occupied with a client");
 
    basin->clientID = clientID;
+   pace_sim_clock();
    log_washbasin(basin);
 }
 
@@ -174,6 +189,7 @@ void rise_from_washbasin(Washbasin* basin, int clientID)
    require (washbasin_service_finished(basin), "basin service not complete");
 
    basin->clientID = 0;
+   pace_sim_clock();
    log_washbasin(basin);
 }
 
@@ -193,6 +209,7 @@ void set_completion_washbasin(Washbasin* basin, int completionPercentage)
    require (complete_washbasin(basin), "washbasin is not complete");
 
    basin->completionPercentage = completionPercentage;
+   pace_sim_clock();
    log_washbasin(basin);
 }
 
@@ -7,6 +7,8 @@
 #ifndef WASHBASIN_H
 #define WASHBASIN_H
 
+#include "global.h"
+
 typedef struct _Washbasin_
 {
    int id; // 1, 2, ... (position in barber shop)
@@ -15,7 +17,7 @@ typedef struct _Washbasin_
    int completionPercentage; // [0;100]
    int logId;
    char* internal;
-} Washbasin;
+} CACHE_ALIGNED Washbasin;
 
 int num_lines_washbasin();
 int num_columns_washbasin();